@@ -0,0 +1,97 @@
+#ifndef SOL_ADAPTIVE_SAMPLING_H
+#define SOL_ADAPTIVE_SAMPLING_H
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include "sol/color.h"
+
+namespace sol {
+
+namespace detail {
+
+struct AdaptiveSamplingConfig {
+    float target_error = 0.0f;  ///< Relative standard error under which a pixel is converged (0 = adaptive sampling disabled)
+    size_t min_samples = 16;    ///< Minimum number of samples before a pixel can be considered converged
+    size_t max_boost = 4;       ///< Maximum factor by which the number of samples of unconverged pixels can be increased
+};
+
+} // namespace detail
+
+/// Tracks the first and second moments of the luminance of the samples of each pixel, in order to stop sampling pixels
+/// once the relative standard error of their mean is below a given target. The samples saved on converged pixels are
+/// given to the remaining ones, up to a maximum factor.
+///
+/// To keep the image a sum of `N` samples per pixel (where `N` is the total number of samples requested so far),
+/// converged pixels accumulate their current mean instead of new samples, and pixels that receive
+/// more samples than requested accumulate their mean scaled by the requested number of samples.
+class AdaptiveSampling {
+public:
+    using Config = detail::AdaptiveSamplingConfig;
+
+    AdaptiveSampling(const Config& config = {})
+        : config_(config)
+    {}
+
+    bool is_enabled() const { return config_.target_error > 0; }
+    const Config& config() const { return config_; }
+
+    /// Prepares a new frame. The statistics are cleared when `sample_index` is zero.
+    /// Returns the factor by which the number of samples of unconverged pixels should be increased.
+    size_t start_frame(size_t width, size_t height, size_t sample_index) {
+        if (sample_index == 0 || pixels_.size() != width * height) {
+            width_ = width;
+            pixels_.assign(width * height, PixelStats {});
+        }
+        auto active_count = std::count_if(pixels_.begin(), pixels_.end(), [] (const PixelStats& p) { return !p.is_converged; });
+        if (active_count == 0)
+            return 1;
+        return std::clamp<size_t>(pixels_.size() / active_count, 1, config_.max_boost);
+    }
+
+    bool is_converged(size_t x, size_t y) const { return pixels_[y * width_ + x].is_converged; }
+
+    /// Returns the number of samples recorded so far for the given pixel.
+    size_t sample_count(size_t x, size_t y) const { return pixels_[y * width_ + x].count; }
+
+    /// Returns true if all the pixels are converged.
+    bool is_converged() const {
+        return !pixels_.empty() && std::all_of(pixels_.begin(), pixels_.end(), [] (const PixelStats& p) { return p.is_converged; });
+    }
+
+    /// Records the samples of a pixel, and updates its convergence status.
+    /// This can be called concurrently for different pixels.
+    void add_samples(size_t x, size_t y, const RgbColor* samples, size_t count) {
+        auto& pixel = pixels_[y * width_ + x];
+        for (size_t i = 0; i < count; ++i) {
+            auto luminance = samples[i].luminance();
+            pixel.sum += luminance;
+            pixel.sum_sq += luminance * luminance;
+        }
+        pixel.count += count;
+
+        if (pixel.count >= std::max(config_.min_samples, size_t{2})) {
+            auto n = static_cast<double>(pixel.count);
+            auto mean = pixel.sum / n;
+            auto variance = std::max(0.0, (pixel.sum_sq - n * mean * mean) / (n - 1));
+            // The small constant avoids spending samples on pixels that are (almost) black
+            pixel.is_converged = std::sqrt(variance / n) <= config_.target_error * (mean + 1.0e-3);
+        }
+    }
+
+private:
+    struct PixelStats {
+        double sum = 0, sum_sq = 0;
+        size_t count = 0;
+        bool is_converged = false;
+    };
+
+    Config config_;
+    size_t width_ = 0;
+    std::vector<PixelStats> pixels_;
+};
+
+} // namespace sol
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef SOL_ALGORITHMS_BDPT_H
+#define SOL_ALGORITHMS_BDPT_H
+
+#include <vector>
+
+#include "sol/renderer.h"
+#include "sol/color.h"
+#include "sol/image.h"
+#include "sol/samplers.h"
+#include "sol/light_sampler.h"
+
+#include <proto/vec.h>
+
+#if defined(SOL_ENABLE_TBB)
+#include <par/tbb/executors.h>
+#elif defined(SOL_ENABLE_OMP)
+#include <par/omp/executors.h>
+#else
+#include <par/sequential_executor.h>
+#endif
+
+namespace sol {
+
+namespace detail {
+
+struct BdptConfig {
+    size_t max_path_len = 64;           ///< Maximum path length, in number of edges
+    size_t min_rr_path_len = 3;         ///< Minimum path length to enable Russian Roulette, for both subpaths
+    float  min_survival_prob = 0.05f;   ///< Minimum Russian Roulette survival probability (must be in `[0, 1]`)
+    float  max_survival_prob = 0.75f;   ///< Maximum Russian Roulette survival probability (must be in `[0, 1]`)
+    float  ray_offset = 1.e-5f;         ///< Ray offset, in order to avoid self-intersections. Usually scene-dependent.
+};
+
+} // namespace detail
+
+/// Bidirectional path tracer. For each sample of each pixel, a light subpath and a camera subpath are traced,
+/// and every vertex of the camera subpath is connected to every vertex of the light subpath, to the camera,
+/// and to a point on a light source. Contributions are weighted with the balance heuristic over all strategies,
+/// computed incrementally along the subpaths (see "Implementing Vertex Connection and Merging", by T. Davidovič).
+/// Connections of light vertices to the camera may land on any pixel, and are splatted atomically.
+class Bdpt final : public Renderer {
+public:
+    using Config = detail::BdptConfig;
+
+    Bdpt(const Scene& scene, const Config& config = {});
+
+    void render(Image&, size_t, size_t, RenderControl*) const override;
+
+private:
+    struct PathVertex;
+    struct CameraInfo;
+
+    void trace_light_path(PcgSampler&, const CameraInfo&, std::vector<PathVertex>&) const;
+    Color trace_camera_path(PcgSampler&, const proto::Vec2f&, const std::vector<PathVertex>&) const;
+
+    void connect_to_camera(const PathVertex&, const CameraInfo&) const;
+    Color connect_to_light(PcgSampler&, const PathVertex&) const;
+    Color connect_vertices(const PathVertex&, const PathVertex&) const;
+
+    bool is_occluded(const proto::Vec3f&, const proto::Vec3f&) const;
+
+#if defined(SOL_ENABLE_TBB)
+    par::tbb::Executor executor_;
+#elif defined(SOL_ENABLE_OMP)
+    par::omp::DynamicExecutor executor_;
+#else
+    par::SequentialExecutor executor_;
+#endif
+    Config config_;
+    PowerLightSampler light_sampler_;
+};
+
+} // namespace sol
+
+#endif
@@ -1,8 +1,16 @@
 #ifndef SOL_ALGORITHMS_PATH_TRACER_H
 #define SOL_ALGORITHMS_PATH_TRACER_H
 
+#include <optional>
+#include <mutex>
+#include <cassert>
+
 #include "sol/renderer.h"
 #include "sol/color.h"
+#include "sol/adaptive_sampling.h"
+#include "sol/path_guiding.h"
+#include "sol/aovs.h"
+#include "sol/samplers.h"
 
 #include <proto/ray.h>
 
@@ -16,7 +24,8 @@
 
 namespace sol {
 
-class Sampler;
+struct BsdfSample;
+struct SurfaceInfo;
 
 namespace detail {
 
@@ -26,6 +35,10 @@ struct PathTracerConfig {
     float  min_survival_prob = 0.05f;   ///< Minimum Russian Roulette survival probability (must be in `[0, 1]`)
     float  max_survival_prob = 0.75f;   ///< Maximum Russian Roulette survival probability (must be in `[0, 1]`)
     float  ray_offset = 1.e-5f;         ///< Ray offset, in order to avoid self-intersections. Usually scene-dependent.
+    AdaptiveSampling::Config adaptive_sampling = {}; ///< Adaptive sampling parameters (disabled by default)
+    SamplerType sampler = SamplerType::Random;          ///< Sampler used to generate the paths
+    PathGuiding::Config path_guiding = {};              ///< Path guiding parameters (disabled by default, only used by `PathTracer`)
+    AovLayout aovs = {};                                ///< AOVs written after the color channels (none by default, only used by `PathTracer`)
 };
 
 } // namespace detail
@@ -35,13 +48,27 @@ public:
     using Config = detail::PathTracerConfig;
 
     PathTracer(const Scene& scene, const Config& config = {})
-        : Renderer("PathTracer", scene), config_(config)
-    {}
+        : Renderer("PathTracer", scene)
+        , config_(config)
+        , adaptive_sampling_(config.adaptive_sampling)
+        , path_guiding_(config.path_guiding)
+    {
+        assert(scene.light_sampler && "the light sampler of the scene must be built with `Scene::finalize()` before creating this renderer");
+    }
 
-    void render(Image&, size_t, size_t) const override;
+    void render(Image&, size_t, size_t, RenderControl*) const override;
+    bool is_converged() const override;
 
 private:
-    Color trace_path(Sampler&, proto::Rayf) const;
+    struct GuidingVertex;
+
+    Color trace_sample(size_t, size_t, size_t, size_t, size_t, AovSample* = nullptr) const;
+    template <typename SamplerType>
+    Color trace_path(SamplerType&, proto::Rayf, AovSample* = nullptr) const;
+    template <typename SamplerType>
+    std::optional<BsdfSample> sample_guided(SamplerType&, float, const Bsdf&, const SurfaceInfo&, const proto::Vec3f&) const;
+    float guided_pdf(float, const proto::Vec3f&, const proto::Vec3f&) const;
+    void render_adaptive(Image&, size_t, size_t, RenderControl*) const;
 
 #if defined(SOL_ENABLE_TBB)
     par::tbb::Executor executor_;
@@ -51,6 +78,11 @@ private:
     par::SequentialExecutor executor_;
 #endif
     Config config_;
+    // The adaptive sampling statistics and the path guiding structure are updated by each frame.
+    // They are only accessed with the mutex held.
+    mutable std::mutex mutex_;
+    mutable AdaptiveSampling adaptive_sampling_;
+    mutable PathGuiding path_guiding_;
 };
 
 } // namespace sol
@@ -0,0 +1,108 @@
+#ifndef SOL_ALGORITHMS_SPPM_H
+#define SOL_ALGORITHMS_SPPM_H
+
+#include <vector>
+#include <mutex>
+#include <cstdint>
+
+#include "sol/renderer.h"
+#include "sol/color.h"
+#include "sol/samplers.h"
+#include "sol/light_sampler.h"
+
+#include <proto/vec.h>
+#include <proto/ray.h>
+
+#if defined(SOL_ENABLE_TBB)
+#include <par/tbb/executors.h>
+#elif defined(SOL_ENABLE_OMP)
+#include <par/omp/executors.h>
+#else
+#include <par/sequential_executor.h>
+#endif
+
+namespace sol {
+
+struct SurfaceInfo;
+
+namespace detail {
+
+struct SppmConfig {
+    size_t max_path_len = 64;           ///< Maximum path length, in number of edges, for both camera and photon paths
+    size_t min_rr_path_len = 3;         ///< Minimum path length to enable Russian Roulette on photon paths
+    float  min_survival_prob = 0.05f;   ///< Minimum Russian Roulette survival probability (must be in `[0, 1]`)
+    float  max_survival_prob = 0.75f;   ///< Maximum Russian Roulette survival probability (must be in `[0, 1]`)
+    float  ray_offset = 1.e-5f;         ///< Ray offset, in order to avoid self-intersections. Usually scene-dependent.
+    size_t photon_count = 1 << 18;      ///< Number of photon paths traced per iteration
+    float  initial_radius = 0.02f;      ///< Initial photon gathering radius. Usually scene-dependent.
+    float  radius_alpha = 2.0f / 3.0f;  ///< Fraction of the new photons kept at each iteration (must be in `]0, 1[`)
+};
+
+} // namespace detail
+
+/// Stochastic progressive photon mapping (see "Stochastic Progressive Photon Mapping", by T. Hachisuka and H. W. Jensen).
+/// Each iteration traces one camera path per pixel, up to its first non-specular vertex, then one photon pass,
+/// and stores the photons in a hash grid, to gather those near each of these vertices. The gathering radius of each pixel
+/// shrinks over iterations, which makes the estimate consistent. Unlike path tracing, this handles caustics seen
+/// through specular surfaces (e.g. light focused by water, seen through glass). Direct lighting is computed with
+/// next-event estimation, and only photons that have bounced at least once are gathered.
+/// One sample per pixel corresponds to one iteration, and the image always contains the current estimate times the
+/// number of iterations, so that it can be used as any other renderer. Since iterations depend on the previous ones,
+/// concurrent calls to `render()` are serialized.
+class Sppm final : public Renderer {
+public:
+    using Config = detail::SppmConfig;
+
+    Sppm(const Scene& scene, const Config& config = {});
+
+    void render(Image&, size_t, size_t, RenderControl*) const override;
+
+private:
+    struct Photon {
+        proto::Vec3f pos;
+        proto::Vec3f in_dir;    ///< Direction towards the previous vertex of the photon path
+        Color power;
+    };
+
+    /// Per-pixel statistics of the progressive estimate.
+    struct PixelStats {
+        float radius;
+        float photon_count;     ///< Accumulated photon count, after radius reduction
+        Color flux;             ///< Accumulated flux, after radius reduction
+        Color direct;           ///< Sum of the direct lighting estimates, over all iterations
+    };
+
+    struct VisiblePoint;
+
+    void trace_visible_point(PcgSampler&, const proto::Rayf&, PixelStats&, VisiblePoint&) const;
+    void trace_photons(size_t, RenderControl*) const;
+    void build_photon_grid(float) const;
+    void gather_photons(const VisiblePoint&, PixelStats&) const;
+    Color estimate_direct(PcgSampler&, const SurfaceInfo&, const Bsdf&, const proto::Vec3f&) const;
+
+    size_t cell_index(const proto::Vec3f&) const;
+    size_t cell_index(int32_t, int32_t, int32_t) const;
+
+#if defined(SOL_ENABLE_TBB)
+    par::tbb::Executor executor_;
+#elif defined(SOL_ENABLE_OMP)
+    par::omp::DynamicExecutor executor_;
+#else
+    par::SequentialExecutor executor_;
+#endif
+    Config config_;
+    PowerLightSampler light_sampler_;
+
+    // Photons are traced in batches of paths, each with its own list, and then sorted by grid cell.
+    // These buffers are only accessed with the mutex held.
+    mutable std::mutex mutex_;
+    mutable std::vector<std::vector<Photon>> photon_batches_;
+    mutable std::vector<Photon> photons_;
+    mutable std::vector<uint32_t> cell_starts_;
+    mutable float cell_size_ = 0.0f;
+    mutable std::vector<PixelStats> pixels_;
+};
+
+} // namespace sol
+
+#endif
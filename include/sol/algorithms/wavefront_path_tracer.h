@@ -0,0 +1,67 @@
+#ifndef SOL_ALGORITHMS_WAVEFRONT_PATH_TRACER_H
+#define SOL_ALGORITHMS_WAVEFRONT_PATH_TRACER_H
+
+#include <cassert>
+
+#include "sol/renderer.h"
+
+#if defined(SOL_ENABLE_TBB)
+#include <par/tbb/executors.h>
+#elif defined(SOL_ENABLE_OMP)
+#include <par/omp/executors.h>
+#else
+#include <par/sequential_executor.h>
+#endif
+
+namespace sol {
+
+namespace detail {
+
+struct WavefrontPathTracerConfig {
+    size_t max_path_len = 64;           ///< Maximum path length
+    size_t min_rr_path_len = 3;         ///< Minimum path length to enable Russian Roulette
+    float  min_survival_prob = 0.05f;   ///< Minimum Russian Roulette survival probability (must be in `[0, 1]`)
+    float  max_survival_prob = 0.75f;   ///< Maximum Russian Roulette survival probability (must be in `[0, 1]`)
+    float  ray_offset = 1.e-5f;         ///< Ray offset, in order to avoid self-intersections. Usually scene-dependent.
+    size_t wave_size = 1 << 16;         ///< Maximum number of paths that are traced simultaneously
+    size_t batch_size = 256;            ///< Number of rays per batch, for ray queries
+};
+
+} // namespace detail
+
+/// Path tracer that processes large sets of paths at once, stage by stage, instead of tracing one path at a time.
+/// The state of the paths is stored in SoA form, and each stage (intersection, emission, shading, shadow rays,
+/// occlusion, bounce) runs over all the paths that are alive. Paths are sorted by BSDF before shading, and ray queries
+/// are performed in batches. Light sampling and MIS are the same as in `PathTracer` with the random sampler, but
+/// Russian Roulette uses separate random streams, so individual samples differ while the image converges to the same result.
+/// Adaptive sampling, path guiding, AOVs, and other samplers are not supported.
+class WavefrontPathTracer final : public Renderer {
+public:
+    using Config = detail::WavefrontPathTracerConfig;
+
+    WavefrontPathTracer(const Scene& scene, const Config& config = {})
+        : Renderer("WavefrontPathTracer", scene), config_(config)
+    {
+        assert(scene.light_sampler && "the light sampler of the scene must be built with `Scene::finalize()` before creating this renderer");
+    }
+
+    void render(Image&, size_t, size_t, RenderControl*) const override;
+
+private:
+    struct Wave;
+
+    void trace_wave(Wave&) const;
+
+#if defined(SOL_ENABLE_TBB)
+    par::tbb::Executor executor_;
+#elif defined(SOL_ENABLE_OMP)
+    par::omp::DynamicExecutor executor_;
+#else
+    par::SequentialExecutor executor_;
+#endif
+    Config config_;
+};
+
+} // namespace sol
+
+#endif
@@ -0,0 +1,150 @@
+#ifndef SOL_AOVS_H
+#define SOL_AOVS_H
+
+#include <vector>
+#include <string>
+#include <optional>
+#include <algorithm>
+
+#include <proto/vec.h>
+
+#include "sol/color.h"
+#include "sol/image.h"
+#include "sol/tile_scheduler.h"
+
+namespace sol {
+
+/// Auxiliary output variables (AOVs), produced along with radiance, at the first non-specular hit of each path.
+enum class Aov {
+    Albedo,         ///< Reflectance of the surface, times the throughput of the specular surfaces in front of it
+    Normal,         ///< Shading normal, in world coordinates
+    Depth,          ///< Distance travelled by the path up to the hit
+    SampleCount     ///< Number of samples traced for the pixel
+};
+
+/// Values of the AOVs for one sample (or the sum of the values of several samples).
+struct AovSample {
+    Color albedo = Color::black();
+    proto::Vec3f normal = proto::Vec3f(0);
+    float depth = 0.0f;
+
+    AovSample& operator += (const AovSample& other) {
+        albedo += other.albedo;
+        normal += other.normal;
+        depth  += other.depth;
+        return *this;
+    }
+
+    AovSample operator * (float f) const {
+        return AovSample { albedo * f, normal * f, depth * f };
+    }
+};
+
+/// Set of AOVs enabled for an image. Their channels are stored after the three color channels of the image,
+/// in the order of the `Aov` enumeration. Like colors, AOV channels contain the sum of the values of all the samples,
+/// except for the sample count, and are normalized at the end of rendering with `normalize()`.
+struct AovLayout {
+    bool albedo = false;
+    bool normal = false;
+    bool depth = false;
+    bool sample_count = false;
+
+    bool is_enabled(Aov aov) const {
+        switch (aov) {
+            case Aov::Albedo:      return albedo;
+            case Aov::Normal:      return normal;
+            case Aov::Depth:       return depth;
+            case Aov::SampleCount: return sample_count;
+            default:               return false;
+        }
+    }
+
+    bool has_any() const { return albedo || normal || depth || sample_count; }
+
+    /// Returns the index of the first channel of the given AOV in the image, or nothing if it is not enabled.
+    std::optional<size_t> first_channel(Aov aov) const {
+        if (!is_enabled(aov))
+            return std::nullopt;
+        size_t channel = 3;
+        for (auto other : { Aov::Albedo, Aov::Normal, Aov::Depth }) {
+            if (other == aov)
+                break;
+            channel += is_enabled(other) ? channel_count(other) : 0;
+        }
+        return std::make_optional(channel);
+    }
+
+    /// Returns the total number of channels of an image with this layout, including colors.
+    size_t channel_count() const {
+        return 3 + (albedo ? 3 : 0) + (normal ? 3 : 0) + (depth ? 1 : 0) + (sample_count ? 1 : 0);
+    }
+
+    static size_t channel_count(Aov aov) { return aov == Aov::Albedo || aov == Aov::Normal ? 3 : 1; }
+
+    /// Returns the names of the channels of an image with this layout, following the layer naming convention of EXR files.
+    std::vector<std::string> channel_names() const {
+        std::vector<std::string> names { "R", "G", "B" };
+        if (albedo)       names.insert(names.end(), { "albedo.R", "albedo.G", "albedo.B" });
+        if (normal)       names.insert(names.end(), { "normal.X", "normal.Y", "normal.Z" });
+        if (depth)        names.push_back("depth.Z");
+        if (sample_count) names.push_back("samples.Y");
+        return names;
+    }
+
+    /// Creates an image with the channels required by this layout.
+    Image create_image(size_t width, size_t height) const {
+        Image image(width, height, channel_count());
+        if (has_any())
+            image.set_channel_names(channel_names());
+        return image;
+    }
+
+    /// Accumulates the AOVs of the given number of samples, given the sum of their values, into a tile buffer.
+    void accumulate(TileBuffer& tile, size_t x, size_t y, const AovSample& sum, size_t count) const {
+        if (auto channel = first_channel(Aov::Albedo)) {
+            tile.accumulate(x, y, *channel + 0, sum.albedo.r);
+            tile.accumulate(x, y, *channel + 1, sum.albedo.g);
+            tile.accumulate(x, y, *channel + 2, sum.albedo.b);
+        }
+        if (auto channel = first_channel(Aov::Normal)) {
+            for (size_t i = 0; i < 3; ++i)
+                tile.accumulate(x, y, *channel + i, sum.normal[i]);
+        }
+        if (auto channel = first_channel(Aov::Depth))
+            tile.accumulate(x, y, *channel, sum.depth);
+        if (auto channel = first_channel(Aov::SampleCount))
+            tile.accumulate(x, y, *channel, static_cast<float>(count));
+    }
+
+    /// Returns the sum of the AOVs of a pixel, as stored in the given image.
+    AovSample aovs_at(const Image& image, size_t x, size_t y) const {
+        auto i = y * image.width() + x;
+        AovSample sum;
+        if (auto channel = first_channel(Aov::Albedo))
+            sum.albedo = Color(image.channel(*channel)[i], image.channel(*channel + 1)[i], image.channel(*channel + 2)[i]);
+        if (auto channel = first_channel(Aov::Normal)) {
+            for (size_t j = 0; j < 3; ++j)
+                sum.normal[j] = image.channel(*channel + j)[i];
+        }
+        if (auto channel = first_channel(Aov::Depth))
+            sum.depth = image.channel(*channel)[i];
+        return sum;
+    }
+
+    /// Divides the channels of the given image by the number of samples, except the sample count.
+    void normalize(Image& image, size_t count) const {
+        auto sample_count_channel = first_channel(Aov::SampleCount);
+        auto inv_count = 1.0f / static_cast<float>(count);
+        for (size_t i = 0; i < image.channel_count(); ++i) {
+            if (i == sample_count_channel)
+                continue;
+            auto& channel = image.channel(i);
+            std::transform(channel.get(), channel.get() + image.width() * image.height(), channel.get(),
+                [&] (float x) { return x * inv_count; });
+        }
+    }
+};
+
+} // namespace sol
+
+#endif
@@ -9,10 +9,10 @@
 
 #include "sol/color.h"
 #include "sol/geometry.h"
+#include "sol/samplers.h"
 
 namespace sol {
 
-class Sampler;
 class Texture;
 class ColorTexture;
 
@@ -32,7 +32,8 @@ public:
         PhongBsdf,
         MirrorBsdf,
         GlassBsdf,
-        InterpBsdf
+        InterpBsdf,
+        Custom          ///< User-defined BSDFs, which are only accessed through virtual functions
     } tag;
 
     /// Classification of BSDF shapes
@@ -79,9 +80,19 @@ public:
         return 0.0f;
     }
 
+    /// Returns the reflectance of the material at the given surface point.
+    /// This is only used to produce auxiliary outputs (e.g. for denoising), not for rendering.
+    virtual Color albedo([[maybe_unused]] const SurfaceInfo& surf_info) const {
+        return Color::black();
+    }
+
     virtual proto::fnv::Hasher& hash(proto::fnv::Hasher&) const = 0;
     virtual bool equals(const Bsdf&) const = 0;
 
+    /// Calls the given function with this BSDF, cast to its concrete type when it is one of the built-in BSDFs,
+    /// so that calls made through it are resolved statically. Other BSDFs are passed as a `Bsdf`.
+    template <typename F> decltype(auto) visit(F&&) const;
+
 protected:
     // Utility function to check the validity of a `BsdfSample`.
     // It prevents corner cases that will cause issues (zero pdf, direction parallel/under the surface).
@@ -100,8 +111,11 @@ public:
     DiffuseBsdf(const ColorTexture&);
 
     std::optional<BsdfSample> sample(Sampler&, const SurfaceInfo&, const proto::Vec3f&, bool) const override;
+    template <BuiltinSampler SamplerType>
+    std::optional<BsdfSample> sample(SamplerType&, const SurfaceInfo&, const proto::Vec3f&, bool) const;
     Color eval(const proto::Vec3f&, const SurfaceInfo&, const proto::Vec3f&) const override;
     float pdf(const proto::Vec3f&, const SurfaceInfo&, const proto::Vec3f&) const override;
+    Color albedo(const SurfaceInfo&) const override;
 
     proto::fnv::Hasher& hash(proto::fnv::Hasher&) const override;
     bool equals(const Bsdf&) const override;
@@ -116,8 +130,11 @@ public:
     PhongBsdf(const ColorTexture&, const Texture&);
 
     std::optional<BsdfSample> sample(Sampler&, const SurfaceInfo&, const proto::Vec3f&, bool) const override;
+    template <BuiltinSampler SamplerType>
+    std::optional<BsdfSample> sample(SamplerType&, const SurfaceInfo&, const proto::Vec3f&, bool) const;
     Color eval(const proto::Vec3f&, const SurfaceInfo&, const proto::Vec3f&) const override;
     float pdf(const proto::Vec3f&, const SurfaceInfo&, const proto::Vec3f&) const override;
+    Color albedo(const SurfaceInfo&) const override;
 
     proto::fnv::Hasher& hash(proto::fnv::Hasher&) const override;
     bool equals(const Bsdf&) const override;
@@ -135,6 +152,9 @@ public:
     MirrorBsdf(const ColorTexture&);
 
     std::optional<BsdfSample> sample(Sampler&, const SurfaceInfo&, const proto::Vec3f&, bool) const override;
+    template <BuiltinSampler SamplerType>
+    std::optional<BsdfSample> sample(SamplerType&, const SurfaceInfo&, const proto::Vec3f&, bool) const;
+    Color albedo(const SurfaceInfo&) const override;
     proto::fnv::Hasher& hash(proto::fnv::Hasher&) const override;
     bool equals(const Bsdf&) const override;
 
@@ -151,6 +171,9 @@ public:
         const Texture& eta);
 
     std::optional<BsdfSample> sample(Sampler&, const SurfaceInfo&, const proto::Vec3f&, bool) const override;
+    template <BuiltinSampler SamplerType>
+    std::optional<BsdfSample> sample(SamplerType&, const SurfaceInfo&, const proto::Vec3f&, bool) const;
+    Color albedo(const SurfaceInfo&) const override;
     proto::fnv::Hasher& hash(proto::fnv::Hasher&) const override;
     bool equals(const Bsdf&) const override;
 
@@ -166,8 +189,11 @@ public:
     InterpBsdf(const Bsdf*, const Bsdf*, const Texture&);
 
     std::optional<BsdfSample> sample(Sampler&, const SurfaceInfo&, const proto::Vec3f&, bool) const override;
+    template <BuiltinSampler SamplerType>
+    std::optional<BsdfSample> sample(SamplerType&, const SurfaceInfo&, const proto::Vec3f&, bool) const;
     RgbColor eval(const proto::Vec3f&, const SurfaceInfo&, const proto::Vec3f&) const override;
     float pdf(const proto::Vec3f&, const SurfaceInfo&, const proto::Vec3f&) const override;
+    Color albedo(const SurfaceInfo&) const override;
 
     proto::fnv::Hasher& hash(proto::fnv::Hasher&) const override;
     bool equals(const Bsdf&) const override;
@@ -180,6 +206,44 @@ private:
     const Texture& k_;
 };
 
+template <typename F>
+decltype(auto) Bsdf::visit(F&& f) const {
+    switch (tag) {
+        case Tag::DiffuseBsdf: return f(static_cast<const DiffuseBsdf&>(*this));
+        case Tag::PhongBsdf:   return f(static_cast<const PhongBsdf&>(*this));
+        case Tag::MirrorBsdf:  return f(static_cast<const MirrorBsdf&>(*this));
+        case Tag::GlassBsdf:   return f(static_cast<const GlassBsdf&>(*this));
+        case Tag::InterpBsdf:  return f(static_cast<const InterpBsdf&>(*this));
+        default:               return f(*this);
+    }
+}
+
+/// Non-virtual versions of the BSDF functions, for use in performance-sensitive code.
+namespace dispatch {
+
+inline Color eval(const Bsdf& bsdf, const proto::Vec3f& in_dir, const SurfaceInfo& surf_info, const proto::Vec3f& out_dir) {
+    return bsdf.visit([&] (auto& b) { return b.eval(in_dir, surf_info, out_dir); });
+}
+
+/// When the concrete type of the sampler is one of the built-in samplers, the random numbers drawn
+/// by built-in BSDFs do not go through a virtual call either.
+template <typename SamplerType>
+std::optional<BsdfSample> sample(
+    const Bsdf& bsdf, SamplerType& sampler, const SurfaceInfo& surf_info, const proto::Vec3f& out_dir, bool is_adjoint = false)
+{
+    return bsdf.visit([&] (auto& b) { return b.sample(sampler, surf_info, out_dir, is_adjoint); });
+}
+
+inline float pdf(const Bsdf& bsdf, const proto::Vec3f& in_dir, const SurfaceInfo& surf_info, const proto::Vec3f& out_dir) {
+    return bsdf.visit([&] (auto& b) { return b.pdf(in_dir, surf_info, out_dir); });
+}
+
+inline Color albedo(const Bsdf& bsdf, const SurfaceInfo& surf_info) {
+    return bsdf.visit([&] (auto& b) { return b.albedo(surf_info); });
+}
+
+} // namespace dispatch
+
 } // namespace sol
 
 #endif
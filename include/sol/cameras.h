@@ -24,6 +24,7 @@ public:
     /// Generates a ray for a point on the image plane, represented by uv-coordinates.
     virtual proto::Rayf generate_ray(const proto::Vec2f& uv) const = 0;
     /// Projects a point onto the image plane and returns the corresponding uv-coordinates.
+    /// Points that are behind the camera are projected outside of the image plane.
     virtual proto::Vec2f project(const proto::Vec3f& point) const = 0;
     /// Returns a point onto the image plane from uv-coordinates.
     virtual proto::Vec3f unproject(const proto::Vec2f& uv) const = 0;
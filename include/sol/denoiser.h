@@ -0,0 +1,66 @@
+#ifndef SOL_DENOISER_H
+#define SOL_DENOISER_H
+
+#include "sol/image.h"
+#include "sol/aovs.h"
+#include "sol/tile_scheduler.h"
+
+#if defined(SOL_ENABLE_TBB)
+#include <par/tbb/executors.h>
+#elif defined(SOL_ENABLE_OMP)
+#include <par/omp/executors.h>
+#else
+#include <par/sequential_executor.h>
+#endif
+
+namespace sol {
+
+namespace detail {
+
+struct DenoiserConfig {
+    size_t radius = 6;              ///< Radius of the filter window, in pixels
+    size_t patch_radius = 1;        ///< Radius of the patches compared to weigh the pixels of the window, in pixels
+    float  spatial_sigma = 3.0f;    ///< Standard deviation of the spatial weights, in pixels
+    float  color_sigma = 1.0f;      ///< Standard deviation of the weights on the relative color distance between patches
+    float  albedo_sigma = 0.1f;     ///< Standard deviation of the weights on the albedo distance (if available)
+    float  normal_sigma = 0.2f;     ///< Standard deviation of the weights on the normal distance (if available)
+    float  depth_sigma = 0.05f;     ///< Standard deviation of the weights on the relative depth distance (if available)
+};
+
+} // namespace detail
+
+/// Post-process filter that removes noise from rendered images. This is a joint (cross) bilateral filter, where the color
+/// weights use non-local means (distances between patches instead of pixels), and that uses the albedo, normal, and depth
+/// AOVs as additional guides when they are present in the image. Colors are divided by the albedo before filtering, so
+/// that textures are not blurred. See "Adaptive Rendering with Non-Local Means Filtering", by F. Rousselle et al.
+class Denoiser {
+public:
+    using Config = detail::DenoiserConfig;
+
+    Denoiser(const Config& config = {})
+        : config_(config)
+    {}
+
+    /// Returns the denoised colors of the given image, which contains the AOVs of the given layout.
+    /// All the channels (except the sample count) are multiplied by the given scale before filtering, which allows
+    /// to denoise the output of a `RenderJob` (which is a sum of samples) without normalizing it first.
+    Image denoise(const Image& image, const AovLayout& aovs = {}, float scale = 1.0f) const;
+
+    /// Returns the scheduler used to distribute the pixels of the image over threads.
+    TileScheduler& tile_scheduler() { return tile_scheduler_; }
+
+private:
+#if defined(SOL_ENABLE_TBB)
+    par::tbb::Executor executor_;
+#elif defined(SOL_ENABLE_OMP)
+    par::omp::DynamicExecutor executor_;
+#else
+    par::SequentialExecutor executor_;
+#endif
+    Config config_;
+    mutable TileScheduler tile_scheduler_;
+};
+
+} // namespace sol
+
+#endif
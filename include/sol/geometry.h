@@ -1,14 +1,20 @@
 #ifndef SOL_GEOMETRY_H
 #define SOL_GEOMETRY_H
 
+#include <optional>
+#include <span>
+
 #include <proto/vec.h>
 #include <proto/mat.h>
 #include <proto/ray.h>
+#include <proto/bbox.h>
 
 namespace sol {
 
 class Bsdf;
 class Light;
+class Geometry;
+struct AffineTransform;
 
 /// Surface information for a specific point on a surface.
 /// This information is required to perform various shading operations.
@@ -30,16 +36,73 @@ struct Hit {
     const Bsdf* bsdf;       ///< BSDF at the hit point, if any (can be null)
 };
 
+/// Compact result of intersecting a ray with a scene node, from which the surface information can be computed on demand.
+/// This is cheaper to obtain than a `Hit`, and sufficient for algorithms that only need the distance, the light, or the BSDF.
+struct HitRecord {
+    const Geometry* geometry;                   ///< Object that contains the primitive that was hit
+    const AffineTransform* inverse_transform;   ///< World-to-object transformation, owned by the instance group (null if not instanced)
+    size_t prim_index;                          ///< Index of the primitive (the meaning of this index depends on the object)
+    float t, u, v;                              ///< Distance along the ray, and coordinates on the primitive
+    const Light* light;                         ///< Light source at the hit point, if any (can be null)
+    const Bsdf* bsdf;                           ///< BSDF at the hit point, if any (can be null)
+
+    /// Computes the surface information at the hit point, given the ray that produced this record.
+    SurfaceInfo surface_info(const proto::Rayf&) const;
+};
+
 class Geometry {
 public:
     virtual ~Geometry() = default;
 
+    /// Intersects the node with a ray, returns either a `HitRecord` that corresponds
+    /// to the closest intersection along the ray, or nothing.
+    /// If an intersection is found, the `tmax` parameter of the ray is updated.
+    virtual std::optional<HitRecord> intersect_closest_record(proto::Rayf&) const = 0;
+    /// Computes the surface information for a record returned by this node, in the local coordinate system of the node.
+    /// Use `HitRecord::surface_info()` instead, which takes instancing into account.
+    virtual SurfaceInfo surface_info(const proto::Rayf&, const HitRecord&) const = 0;
+
     /// Intersects the node with a ray, returns either a `Hit` that corresponds
     /// to the closest intersection along the ray, or nothing.
     /// If an intersection is found, the `tmax` parameter of the ray is updated.
-    virtual std::optional<Hit> intersect_closest(proto::Rayf&) const = 0;
+    /// This is equivalent to `intersect_closest_record()` followed by `HitRecord::surface_info()`.
+    std::optional<Hit> intersect_closest(proto::Rayf& ray) const {
+        if (auto record = intersect_closest_record(ray))
+            return std::make_optional(Hit { record->surface_info(ray), record->light, record->bsdf });
+        return std::nullopt;
+    }
     /// Tests if a given ray intersects the node or not.
     virtual bool intersect_any(const proto::Rayf&) const = 0;
+    /// Returns a bounding box that encloses the node.
+    virtual proto::BBoxf bbox() const = 0;
+
+    /// Intersects a batch of rays with the node. Only the rays for which `active` is true are processed,
+    /// and for those, the corresponding element of `hits` is set to the result of `intersect_closest_record()`.
+    /// The default implementation processes one ray at a time.
+    virtual void intersect_closest_batch(
+        std::span<proto::Rayf> rays,
+        std::span<const bool> active,
+        std::span<std::optional<HitRecord>> hits) const
+    {
+        for (size_t i = 0; i < rays.size(); ++i) {
+            if (active[i])
+                hits[i] = intersect_closest_record(rays[i]);
+        }
+    }
+
+    /// Tests a batch of rays for intersection with the node. Only the rays for which `active` is true are processed,
+    /// and for those, the corresponding element of `hits` is set to the result of `intersect_any()`.
+    /// The default implementation processes one ray at a time.
+    virtual void intersect_any_batch(
+        std::span<const proto::Rayf> rays,
+        std::span<const bool> active,
+        std::span<bool> hits) const
+    {
+        for (size_t i = 0; i < rays.size(); ++i) {
+            if (active[i])
+                hits[i] = intersect_any(rays[i]);
+        }
+    }
 };
 
 } // namespace sol
@@ -4,7 +4,9 @@
 #include <optional>
 #include <memory>
 #include <vector>
+#include <atomic>
 #include <string_view>
+#include <string>
 #include <cmath>
 #include <cassert>
 
@@ -14,7 +16,7 @@ namespace sol {
 
 /// Image represented as a list of floating-point channels, each having the same width and height.
 /// An image can have an arbitrary number of channels, but some image formats only support 3 or 4 channels.
-/// By convention, the top-left corner of the image is at (0, 0).
+/// By convention, the top-left corner of the image is at (0, 0). The color functions use the first three channels.
 struct Image {
     template <size_t Bits> using Word = std::make_unsigned_t<proto::SizedIntegerType<Bits>>;
 
@@ -46,22 +48,40 @@ public:
     size_t channel_count() const { return channels_.size(); }
 
     RgbColor rgb_at(size_t x, size_t y) const {
-        assert(channel_count() == 3);
+        assert(channel_count() >= 3);
         auto i = y * width_ + x;
         return RgbColor(channels_[0][i], channels_[1][i], channels_[2][i]);
     }
 
     void accumulate(size_t x, size_t y, const RgbColor& color) {
-        assert(channel_count() == 3);
+        assert(channel_count() >= 3);
         auto i = y * width_ + x;
         channels_[0][i] += color.r;
         channels_[1][i] += color.g;
         channels_[2][i] += color.b;
     }
 
+    /// Same as `accumulate()`, but can be called concurrently for the same pixel.
+    /// This should not be mixed with non-atomic accesses to the image while other threads are running.
+    void atomic_accumulate(size_t x, size_t y, const RgbColor& color) {
+        assert(channel_count() >= 3);
+        auto i = y * width_ + x;
+        std::atomic_ref<float>(channels_[0][i]).fetch_add(color.r, std::memory_order_relaxed);
+        std::atomic_ref<float>(channels_[1][i]).fetch_add(color.g, std::memory_order_relaxed);
+        std::atomic_ref<float>(channels_[2][i]).fetch_add(color.b, std::memory_order_relaxed);
+    }
+
     Channel& channel(size_t i) { return channels_[i]; }
     const Channel& channel(size_t i) const { return channels_[i]; }
 
+    /// Names of the channels, for formats that support them (e.g. `albedo.R` for a layer of a multi-layer EXR image).
+    /// When empty, formats use default names.
+    const std::vector<std::string>& channel_names() const { return channel_names_; }
+    void set_channel_names(std::vector<std::string>&& names) {
+        assert(names.empty() || names.size() == channel_count());
+        channel_names_ = std::move(names);
+    }
+
     /// Resets every pixel in the image to the given value.
     void clear(float value = 0.0f);
 
@@ -95,6 +115,7 @@ private:
     size_t width_ = 0;
     size_t height_ = 0;
     std::vector<std::unique_ptr<float[]>> channels_;
+    std::vector<std::string> channel_names_;
 };
 
 } // namespace sol
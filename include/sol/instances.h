@@ -0,0 +1,66 @@
+#ifndef SOL_INSTANCES_H
+#define SOL_INSTANCES_H
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <proto/vec.h>
+#include <proto/bbox.h>
+
+#include "sol/geometry.h"
+#include "sol/transform.h"
+
+namespace sol {
+
+/// Set of instances of other geometric objects, each placed with its own transformation.
+/// Instanced objects are not owned by this object, and must outlive it.
+/// Intersection is performed with a top-level BVH over the bounding boxes of the instances.
+/// Nested groups are traversed like any other object. The transformations from this group to the objects
+/// of the nested groups are composed when the group is built, so that hit records only need to point to them.
+/// Light sources are not transformed by this object: Each instance maps the lights
+/// of the instanced object to their transformed counterparts, and hits on lights that are not in this map report no light.
+class InstanceGroup final : public Geometry {
+public:
+    using LightMap = std::unordered_map<const Light*, const Light*>;
+
+    struct Instance {
+        const Geometry* geometry;
+        AffineTransform transform;
+        LightMap lights = {};   ///< Lights of the instanced object, mapped to the lights placed by this instance
+    };
+
+    InstanceGroup(std::vector<Instance>&&);
+    ~InstanceGroup();
+
+    std::optional<HitRecord> intersect_closest_record(proto::Rayf&) const override;
+    SurfaceInfo surface_info(const proto::Rayf&, const HitRecord&) const override;
+    bool intersect_any(const proto::Rayf&) const override;
+    proto::BBoxf bbox() const override;
+
+    size_t instance_count() const { return instances_.size(); }
+
+private:
+    struct BvhData;
+
+    struct TransformedInstance {
+        const Geometry* geometry;
+        const InstanceGroup* nested_group;  ///< Same as `geometry` if it is a group, otherwise null
+        AffineTransform transform;
+        AffineTransform inverse;
+        LightMap lights;
+        size_t first_inverse;               ///< Index of the first world-to-object transformation of this instance
+    };
+
+    proto::Rayf to_local(const TransformedInstance&, const proto::Rayf&) const;
+
+    std::vector<TransformedInstance> instances_;
+    /// World-to-object transformations referenced by hit records. Instances of regular objects have one,
+    /// while instances of nested groups have one per transformation of the nested group.
+    std::vector<AffineTransform> inverses_;
+    std::unique_ptr<BvhData> bvh_data_;
+};
+
+} // namespace sol
+
+#endif
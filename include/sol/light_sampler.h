@@ -0,0 +1,104 @@
+#ifndef SOL_LIGHT_SAMPLER_H
+#define SOL_LIGHT_SAMPLER_H
+
+#include <vector>
+#include <optional>
+#include <unordered_map>
+#include <cstdint>
+
+#include <proto/vec.h>
+
+#include "sol/lights.h"
+
+namespace sol {
+
+class Sampler;
+
+/// Light source picked by a `LightSampler`, along with the probability to pick it.
+struct LightPick {
+    const Light* light;
+    float prob;
+};
+
+/// Strategy to pick a light source to illuminate a given surface point, for next-event estimation.
+class LightSampler {
+public:
+    virtual ~LightSampler() {}
+
+    /// Picks a light source to illuminate the given point, with the given surface normal.
+    /// Returns nothing if no light source can illuminate the point.
+    virtual std::optional<LightPick> sample(Sampler&, const proto::Vec3f& point, const proto::Vec3f& normal) const = 0;
+
+    /// Returns the probability that `sample()` picks the given light source, for the given point and surface normal.
+    virtual float pdf(const Light&, const proto::Vec3f& point, const proto::Vec3f& normal) const = 0;
+};
+
+/// Picks light sources uniformly.
+class UniformLightSampler final : public LightSampler {
+public:
+    UniformLightSampler(const std::vector<const Light*>&);
+
+    std::optional<LightPick> sample(Sampler&, const proto::Vec3f&, const proto::Vec3f&) const override;
+    float pdf(const Light&, const proto::Vec3f&, const proto::Vec3f&) const override;
+
+private:
+    std::vector<const Light*> lights_;
+};
+
+/// Picks light sources with a probability proportional to their power, in constant time, using an alias table.
+/// See "A Linear Algorithm for Generating Random Numbers with a Given Distribution", by M. D. Vose.
+class PowerLightSampler final : public LightSampler {
+public:
+    PowerLightSampler(const std::vector<const Light*>&);
+
+    std::optional<LightPick> sample(Sampler&, const proto::Vec3f&, const proto::Vec3f&) const override;
+    float pdf(const Light&, const proto::Vec3f&, const proto::Vec3f&) const override;
+
+private:
+    struct AliasEntry {
+        float threshold;    ///< Probability to keep the entry instead of using its alias
+        uint32_t alias;
+    };
+
+    std::vector<const Light*> lights_;
+    std::vector<float> probs_;
+    std::vector<AliasEntry> entries_;
+    std::unordered_map<const Light*, uint32_t> indices_;
+};
+
+/// Hierarchy of light sources, where each node stores bounds on the positions, power, and directions of emission
+/// of the lights below it. Lights are picked by traversing the tree from the root, choosing children with a
+/// probability proportional to an estimate of their contribution to the shading point, which accounts for their
+/// power, distance, and orientation. See "Importance Sampling of Many Lights With Adaptive Tree Splitting",
+/// by A. Conty Estevez and C. Kulla.
+class LightTree final : public LightSampler {
+public:
+    LightTree(const std::vector<const Light*>&);
+
+    std::optional<LightPick> sample(Sampler&, const proto::Vec3f&, const proto::Vec3f&) const override;
+    float pdf(const Light&, const proto::Vec3f&, const proto::Vec3f&) const override;
+
+    size_t node_count() const { return nodes_.size(); }
+
+private:
+    struct Node {
+        LightBounds bounds;
+        uint32_t first_child_or_light;  ///< Index of the first child for inner nodes, index of the light for leaves
+        uint32_t parent;
+        bool is_leaf;
+    };
+
+    struct BuildItem;
+
+    void build(uint32_t, BuildItem*, size_t, uint32_t);
+
+    static float importance(const LightBounds&, const proto::Vec3f&, const proto::Vec3f&);
+
+    std::vector<Node> nodes_;
+    std::vector<const Light*> lights_;
+    std::unordered_map<const Light*, uint32_t> leaves_;
+};
+
+} // namespace sol
+
+#endif
@@ -4,16 +4,17 @@
 #include <optional>
 
 #include <proto/vec.h>
+#include <proto/bbox.h>
 #include <proto/hash.h>
 #include <proto/triangle.h>
 #include <proto/sphere.h>
 
 #include "sol/color.h"
 #include "sol/shapes.h"
+#include "sol/samplers.h"
 
 namespace sol {
 
-class Sampler;
 class ColorTexture;
 
 /// Result from sampling the area of a light source from another surface point.
@@ -44,12 +45,24 @@ struct EmissionValue {
     float pdf_dir;      ///< Probability to sample the direction
 };
 
+/// Conservative bounds on the positions and directions of emission of a light source, used to build light hierarchies.
+/// The emitting surface normals lie in a cone of axis `axis` and half-angle `acos(cos_theta_o)`, and light is emitted
+/// in directions within `acos(cos_theta_e)` of these normals.
+struct LightBounds {
+    proto::BBoxf bbox;  ///< Bounding box of the emitting surface
+    proto::Vec3f axis;  ///< Axis of the cone of surface normals
+    float cos_theta_o;  ///< Cosine of the half-angle of the cone of surface normals
+    float cos_theta_e;  ///< Cosine of the maximum angle between an emission direction and the surface normal
+    float power;        ///< Total emitted power (luminance)
+};
+
 class Light {
 public:
     const enum class Tag {
         PointLight,
         UniformTriangleLight,
-        UniformSphereLight
+        UniformSphereLight,
+        Custom                  ///< User-defined lights, which are only accessed through virtual functions
     } tag;
 
     Light(Tag tag)
@@ -75,9 +88,16 @@ public:
     /// Returns true if the light source has an area (i.e. it can be hit when intersecting a ray with the scene).
     virtual bool has_area() const = 0;
 
+    /// Returns bounds on the emission of this light source.
+    virtual LightBounds bounds() const = 0;
+
     virtual proto::fnv::Hasher& hash(proto::fnv::Hasher&) const = 0;
     virtual bool equals(const Light&) const = 0;
 
+    /// Calls the given function with this light, cast to its concrete type when it is one of the built-in lights,
+    /// so that calls made through it are resolved statically. Other lights are passed as a `Light`.
+    template <typename F> decltype(auto) visit(F&&) const;
+
 protected:
     // Utility function to create a `LightSample`.
     // Just like its counterpart for `BsdfSample`, this prevents corner cases for pdfs or cosines.
@@ -95,14 +115,22 @@ public:
 
     std::optional<LightAreaSample> sample_area(Sampler&, const proto::Vec3f&) const override;
     std::optional<LightEmissionSample> sample_emission(Sampler&) const override;
+    template <BuiltinSampler SamplerType>
+    std::optional<LightAreaSample> sample_area(SamplerType&, const proto::Vec3f&) const;
+    template <BuiltinSampler SamplerType>
+    std::optional<LightEmissionSample> sample_emission(SamplerType&) const;
     EmissionValue emission(const proto::Vec3f&, const proto::Vec3f&, const proto::Vec2f&) const override;
     float pdf_from(const proto::Vec3f&, const proto::Vec2f&) const override;
 
     bool has_area() const override { return false; }
+    LightBounds bounds() const override;
 
     proto::fnv::Hasher& hash(proto::fnv::Hasher&) const override;
     bool equals(const Light&) const override;
 
+    const proto::Vec3f& pos() const { return pos_; }
+    const Color& intensity() const { return intensity_; }
+
 private:
     proto::Vec3f pos_;
     Color intensity_;
@@ -118,14 +146,22 @@ public:
 
     std::optional<LightAreaSample> sample_area(Sampler&, const proto::Vec3f&) const override;
     std::optional<LightEmissionSample> sample_emission(Sampler&) const override;
+    template <BuiltinSampler SamplerType>
+    std::optional<LightAreaSample> sample_area(SamplerType&, const proto::Vec3f&) const;
+    template <BuiltinSampler SamplerType>
+    std::optional<LightEmissionSample> sample_emission(SamplerType&) const;
     EmissionValue emission(const proto::Vec3f&, const proto::Vec3f&, const proto::Vec2f&) const override;
     float pdf_from(const proto::Vec3f&, const proto::Vec2f&) const override;
 
     bool has_area() const override { return true; }
+    LightBounds bounds() const override;
 
     proto::fnv::Hasher& hash(proto::fnv::Hasher&) const override;
     bool equals(const Light&) const override;
 
+    const SamplableShape& shape() const { return shape_; }
+    const ColorTexture& intensity() const { return intensity_; }
+
 private:
     static Tag infer_tag(const UniformTriangle&) { return Tag::UniformTriangleLight; }
     static Tag infer_tag(const UniformSphere&)   { return Tag::UniformSphereLight;   }
@@ -137,6 +173,40 @@ private:
 using UniformTriangleLight = AreaLight<UniformTriangle>;
 using UniformSphereLight   = AreaLight<UniformSphere>;
 
+template <typename F>
+decltype(auto) Light::visit(F&& f) const {
+    switch (tag) {
+        case Tag::PointLight:           return f(static_cast<const PointLight&>(*this));
+        case Tag::UniformTriangleLight: return f(static_cast<const UniformTriangleLight&>(*this));
+        case Tag::UniformSphereLight:   return f(static_cast<const UniformSphereLight&>(*this));
+        default:                        return f(*this);
+    }
+}
+
+/// Non-virtual versions of the light functions, for use in performance-sensitive code.
+/// As for BSDFs, the sampling functions do not make virtual calls to built-in samplers passed with their concrete type.
+namespace dispatch {
+
+template <typename SamplerType>
+std::optional<LightAreaSample> sample_area(const Light& light, SamplerType& sampler, const proto::Vec3f& from) {
+    return light.visit([&] (auto& l) { return l.sample_area(sampler, from); });
+}
+
+template <typename SamplerType>
+std::optional<LightEmissionSample> sample_emission(const Light& light, SamplerType& sampler) {
+    return light.visit([&] (auto& l) { return l.sample_emission(sampler); });
+}
+
+inline EmissionValue emission(const Light& light, const proto::Vec3f& from, const proto::Vec3f& dir, const proto::Vec2f& uv) {
+    return light.visit([&] (auto& l) { return l.emission(from, dir, uv); });
+}
+
+inline bool has_area(const Light& light) {
+    return light.visit([&] (auto& l) { return l.has_area(); });
+}
+
+} // namespace dispatch
+
 } // namespace sol
 
 #endif
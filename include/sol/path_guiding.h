@@ -0,0 +1,122 @@
+#ifndef SOL_PATH_GUIDING_H
+#define SOL_PATH_GUIDING_H
+
+#include <vector>
+#include <utility>
+#include <cstdint>
+
+#include <proto/vec.h>
+#include <proto/bbox.h>
+#include <par/for_each.h>
+
+namespace sol {
+
+namespace detail {
+
+struct PathGuidingConfig {
+    bool   enable = false;                  ///< Enables path guiding
+    float  bsdf_sampling_fraction = 0.5f;   ///< Probability to sample the BSDF instead of the learned distribution (must be in `]0, 1[`)
+    size_t spatial_threshold = 4000;        ///< Number of samples recorded by a spatial leaf during a frame, above which it is split
+    float  directional_threshold = 0.01f;   ///< Fraction of the energy of a directional tree above which a quadrant is subdivided
+    size_t max_directional_depth = 16;      ///< Maximum depth of the directional trees
+};
+
+} // namespace detail
+
+/// Learns the distribution of incident radiance over the scene, in order to sample directions proportionally to it.
+/// The distribution is represented as an SD-tree: a binary tree over space, whose leaves contain quadtrees over
+/// directions (see "Practical Path Guiding for Efficient Light-Transport Simulation", by T. Müller et al.).
+///
+/// Each spatial leaf has two directional trees: One that was learned during the previous frame, which is sampled,
+/// and one that records radiance during the current frame. At the start of a frame, the recorded trees replace the
+/// sampled ones, the spatial leaves that have recorded many samples are split, and the new recording trees are
+/// subdivided where the previous ones have the most energy.
+class PathGuiding {
+public:
+    using Config = detail::PathGuidingConfig;
+
+    PathGuiding(const Config& config = {})
+        : config_(config)
+    {}
+
+    bool is_enabled() const { return config_.enable; }
+    const Config& config() const { return config_; }
+
+    /// Returns true if a distribution has been learned during a previous frame, and can be sampled.
+    bool can_sample() const { return can_sample_; }
+
+    /// Prepares a new frame, for a scene with the given bounding box.
+    /// The learned distribution is cleared when `sample_index` is zero.
+    template <typename Executor>
+    void start_frame(Executor& executor, const proto::BBoxf& bbox, size_t sample_index) {
+        if (sample_index == 0 || nodes_.empty())
+            return reset(bbox);
+        split_leaves();
+        par::for_each(executor, par::range_1d(size_t{0}, leaves_.size()), [&] (size_t i) { refine_leaf(i); });
+        can_sample_ = true;
+    }
+
+    /// Samples a direction at the given point, given two random numbers.
+    /// Returns the direction and its probability density, in solid angle measure.
+    std::pair<proto::Vec3f, float> sample(const proto::Vec3f& point, float u, float v) const;
+
+    /// Returns the probability density to sample the given direction at the given point, in solid angle measure.
+    float pdf(const proto::Vec3f& point, const proto::Vec3f& dir) const;
+
+    /// Records the radiance arriving at the given point from the given direction, divided by the probability density
+    /// of that direction. This can be called concurrently.
+    void record(const proto::Vec3f& point, const proto::Vec3f& dir, float radiance);
+
+private:
+    /// Quadtree over the square `[0, 1]^2`, onto which directions are mapped with an equal-area projection.
+    /// Every node stores the energy of its four quadrants, and the index of their children (0 for leaves).
+    class DirectionalTree {
+    public:
+        DirectionalTree() : nodes_(1) {}
+
+        std::pair<proto::Vec2f, float> sample(float, float) const;
+        float pdf(proto::Vec2f) const;
+        void record(proto::Vec2f, float);
+
+        /// Returns a tree with no energy, where the quadrants that hold more than the given fraction of the energy are subdivided.
+        DirectionalTree refine(float, size_t) const;
+
+    private:
+        struct Node {
+            float energy[4] = {};
+            uint32_t children[4] = {};
+
+            float total() const { return energy[0] + energy[1] + energy[2] + energy[3]; }
+        };
+
+        std::vector<Node> nodes_;
+    };
+
+    struct SpatialNode {
+        uint32_t first_child_or_leaf;   ///< Index of the first child for inner nodes, index of the leaf for leaves
+        uint32_t axis;                  ///< Axis along which the node is (or would be) split
+        bool is_leaf;
+    };
+
+    struct Leaf {
+        DirectionalTree sampling;
+        DirectionalTree recording;
+        uint32_t sample_count = 0;
+    };
+
+    void reset(const proto::BBoxf&);
+    void split_leaves();
+    void refine_leaf(size_t);
+    size_t find_leaf(const proto::Vec3f&) const;
+
+    Config config_;
+    proto::Vec3f bbox_min_;
+    proto::Vec3f inv_extent_;
+    std::vector<SpatialNode> nodes_;
+    std::vector<Leaf> leaves_;
+    bool can_sample_ = false;
+};
+
+} // namespace sol
+
+#endif
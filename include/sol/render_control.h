@@ -0,0 +1,52 @@
+#ifndef SOL_RENDER_CONTROL_H
+#define SOL_RENDER_CONTROL_H
+
+#include <atomic>
+#include <algorithm>
+#include <cstddef>
+
+namespace sol {
+
+/// Cancellation token and progress counter, shared between a renderer and the thread that controls it.
+/// Renderers check the token between tiles (or other blocks of pixels), so that cancellation takes effect
+/// after at most one block per thread, instead of at the end of the frame.
+class RenderControl {
+public:
+    /// Clears the cancellation request and the progress.
+    void reset() {
+        is_cancelled_.store(false, std::memory_order_relaxed);
+        set_total_work(0);
+    }
+
+    /// Requests the renderer to stop as soon as possible. This can be called from any thread.
+    void cancel() { is_cancelled_.store(true, std::memory_order_relaxed); }
+    bool is_cancelled() const { return is_cancelled_.load(std::memory_order_relaxed); }
+
+    /// Sets the amount of work that the renderer has to do for the current frame (e.g. a number of pixels),
+    /// and resets the amount of work done so far.
+    void set_total_work(size_t total_work) {
+        done_work_.store(0, std::memory_order_relaxed);
+        total_work_.store(total_work, std::memory_order_relaxed);
+    }
+
+    /// Records that the given amount of work has been done.
+    void advance(size_t work) { done_work_.fetch_add(work, std::memory_order_relaxed); }
+
+    /// Returns the fraction of the work of the current frame that has been done, between 0 and 1.
+    float progress() const {
+        auto total_work = total_work_.load(std::memory_order_relaxed);
+        if (total_work == 0)
+            return 0.0f;
+        auto done_work = std::min(done_work_.load(std::memory_order_relaxed), total_work);
+        return static_cast<float>(done_work) / static_cast<float>(total_work);
+    }
+
+private:
+    std::atomic<bool> is_cancelled_ = false;
+    std::atomic<size_t> total_work_ = 0;
+    std::atomic<size_t> done_work_ = 0;
+};
+
+} // namespace sol
+
+#endif
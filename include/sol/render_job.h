@@ -5,6 +5,9 @@
 #include <thread>
 #include <condition_variable>
 #include <mutex>
+#include <atomic>
+
+#include "sol/render_control.h"
 
 namespace sol {
 
@@ -16,8 +19,19 @@ class Renderer;
 /// Rendering jobs should only be controlled from a single thread
 /// (i.e. calling `wait/start/cancel` from different threads is undefined behavior).
 struct RenderJob {
+    /// Strategies to choose the number of samples per frame.
+    enum class FramePacing {
+        Fixed,      ///< Always renders `samples_per_frame` samples per frame
+        Latency,    ///< Adjusts `samples_per_frame` so that frames take `target_frame_ms` milliseconds
+        Throughput  ///< Increases `samples_per_frame` as long as it improves the number of samples rendered per second
+    };
+
     size_t sample_count = 0;        ///< Number of samples to render (0 = unlimited, until cancellation).
-    size_t samples_per_frame = 1;   ///< Number of samples per frame (larger = higher throughput but higher latency)
+    /// Number of samples per frame (larger = higher throughput but higher latency).
+    /// Unless the frame pacing is `FramePacing::Fixed`, this is updated by the rendering thread after each frame.
+    std::atomic<size_t> samples_per_frame = 1;
+    FramePacing frame_pacing = FramePacing::Fixed;  ///< Strategy used to adjust `samples_per_frame` between frames
+    size_t target_frame_ms = 100;   ///< Target duration of a frame, in milliseconds, for `FramePacing::Latency`
     const Renderer& renderer;       ///< Rendering algorithm to use.
     Image& output;                  ///< Output image, where samples are accumulated.
 
@@ -27,9 +41,11 @@ struct RenderJob {
     ~RenderJob();
 
     /// Starts the rendering job, producing samples into the output image.
+    /// The output image is cleared first, since the renderer starts again from the first sample and resets its state.
     /// This function takes a callback that is called after a frame has been rendered.
     /// The next frame will only start after that callback returns, and if the returned value is `true`.
-    /// If the returned value is false, the job is cancelled.
+    /// If the returned value is false, the job is cancelled. When the callback is called, `samples_per_frame`
+    /// already contains the number of samples chosen for the next frame.
     void start(std::function<bool (const RenderJob&)>&& frame_end = {});
 
     /// Waits for this rendering job to finish, or until the given amount of milliseconds has passed.
@@ -38,14 +54,47 @@ struct RenderJob {
     bool wait(size_t timeout_ms = 0);
 
     /// Explicitly cancels the rendering job.
-    /// This might require waiting for some frames to finish rendering.
+    /// The renderer stops after the tiles that are being rendered are done. The samples of the
+    /// interrupted frame are then only present in some pixels, and are not counted in `rendered_sample_count()`.
+    /// The output image thus only contains exactly `rendered_sample_count()` samples per pixel in the frame callback,
+    /// or when the job finishes without being cancelled. After a cancellation, the output image and the state of
+    /// the renderer (e.g. adaptive sampling statistics) are partially advanced, and the job can only be restarted.
     void cancel();
 
+    /// Returns the number of samples per pixel that have been accumulated into the output image so far.
+    size_t rendered_sample_count() const { return rendered_sample_count_; }
+
+    /// Returns true if the job stopped because the renderer reported that the image has converged.
+    bool is_converged() const { return is_converged_; }
+
+    /// Returns the fraction of the job that is done, between 0 and 1, including the progress of the current frame.
+    /// For jobs with an unlimited number of samples, this is the progress of the current frame.
+    float progress() const;
+
+    /// Returns the number of samples per pixel rendered during the last frame (or the current frame, while rendering).
+    size_t frame_sample_count() const { return frame_sample_count_; }
+
+    /// Returns the time taken to render the last frame, in milliseconds.
+    double frame_ms() const { return frame_ms_; }
+
 private:
+    void adjust_samples_per_frame();
+
     std::thread render_thread_;
     std::mutex mutex_;
     std::condition_variable done_cond_;
     bool is_done_ = true;
+    std::atomic<size_t> rendered_sample_count_ = 0;
+    std::atomic<bool> is_converged_ = false;
+    std::atomic<size_t> frame_sample_count_ = 0;
+    std::atomic<double> frame_ms_ = 0;
+    RenderControl control_;
+
+    // State of the frame pacing heuristics
+    double ms_per_sample_ = 0;
+    double best_throughput_ = 0;
+    size_t best_samples_per_frame_ = 0;
+    bool is_throughput_tuned_ = false;
 };
 
 } // namespace sol
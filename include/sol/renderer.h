@@ -12,6 +12,7 @@
 
 #include "sol/samplers.h"
 #include "sol/scene.h"
+#include "sol/tile_scheduler.h"
 
 namespace sol {
 
@@ -28,16 +29,25 @@ public:
 
     const std::string& name() const { return name_; }
 
+    /// Returns the scheduler used to distribute the pixels of the image over threads.
+    TileScheduler& tile_scheduler() { return tile_scheduler_; }
+
     /// Renders the samples starting at the given index into the given image.
     /// Since the behavior is entirely deterministic, this `sample_index`
     /// variable can be used to retrace a particular set of samples.
-    virtual void render(Image& image, size_t sample_index, size_t sample_count = 1) const = 0;
+    /// The optional control object receives the progress of the frame, and allows to cancel it from another thread.
+    /// When the frame is cancelled, the image contains the samples of an unspecified subset of its pixels.
+    virtual void render(Image& image, size_t sample_index, size_t sample_count = 1, RenderControl* control = nullptr) const = 0;
+
+    /// Returns true if the renderer has determined that the image has converged, and that rendering more samples is useless.
+    virtual bool is_converged() const { return false; }
 
 protected:
-    /// Processes each pixel of the given range `[0,w]x[0,h]` in parallel.
+    /// Processes each pixel of the given image in parallel, tile by tile (see `TileScheduler`).
+    /// The given function takes the pixel position and the buffer of its tile, into which it should accumulate its result.
     template <typename Executor, typename F>
-    static inline void for_each_pixel(Executor& executor, size_t w, size_t h, const F& f) {
-        par::for_each(executor, par::range_2d(size_t{0}, w, size_t{0}, h), f);
+    void for_each_pixel(Executor& executor, Image& image, const F& f, RenderControl* control = nullptr) const {
+        tile_scheduler_.for_each_pixel(executor, image, f, control);
     }
 
     /// Generates a seed suitable to initialize a sampler, given a frame index, and a pixel position (2D).
@@ -47,7 +57,8 @@ protected:
 
     /// Samples the area within a pixel, using the given sampler.
     /// Returns the coordinates of the pixel in camera space (i.e. `[-1, 1]^2`).
-    static inline proto::Vec2f sample_pixel(Sampler& sampler, size_t x, size_t y, size_t w, size_t h) {
+    template <typename SamplerType>
+    static inline proto::Vec2f sample_pixel(SamplerType& sampler, size_t x, size_t y, size_t w, size_t h) {
         return proto::Vec2f(
             (x + sampler()) * (2.0f / static_cast<float>(w)) - 1.0f,
             1.0f - (y + sampler()) * (2.0f / static_cast<float>(h)));
@@ -61,6 +72,7 @@ protected:
 
     std::string name_;
     const Scene& scene_;
+    mutable TileScheduler tile_scheduler_;
 };
 
 } // namespace sol
@@ -2,7 +2,12 @@
 #define SOL_SAMPLERS_H
 
 #include <cstdint>
+#include <cstddef>
 #include <random>
+#include <array>
+#include <algorithm>
+#include <limits>
+#include <concepts>
 
 namespace sol {
 
@@ -12,6 +17,11 @@ public:
     /// Generates a new floating-point value in the range [0, 1] from this sampler.
     virtual float operator () () = 0;
 
+    /// Moves to the given dimension of the current sample, so that the next call to `operator ()` returns
+    /// the value of the sample for that dimension. This is only meaningful for samplers that produce
+    /// low-discrepancy sequences, and is ignored by the others.
+    virtual void set_dimension(size_t) {}
+
 protected:
     ~Sampler() {}
 };
@@ -34,7 +44,10 @@ struct PcgGenerator {
         (*this)();
     }
 
-    uint32_t operator () () {
+    uint32_t operator () () { return next(state); }
+
+    /// Advances the given state, and returns the output of the generator for the previous state.
+    static uint32_t next(uint64_t& state) {
         auto old_state = state;
         state = old_state * UINT64_C(6364136223846793005) + inc;
         uint32_t xorshifted = ((old_state >> 18) ^ old_state) >> 27;
@@ -45,6 +58,12 @@ struct PcgGenerator {
     uint64_t state;
 };
 
+/// Converts 32 random bits into a floating-point number in `[0, 1)`, keeping the 24 most significant bits.
+/// This is much cheaper than `std::uniform_real_distribution`.
+inline float bits_to_float(uint32_t bits) {
+    return static_cast<float>(bits >> 8) * 0x1p-24f;
+}
+
 /// Template to create samplers from a generator compatible with the standard-library.
 template <typename Generator>
 class StdRandomSampler final : public Sampler {
@@ -62,7 +81,177 @@ private:
 };
 
 using Mt19937Sampler = StdRandomSampler<std::mt19937>; ///< Mersenne-twister-based sampler.
-using PcgSampler     = StdRandomSampler<PcgGenerator>; ///< PCG-based sampler.
+
+/// PCG-based sampler. Since this class is final, renderers that know the type of the sampler statically
+/// (e.g. by templating on it) call `operator ()` without going through a virtual call.
+class PcgSampler final : public Sampler {
+public:
+    PcgSampler(uint64_t seed)
+        : gen_(seed)
+    {}
+
+    float operator () () override final { return bits_to_float(gen_()); }
+
+private:
+    PcgGenerator gen_;
+};
+
+/// Set of independent PCG generators that are advanced in lock-step, so that the compiler can vectorize them.
+/// This is useful to generate many random numbers at once, for instance one for each path of a wavefront.
+template <size_t Lanes>
+class PcgLanes {
+public:
+    static constexpr size_t lane_count = Lanes;
+
+    PcgLanes(uint64_t seed) {
+        for (size_t i = 0; i < Lanes; ++i)
+            states_[i] = PcgGenerator(seed ^ (i * UINT64_C(0x9e3779b97f4a7c15))).state;
+    }
+
+    /// Generates one random number per lane, in `[0, 1)`.
+    void next(float (&values)[Lanes]) {
+        for (size_t i = 0; i < Lanes; ++i)
+            values[i] = bits_to_float(PcgGenerator::next(states_[i]));
+    }
+
+    /// Fills the given array with random numbers in `[0, 1)`.
+    void fill(float* values, size_t count) {
+        float lanes[Lanes];
+        for (; count >= Lanes; count -= Lanes, values += Lanes) {
+            next(lanes);
+            std::copy_n(lanes, Lanes, values);
+        }
+        if (count > 0) {
+            next(lanes);
+            std::copy_n(lanes, count, values);
+        }
+    }
+
+private:
+    uint64_t states_[Lanes];
+};
+
+namespace detail {
+
+/// Computes the generator matrices of the first dimensions of the Sobol sequence, from the
+/// primitive polynomials and initial direction numbers of S. Joe and F. Y. Kuo.
+constexpr std::array<std::array<uint32_t, 32>, 4> make_sobol_matrices() {
+    struct Parameters { uint32_t degree, coeffs; uint32_t init[3]; };
+    constexpr Parameters params[] = { { 1, 0, { 1 } }, { 2, 1, { 1, 3 } }, { 3, 1, { 1, 3, 1 } } };
+
+    std::array<std::array<uint32_t, 32>, 4> matrices = {};
+    for (uint32_t i = 0; i < 32; ++i)
+        matrices[0][i] = UINT32_C(1) << (31 - i);
+    for (size_t dim = 1; dim < 4; ++dim) {
+        auto [s, a, init] = params[dim - 1];
+        uint32_t m[32] = {};
+        for (uint32_t i = 0; i < 32; ++i) {
+            if (i < s) {
+                m[i] = init[i];
+                continue;
+            }
+            m[i] = m[i - s] ^ (m[i - s] << s);
+            for (uint32_t k = 1; k < s; ++k)
+                m[i] ^= ((a >> (s - 1 - k)) & 1) * (m[i - k] << k);
+        }
+        for (uint32_t i = 0; i < 32; ++i)
+            matrices[dim][i] = m[i] << (31 - i);
+    }
+    return matrices;
+}
+
+inline constexpr auto sobol_matrices = make_sobol_matrices();
+
+inline uint32_t sobol(uint32_t index, size_t dim) {
+    uint32_t result = 0;
+    for (size_t bit = 0; index != 0; index >>= 1, ++bit)
+        result ^= (index & 1) * sobol_matrices[dim][bit];
+    return result;
+}
+
+inline uint32_t reverse_bits(uint32_t x) {
+    x = ((x >> 1) & UINT32_C(0x55555555)) | ((x & UINT32_C(0x55555555)) << 1);
+    x = ((x >> 2) & UINT32_C(0x33333333)) | ((x & UINT32_C(0x33333333)) << 2);
+    x = ((x >> 4) & UINT32_C(0x0F0F0F0F)) | ((x & UINT32_C(0x0F0F0F0F)) << 4);
+    x = ((x >> 8) & UINT32_C(0x00FF00FF)) | ((x & UINT32_C(0x00FF00FF)) << 8);
+    return (x >> 16) | (x << 16);
+}
+
+/// Hash-based Owen scrambling (see "Practical Hash-based Owen Scrambling", by B. Burley).
+inline uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed) {
+    x = reverse_bits(x);
+    x += seed;
+    x ^= x * UINT32_C(0x6c50b47c);
+    x ^= x * UINT32_C(0xb82f1e52);
+    x ^= x * UINT32_C(0xc7afe638);
+    x ^= x * UINT32_C(0x8d22f6e6);
+    return reverse_bits(x);
+}
+
+inline uint32_t hash_combine(uint32_t seed, uint32_t v) {
+    return seed ^ (v + UINT32_C(0x9e3779b9) + (seed << 6) + (seed >> 2));
+}
+
+} // namespace detail
+
+/// Low-discrepancy sampler that produces Owen-scrambled points, one dimension at a time.
+/// Dimensions are grouped by `GroupSize`: Within a group, points are taken from the first dimensions
+/// of the Sobol sequence, and groups are decorrelated by shuffling the sample index with a different seed.
+/// Samples of a given pixel must use the same seed and consecutive sample indices.
+template <size_t GroupSize>
+class OwenScrambledSampler final : public Sampler {
+    static_assert(GroupSize >= 1 && GroupSize <= 4);
+
+public:
+    OwenScrambledSampler(uint32_t seed, uint32_t sample_index, size_t dim = 0)
+        : seed_(seed), sample_index_(sample_index), dim_(dim)
+    {}
+
+    float operator () () override final {
+        auto group = static_cast<uint32_t>(dim_ / GroupSize);
+        auto group_seed = detail::hash_combine(seed_, group);
+        auto index = detail::nested_uniform_scramble(sample_index_, group_seed);
+        auto value = detail::nested_uniform_scramble(
+            detail::sobol(index, dim_ % GroupSize),
+            detail::hash_combine(group_seed, static_cast<uint32_t>(dim_ % GroupSize) + 1));
+        dim_++;
+        return bits_to_float(value);
+    }
+
+    void set_dimension(size_t dim) override final { dim_ = dim; }
+    size_t dimension() const { return dim_; }
+
+private:
+    uint32_t seed_;
+    uint32_t sample_index_;
+    size_t dim_;
+};
+
+/// Owen-scrambled Sobol sampler, with dimensions padded in groups of four.
+using SobolSampler = OwenScrambledSampler<4>;
+
+/// Sampler producing progressive multi-jittered (0, 2) points (see "Progressive Multi-Jittered Sample Sequences",
+/// by P. Christensen et al.). Owen-scrambling the first two dimensions of the Sobol sequence, which form a
+/// (0, 2)-sequence, produces points with the same stratification as PMJ02 without precomputed tables.
+/// Dimensions are padded in pairs.
+using Pmj02Sampler = OwenScrambledSampler<2>;
+
+/// Samplers for which the built-in BSDFs and lights are compiled. When one of these is passed with its concrete type
+/// to the functions of the `dispatch` namespace, the random numbers drawn by BSDFs and lights do not go through
+/// a virtual call. Other samplers are accessed through the `Sampler` interface.
+template <typename T>
+concept BuiltinSampler =
+    std::same_as<T, Sampler> ||
+    std::same_as<T, PcgSampler> ||
+    std::same_as<T, SobolSampler> ||
+    std::same_as<T, Pmj02Sampler>;
+
+/// Types of samplers that renderers can use.
+enum class SamplerType {
+    Random, ///< Independent random numbers (PCG)
+    Sobol,  ///< Owen-scrambled Sobol sequence (see `SobolSampler`)
+    Pmj02   ///< Progressive multi-jittered (0, 2) sequence (see `Pmj02Sampler`)
+};
 
 } // namespace sol
 
@@ -17,6 +17,14 @@ class Texture;
 class Camera;
 class Image;
 class Geometry;
+class LightSampler;
+
+/// Strategies to pick light sources for next-event estimation.
+enum class LightSamplerType {
+    Uniform,    ///< Uniformly, regardless of their power or position
+    Power,      ///< Proportionally to their power, with an alias table
+    Tree        ///< With a light hierarchy that accounts for power, distance, and orientation
+};
 
 namespace detail {
 
@@ -26,6 +34,7 @@ struct SceneDefaults {
     proto::Vec3f eye_pos    = proto::Vec3f(0, 0, 0);
     proto::Vec3f dir_vector = proto::Vec3f(0, 0, 1);
     proto::Vec3f up_vector  = proto::Vec3f(0, 1, 0);
+    LightSamplerType light_sampler = LightSamplerType::Tree;    ///< Light sampler built by `Scene::load()`
 };
 
 } // namespace detail
@@ -47,8 +56,20 @@ struct Scene {
     unique_vector<Texture> textures;
     unique_vector<Image>   images;
 
+    /// Geometric objects other than the root, that may be referenced by it (e.g. instanced meshes).
+    unique_vector<Geometry> geometries;
+
+    /// Strategy used to pick lights for next-event estimation. Built by `finalize()`, which must thus be
+    /// called before creating renderers that perform next-event estimation (path tracers and SPPM).
+    std::unique_ptr<LightSampler> light_sampler;
+
     using Defaults = detail::SceneDefaults;
 
+    /// Builds the data structures that depend on the contents of the whole scene (e.g. the light sampler).
+    /// This must be called once all the lights have been added, and is called automatically by `load()`,
+    /// with the light sampler given in the defaults.
+    void finalize(LightSamplerType light_sampler_type = LightSamplerType::Tree);
+
     /// Loads the given scene file, using the given configuration to deduce missing values.
     static std::optional<Scene> load(
         const std::string& file_name,
@@ -7,8 +7,6 @@
 
 namespace sol {
 
-class Sampler;
-
 /// Shape surface sample.
 struct ShapeSample {
     proto::Vec2f surf_coords; ///< Surface coordinates of the sample on the surface.
@@ -37,8 +35,17 @@ struct SamplableShape {
     {}
 
     /// Samples the surface of the shape from a given point on another surface.
-    ShapeSample sample(Sampler& sampler) const;
-    DirectionalShapeSample sample(Sampler& sampler, const proto::Vec3f&) const;
+    template <typename SamplerType>
+    ShapeSample sample(SamplerType& sampler) const {
+        auto uv = proto::Vec2f(sampler(), sampler());
+        return static_cast<const Derived*>(this)->sample_at(uv);
+    }
+
+    template <typename SamplerType>
+    DirectionalShapeSample sample(SamplerType& sampler, const proto::Vec3f& from) const {
+        auto uv = proto::Vec2f(sampler(), sampler());
+        return static_cast<const Derived*>(this)->sample_at(uv, from);
+    }
 
     template <typename Hasher>
     Hasher& hash(Hasher& hasher) const { return shape.hash(hasher); }
@@ -60,7 +60,8 @@ public:
         ConstantColorTexture = 1,
         ImageTextureBegin = 2,
         ImageTextureEnd =
-            ImageTextureBegin + BorderMode::tag_count() * ImageFilter::tag_count()
+            ImageTextureBegin + BorderMode::tag_count() * ImageFilter::tag_count(),
+        Custom              ///< User-defined textures, which are only accessed through virtual functions
     } tag;
 
     Texture(Tag tag)
@@ -75,6 +76,10 @@ public:
     virtual proto::fnv::Hasher& hash(proto::fnv::Hasher&) const = 0;
     virtual bool equals(const Texture&) const = 0;
 
+    /// Calls the given function with this texture, cast to its concrete type when it is one of the built-in textures,
+    /// so that calls made through it are resolved statically. Other textures are passed as a `Texture`.
+    template <typename F> decltype(auto) visit(F&&) const;
+
 protected:
     template <typename ImageFilterType, typename BorderModeType>
     static constexpr Tag make_image_texture_tag() {
@@ -99,6 +104,12 @@ public:
     }
 
     virtual Color sample_color(const proto::Vec2f& uv) const = 0;
+
+    /// Returns the average color of the texture over the unit square.
+    virtual Color average_color() const = 0;
+
+    /// Same as `Texture::visit()`, for color textures.
+    template <typename F> decltype(auto) visit(F&&) const;
 };
 
 /// Constant texture that evaluates to the same scalar everywhere.
@@ -130,6 +141,7 @@ public:
     {}
 
     Color sample_color(const proto::Vec2f&) const override { return color_; }
+    Color average_color() const override { return color_; }
 
     proto::fnv::Hasher& hash(proto::fnv::Hasher& hasher) const override {
         return color_.hash(hasher.combine(tag));
@@ -162,9 +174,11 @@ public:
         , image_(image)
         , filter_(std::move(filter))
         , border_mode_(std::move(border_mode))
+        , average_color_(compute_average_color(image))
     {}
 
     Color sample_color(const proto::Vec2f& uv) const override;
+    Color average_color() const override { return average_color_; }
 
     proto::fnv::Hasher& hash(proto::fnv::Hasher& hasher) const override {
         return hasher.combine(tag).combine(&image_);
@@ -177,12 +191,67 @@ public:
     const Image& image() const { return image_; }
 
 private:
+    static Color compute_average_color(const Image&);
+
     const Image& image_;
 
     ImageFilter filter_;
     BorderMode border_mode_;
+    Color average_color_;
 };
 
+template <typename F>
+decltype(auto) Texture::visit(F&& f) const {
+    if (tag == Tag::ConstantTexture)
+        return f(static_cast<const ConstantTexture&>(*this));
+    if (tag >= Tag::ConstantColorTexture && tag < Tag::ImageTextureEnd)
+        return static_cast<const ColorTexture&>(*this).visit(f);
+    return f(*this);
+}
+
+template <typename F>
+decltype(auto) ColorTexture::visit(F&& f) const {
+    using Nearest  = ImageFilter::Nearest;
+    using Bilinear = ImageFilter::Bilinear;
+    switch (tag) {
+        case Tag::ConstantColorTexture:
+            return f(static_cast<const ConstantColorTexture&>(*this));
+        case make_image_texture_tag<Nearest, BorderMode::Clamp>():
+            return f(static_cast<const ImageTexture<Nearest, BorderMode::Clamp>&>(*this));
+        case make_image_texture_tag<Nearest, BorderMode::Repeat>():
+            return f(static_cast<const ImageTexture<Nearest, BorderMode::Repeat>&>(*this));
+        case make_image_texture_tag<Nearest, BorderMode::Mirror>():
+            return f(static_cast<const ImageTexture<Nearest, BorderMode::Mirror>&>(*this));
+        case make_image_texture_tag<Bilinear, BorderMode::Clamp>():
+            return f(static_cast<const ImageTexture<Bilinear, BorderMode::Clamp>&>(*this));
+        case make_image_texture_tag<Bilinear, BorderMode::Repeat>():
+            return f(static_cast<const ImageTexture<Bilinear, BorderMode::Repeat>&>(*this));
+        case make_image_texture_tag<Bilinear, BorderMode::Mirror>():
+            return f(static_cast<const ImageTexture<Bilinear, BorderMode::Mirror>&>(*this));
+        default:
+            return f(*this);
+    }
+}
+
+/// Non-virtual versions of the texture functions, for use in performance-sensitive code.
+namespace dispatch {
+
+inline Color sample_color(const ColorTexture& texture, const proto::Vec2f& uv) {
+    return texture.visit([&] (auto& t) { return t.sample_color(uv); });
+}
+
+inline float sample(const Texture& texture, const proto::Vec2f& uv) {
+    return texture.visit([&] (auto& t) -> float {
+        // Sample color textures directly, as `ColorTexture::sample()` would go through a virtual call
+        if constexpr (requires { t.sample_color(uv); })
+            return t.sample_color(uv).luminance();
+        else
+            return t.sample(uv);
+    });
+}
+
+} // namespace dispatch
+
 } // namespace sol
 
 #endif
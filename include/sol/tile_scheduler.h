@@ -0,0 +1,184 @@
+#ifndef SOL_TILE_SCHEDULER_H
+#define SOL_TILE_SCHEDULER_H
+
+#include <vector>
+#include <numeric>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cmath>
+#include <mutex>
+
+#include <par/for_each.h>
+
+#include "sol/color.h"
+#include "sol/image.h"
+#include "sol/render_control.h"
+
+namespace sol {
+
+/// Rectangular region of an image, `[x_min, x_max[ x [y_min, y_max[`.
+struct Tile {
+    size_t x_min, y_min;
+    size_t x_max, y_max;
+
+    size_t width() const { return x_max - x_min; }
+    size_t height() const { return y_max - y_min; }
+};
+
+/// Private accumulation buffer for the pixels of a tile.
+/// Its contents are written to the image only once, when the tile is done.
+/// Channels beyond the first three (e.g. AOVs) are accumulated separately from colors.
+class TileBuffer {
+public:
+    void reset(const Tile& tile, size_t extra_channel_count = 0) {
+        tile_ = tile;
+        extra_channel_count_ = extra_channel_count;
+        pixels_.assign(tile.width() * tile.height(), RgbColor(0.0f));
+        extra_channels_.assign(tile.width() * tile.height() * extra_channel_count, 0.0f);
+    }
+
+    void accumulate(size_t x, size_t y, const RgbColor& color) {
+        pixels_[(y - tile_.y_min) * tile_.width() + (x - tile_.x_min)] += color;
+    }
+
+    /// Accumulates a value into the given channel of the image, which must be one of the channels after the first three.
+    void accumulate(size_t x, size_t y, size_t channel, float value) {
+        extra_channels_[((y - tile_.y_min) * tile_.width() + (x - tile_.x_min)) * extra_channel_count_ + channel - 3] += value;
+    }
+
+    void flush(Image& image) const {
+        for (size_t y = tile_.y_min, i = 0; y < tile_.y_max; ++y) {
+            for (size_t x = tile_.x_min; x < tile_.x_max; ++x, ++i) {
+                image.accumulate(x, y, pixels_[i]);
+                for (size_t j = 0; j < extra_channel_count_; ++j)
+                    image.channel(j + 3)[y * image.width() + x] += extra_channels_[i * extra_channel_count_ + j];
+            }
+        }
+    }
+
+private:
+    Tile tile_;
+    size_t extra_channel_count_ = 0;
+    std::vector<RgbColor> pixels_;
+    std::vector<float> extra_channels_;
+};
+
+/// Splits images into tiles, and processes them in parallel. Tiles are ordered along a Morton curve,
+/// so that neighboring tiles are processed at around the same time, which improves cache locality.
+/// The time spent on each tile is recorded, and when the same image size is rendered again, the most
+/// expensive tiles are scheduled first, so that a few expensive tiles do not delay the end of a frame.
+/// Several images may be processed concurrently with the same scheduler: The recorded costs are shared,
+/// but the schedule of each call is local to it.
+class TileScheduler {
+public:
+    TileScheduler(size_t tile_size = 16)
+        : tile_size_(tile_size)
+    {}
+
+    size_t tile_size() const {
+        std::lock_guard lock(mutex_);
+        return tile_size_;
+    }
+
+    /// Changes the tile size. This discards the costs recorded so far.
+    void set_tile_size(size_t tile_size) {
+        std::lock_guard lock(mutex_);
+        tile_size_ = tile_size;
+        costs_.clear();
+    }
+
+    /// Calls the given function for each pixel of the image, in parallel, with the buffer of the tile that contains it.
+    /// The function should accumulate its contributions into that buffer, which is flushed into the image once the tile is done.
+    /// If a control object is given, tiles are skipped once it is cancelled, and it advances by the number of pixels of each tile.
+    template <typename Executor, typename F>
+    void for_each_pixel(Executor& executor, Image& image, const F& f, RenderControl* control = nullptr) {
+        // The shared state is only accessed at the beginning and at the end of the call
+        std::unique_lock lock(mutex_);
+        auto tile_size = tile_size_;
+        auto tiles_x = (image.width()  + tile_size - 1) / tile_size;
+        auto tiles_y = (image.height() + tile_size - 1) / tile_size;
+        auto tile_count = tiles_x * tiles_y;
+        if (tile_count == 0)
+            return;
+        if (costs_.size() != tile_count || width_ != image.width() || height_ != image.height()) {
+            width_  = image.width();
+            height_ = image.height();
+            costs_.assign(tile_count, 0.0f);
+            morton_order_.resize(tile_count);
+            std::iota(morton_order_.begin(), morton_order_.end(), 0);
+            std::sort(morton_order_.begin(), morton_order_.end(), [&] (size_t i, size_t j) {
+                return morton_code(i % tiles_x, i / tiles_x) < morton_code(j % tiles_x, j / tiles_x);
+            });
+        }
+        auto costs = costs_;
+        auto order = morton_order_;
+        lock.unlock();
+
+        // Schedule expensive tiles first. Costs are bucketed by powers of two, relative to the most expensive tile,
+        // and the Morton order is preserved within each bucket.
+        auto max_cost = *std::max_element(costs.begin(), costs.end());
+        auto bucket = [&] (size_t i) {
+            return max_cost > 0 ? std::min(cost_bucket_count - 1, static_cast<size_t>(-std::log2(std::max(costs[i] / max_cost, 1.0e-6f)))) : 0;
+        };
+        std::stable_sort(order.begin(), order.end(), [&] (size_t i, size_t j) { return bucket(i) < bucket(j); });
+
+        par::for_each(executor, par::range_1d(size_t{0}, tile_count), [&] (size_t i) {
+            thread_local TileBuffer buffer;
+
+            if (control && control->is_cancelled())
+                return;
+
+            auto tile_index = order[i];
+            auto tile_x = tile_index % tiles_x;
+            auto tile_y = tile_index / tiles_x;
+            Tile tile {
+                tile_x * tile_size, tile_y * tile_size,
+                std::min((tile_x + 1) * tile_size, image.width()),
+                std::min((tile_y + 1) * tile_size, image.height())
+            };
+
+            auto start = std::chrono::steady_clock::now();
+            buffer.reset(tile, std::max(image.channel_count(), size_t{3}) - 3);
+            for (size_t y = tile.y_min; y < tile.y_max; ++y) {
+                for (size_t x = tile.x_min; x < tile.x_max; ++x)
+                    f(x, y, buffer);
+            }
+            buffer.flush(image);
+            costs[tile_index] = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+            if (control)
+                control->advance(tile.width() * tile.height());
+        });
+
+        // The costs are only kept if the tile layout has not changed in the meantime
+        lock.lock();
+        if (tile_size_ == tile_size && width_ == image.width() && height_ == image.height() && costs_.size() == tile_count)
+            costs_ = std::move(costs);
+    }
+
+private:
+    static uint64_t morton_code(uint64_t x, uint64_t y) {
+        auto spread = [] (uint64_t v) {
+            v &= UINT64_C(0xFFFFFFFF);
+            v = (v | (v << 16)) & UINT64_C(0x0000FFFF0000FFFF);
+            v = (v | (v <<  8)) & UINT64_C(0x00FF00FF00FF00FF);
+            v = (v | (v <<  4)) & UINT64_C(0x0F0F0F0F0F0F0F0F);
+            v = (v | (v <<  2)) & UINT64_C(0x3333333333333333);
+            v = (v | (v <<  1)) & UINT64_C(0x5555555555555555);
+            return v;
+        };
+        return spread(x) | (spread(y) << 1);
+    }
+
+    static constexpr size_t cost_bucket_count = 4;
+
+    mutable std::mutex mutex_;
+    size_t tile_size_;
+    size_t width_ = 0, height_ = 0;
+    std::vector<float> costs_;
+    std::vector<size_t> morton_order_;
+};
+
+} // namespace sol
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef SOL_TRANSFORM_H
+#define SOL_TRANSFORM_H
+
+#include <array>
+
+#include <proto/vec.h>
+#include <proto/bbox.h>
+
+namespace sol {
+
+/// Affine transformation, made of a linear part and a translation.
+struct AffineTransform {
+    std::array<proto::Vec3f, 3> rows;   ///< Rows of the linear part
+    proto::Vec3f translation;
+
+    AffineTransform(const std::array<proto::Vec3f, 3>& rows, const proto::Vec3f& translation)
+        : rows(rows), translation(translation)
+    {}
+
+    static AffineTransform identity();
+    static AffineTransform translate(const proto::Vec3f&);
+    static AffineTransform scale(const proto::Vec3f&);
+    /// Rotation around the X, Y, and Z axes, in that order (angles in degrees).
+    static AffineTransform rotate(const proto::Vec3f&);
+
+    proto::Vec3f apply_vector(const proto::Vec3f&) const;
+    proto::Vec3f apply_point(const proto::Vec3f& p) const { return apply_vector(p) + translation; }
+    /// Transforms a normal by this transformation, given the inverse of this transformation.
+    static proto::Vec3f apply_normal(const AffineTransform& inverse, const proto::Vec3f&);
+
+    proto::BBoxf apply(const proto::BBoxf&) const;
+    float determinant() const;
+    /// Inverts this transformation. The transformation must be invertible (see `is_invertible()`).
+    AffineTransform inverse() const;
+    /// Returns true if the transformation has a finite, non-zero determinant.
+    bool is_invertible() const;
+
+    /// Composes two transformations: The right-hand side is applied first.
+    AffineTransform operator * (const AffineTransform&) const;
+};
+
+} // namespace sol
+
+#endif
@@ -2,7 +2,10 @@
 #define SOL_TRIANGLE_MESH_H
 
 #include <tuple>
+#include <cstdint>
 #include <memory>
+#include <vector>
+#include <unordered_map>
 
 #include <proto/triangle.h>
 
@@ -11,27 +14,87 @@
 namespace sol {
 
 class Light;
+struct BinaryReader;
+struct BinaryWriter;
+
+/// Trade-off between BVH construction time and traversal performance.
+enum class BvhQuality {
+    Low,    ///< Binned SAH builder, for quick previews
+    Medium, ///< Sweep SAH builder
+    High    ///< Sweep SAH builder followed by a (parallel) reinsertion optimization pass, for final frames
+};
+
+namespace detail {
+
+struct TriangleMeshConfig {
+    BvhQuality bvh_quality = BvhQuality::High;
+    size_t bvh_arity = 2;       ///< Number of children per BVH node used for single-ray traversal (2, 4, or 8)
+    /// Quantizes BVH nodes to save memory, at the expense of traversal speed. This requires an arity of 4 or 8.
+    /// Compressed meshes do not keep the binary BVH, and thus trace batches of rays one ray at a time.
+    /// Meshes whose BVH leaves are too large for compressed nodes keep the uncompressed layout instead.
+    bool compress_bvh = false;
+    bool compact = false;       ///< Keeps 32-bit indices and shared vertices instead of precomputed triangles, to save memory
+};
+
+} // namespace detail
 
 /// Triangle mesh with an underlying acceleration data structure to speed up intersection tests.
 class TriangleMesh : public Geometry {
 public:
+    using Config = detail::TriangleMeshConfig;
+
     TriangleMesh(
         std::vector<size_t>&& indices,
         std::vector<proto::Vec3f>&& vertices,
         std::vector<proto::Vec3f>&& normals,
         std::vector<proto::Vec2f>&& tex_coords,
         std::vector<const Bsdf*>&& bsdfs,
-        std::unordered_map<size_t, const Light*>&& lights);
+        std::unordered_map<size_t, const Light*>&& lights,
+        const Config& config = {});
+
+    /// Reads a mesh and its acceleration data structure from a binary stream, as written by `write()`.
+    /// BSDFs and lights are not part of the stream, and must be provided separately.
+    /// Throws an exception if the data is invalid or has been written with a different configuration.
+    TriangleMesh(
+        BinaryReader&,
+        std::vector<const Bsdf*>&& bsdfs,
+        std::unordered_map<size_t, const Light*>&& lights,
+        const Config& config = {});
+
     ~TriangleMesh();
 
-    std::optional<Hit> intersect_closest(proto::Rayf&) const override;
+    /// Writes the mesh and its acceleration data structure to a binary stream.
+    void write(BinaryWriter&) const;
+
+    std::optional<HitRecord> intersect_closest_record(proto::Rayf&) const override;
+    SurfaceInfo surface_info(const proto::Rayf&, const HitRecord&) const override;
     bool intersect_any(const proto::Rayf&) const override;
+    proto::BBoxf bbox() const override;
+
+    void intersect_closest_batch(
+        std::span<proto::Rayf>,
+        std::span<const bool>,
+        std::span<std::optional<HitRecord>>) const override;
+    void intersect_any_batch(
+        std::span<const proto::Rayf>,
+        std::span<const bool>,
+        std::span<bool>) const override;
+
+    /// Returns the distinct lights attached to the triangles of this mesh.
+    std::vector<const Light*> lights() const;
 
     /// Returns the number of triangles in the mesh.
-    size_t triangle_count() const { return indices_.size() / 3; }
+    size_t triangle_count() const { return (config_.compact ? compact_indices_.size() : indices_.size()) / 3; }
 
     /// Returns the vertex indices of a triangle located a given triangle index.
     std::tuple<size_t, size_t, size_t> triangle_indices(size_t triangle_index) const {
+        if (config_.compact) {
+            return std::tuple<size_t, size_t, size_t> {
+                compact_indices_[triangle_index * 3 + 0],
+                compact_indices_[triangle_index * 3 + 1],
+                compact_indices_[triangle_index * 3 + 2]
+            };
+        }
         return std::tuple {
             indices_[triangle_index * 3 + 0],
             indices_[triangle_index * 3 + 1],
@@ -45,17 +108,41 @@ public:
 
 private:
     struct BvhData;
+    struct RayPacket;
+    struct TriangleBlock;
+
+    /// Emissive lanes of a triangle block. The lights of these lanes are stored contiguously in `lights_`.
+    struct EmissiveBlock {
+        uint32_t lane_mask = 0;     ///< Bit mask of the lanes that emit light
+        uint32_t first_light = 0;   ///< Index of the light of the first emissive lane in `lights_`
+    };
+
+    template <bool IsAnyHit, typename LeafFn>
+    auto traverse(proto::Rayf&, LeafFn&&) const;
+    template <bool IsAnyHit, typename LeafFn>
+    void traverse_packet(RayPacket&, LeafFn&&) const;
+    HitRecord make_record(const proto::Rayf&, size_t, float, float) const;
+    const Light* light_at(size_t) const;
+    void validate() const;
+    const TriangleBlock& triangle_block(size_t, TriangleBlock&) const;
+
     template <typename Executor>
     std::unique_ptr<BvhData> build_bvh(Executor&, const std::vector<proto::Vec3f>&) const;
+    void build_leaf_blocks(BvhData&) const;
     template <typename Executor>
-    std::vector<proto::PrecomputedTrianglef> build_triangles(Executor&, const std::vector<proto::Vec3f>&) const;
+    std::vector<TriangleBlock> build_triangles(Executor&, const std::vector<proto::Vec3f>&) const;
+    void build_light_table(const std::unordered_map<size_t, const Light*>&);
 
-    std::vector<size_t> indices_;
-    std::vector<proto::PrecomputedTrianglef> triangles_;
+    Config config_;
+    std::vector<size_t> indices_;            ///< Vertex indices (empty in compact mode)
+    std::vector<uint32_t> compact_indices_;  ///< Vertex indices (compact mode only)
+    std::vector<proto::Vec3f> vertices_;     ///< Shared vertices (compact mode only)
+    std::vector<TriangleBlock> triangles_;   ///< Precomputed triangle blocks (empty in compact mode)
     std::vector<proto::Vec3f> normals_;
     std::vector<proto::Vec2f> tex_coords_;
     std::vector<const Bsdf*> bsdfs_;
-    std::unordered_map<size_t, const Light*> lights_;
+    std::vector<EmissiveBlock> emissive_blocks_; ///< Emissive lanes of each triangle block (empty if no triangle emits)
+    std::vector<const Light*> lights_;       ///< Lights of the emissive lanes, in the order of the triangle blocks
     std::unique_ptr<BvhData> bvh_data_;
 };
 
@@ -0,0 +1,310 @@
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include "sol/algorithms/bdpt.h"
+#include "sol/scene.h"
+#include "sol/geometry.h"
+#include "sol/cameras.h"
+#include "sol/bsdfs.h"
+#include "sol/lights.h"
+
+namespace sol {
+
+/// Vertex of a subpath, on a non-specular surface. The partial MIS quantities `d_vcm` and `d_vc` summarize the
+/// probabilities to generate the subpath with the other strategies, so that connections only need local information.
+struct Bdpt::PathVertex {
+    SurfaceInfo surf_info;
+    const Bsdf* bsdf;
+    proto::Vec3f out_dir;   ///< Direction towards the previous vertex of the subpath
+    Color throughput;       ///< Throughput of the subpath, up to (but excluding) the BSDF at this vertex
+    size_t path_len;        ///< Number of edges from the start of the subpath
+    float d_vcm;
+    float d_vc;
+};
+
+struct Bdpt::CameraInfo {
+    proto::Vec3f eye;
+    size_t width, height;
+    Image* image;
+};
+
+Bdpt::Bdpt(const Scene& scene, const Config& config)
+    : Renderer("Bdpt", scene), config_(config), light_sampler_([&] {
+        // Light subpaths start on a light source picked independently of any surface point,
+        // so the same point-independent distribution is used for connections to light sources.
+        std::vector<const Light*> lights;
+        for (auto& light : scene.lights)
+            lights.push_back(light.get());
+        return PowerLightSampler(lights);
+    }())
+{}
+
+void Bdpt::render(Image& image, size_t sample_index, size_t sample_count, RenderControl* control) const {
+    if (control)
+        control->set_total_work(image.width() * image.height());
+
+    // Splats from light subpaths can land on any pixel, and go to a separate image, which is only
+    // added to the output once all tiles are done, so that atomic and regular accesses never overlap.
+    // This image is local to the call, so that several images can be rendered concurrently.
+    Image splats(image.width(), image.height(), 3);
+
+    CameraInfo camera {
+        .eye    = scene_.camera->generate_ray(proto::Vec2f(0)).org,
+        .width  = image.width(),
+        .height = image.height(),
+        .image  = &splats
+    };
+
+    Renderer::for_each_pixel(executor_, image,
+        [&] (size_t x, size_t y, TileBuffer& tile) {
+            thread_local std::vector<PathVertex> light_vertices;
+            auto color = Color::black();
+            for (size_t i = 0; i < sample_count; ++i) {
+                PcgSampler sampler(Renderer::pixel_seed(sample_index + i, x, y));
+                auto uv = Renderer::sample_pixel(sampler, x, y, image.width(), image.height());
+                trace_light_path(sampler, camera, light_vertices);
+                color += trace_camera_path(sampler, uv, light_vertices);
+            }
+            tile.accumulate(x, y, color);
+        }, control);
+
+    for (size_t y = 0; y < image.height(); ++y) {
+        for (size_t x = 0; x < image.width(); ++x)
+            image.accumulate(x, y, splats.rgb_at(x, y));
+    }
+}
+
+void Bdpt::trace_light_path(PcgSampler& sampler, const CameraInfo& camera, std::vector<PathVertex>& vertices) const {
+    vertices.clear();
+
+    auto light_pick = light_sampler_.sample(sampler, proto::Vec3f(0), proto::Vec3f(0));
+    if (!light_pick)
+        return;
+    auto light = light_pick->light;
+    auto light_sample = dispatch::sample_emission(*light, sampler);
+    if (!light_sample)
+        return;
+
+    auto emission_pdf = light_sample->pdf_area * light_sample->pdf_dir * light_pick->prob;
+    auto direct_pdf   = light_sample->pdf_area * light_pick->prob;
+    auto throughput   = light_sample->intensity * (light_sample->cos / emission_pdf);
+    auto d_vcm = direct_pdf / emission_pdf;
+    auto d_vc  = dispatch::has_area(*light) ? light_sample->cos / emission_pdf : 0.0f;
+    auto ray   = proto::Rayf(light_sample->pos, light_sample->dir, config_.ray_offset);
+
+    for (size_t path_len = 1; path_len < config_.max_path_len; ++path_len) {
+        auto hit = scene_.root->intersect_closest_record(ray);
+        if (!hit || !hit->bsdf)
+            break;
+        auto surf_info = hit->surface_info(ray);
+        auto out_dir = -ray.dir;
+
+        // Convert the MIS quantities to the area measure at the new vertex
+        auto cos_in = std::abs(proto::dot(out_dir, surf_info.normal()));
+        d_vcm *= ray.tmax * ray.tmax / cos_in;
+        d_vc  /= cos_in;
+
+        auto is_specular = hit->bsdf->type == Bsdf::Type::Specular;
+        if (!is_specular) {
+            vertices.push_back(PathVertex { surf_info, hit->bsdf, out_dir, throughput, path_len, d_vcm, d_vc });
+            connect_to_camera(vertices.back(), camera);
+        }
+
+        auto survival_prob = 1.0f;
+        if (path_len >= config_.min_rr_path_len) {
+            survival_prob = proto::clamp(throughput.luminance(), config_.min_survival_prob, config_.max_survival_prob);
+            if (sampler() >= survival_prob)
+                break;
+        }
+
+        auto bsdf_sample = dispatch::sample(*hit->bsdf, sampler, surf_info, out_dir, true);
+        if (!bsdf_sample)
+            break;
+
+        if (is_specular) {
+            d_vcm = 0.0f;
+            d_vc *= bsdf_sample->cos;
+        } else {
+            auto rev_pdf = dispatch::pdf(*hit->bsdf, out_dir, surf_info, bsdf_sample->in_dir);
+            d_vc  = bsdf_sample->cos / bsdf_sample->pdf * (d_vc * rev_pdf + d_vcm);
+            d_vcm = 1.0f / bsdf_sample->pdf;
+        }
+        throughput *= bsdf_sample->color * (bsdf_sample->cos / (bsdf_sample->pdf * survival_prob));
+        ray = proto::Rayf(surf_info.point, bsdf_sample->in_dir, config_.ray_offset);
+    }
+}
+
+Color Bdpt::trace_camera_path(
+    PcgSampler& sampler,
+    const proto::Vec2f& uv,
+    const std::vector<PathVertex>& light_vertices) const
+{
+    // The pdf of the camera ray, relative to the number of light subpaths, only depends on the lens geometry:
+    // The number of light subpaths per sample is the number of pixels, which cancels out with the pixel area.
+    auto lens  = scene_.camera->geometry(uv);
+    auto ray   = scene_.camera->generate_ray(uv);
+    auto d_vcm = lens.cos / (lens.area * lens.dist * lens.dist);
+    auto d_vc  = 0.0f;
+    auto throughput = Color::constant(1.0f);
+    auto color = Color::black();
+
+    for (size_t path_len = 1; path_len <= config_.max_path_len; ++path_len) {
+        auto hit = scene_.root->intersect_closest_record(ray);
+        if (!hit || (!hit->light && !hit->bsdf))
+            break;
+        auto surf_info = hit->surface_info(ray);
+        auto out_dir = -ray.dir;
+
+        auto cos_in = std::abs(proto::dot(out_dir, surf_info.normal()));
+        d_vcm *= ray.tmax * ray.tmax / cos_in;
+        d_vc  /= cos_in;
+
+        // Direct hits on a light source. Paths of length one can only be sampled this way.
+        if (hit->light && surf_info.is_front_side) {
+            auto emission = dispatch::emission(*hit->light, ray.org, out_dir, surf_info.surf_coords);
+            auto pick_prob = light_sampler_.pdf(*hit->light, ray.org, proto::Vec3f(0));
+            auto w_camera = path_len == 1 ? 0.0f :
+                emission.pdf_from * pick_prob * d_vcm +
+                emission.pdf_area * emission.pdf_dir * pick_prob * d_vc;
+            color += throughput * emission.intensity * (1.0f / (1.0f + w_camera));
+        }
+
+        if (!hit->bsdf || path_len >= config_.max_path_len)
+            break;
+
+        auto is_specular = hit->bsdf->type == Bsdf::Type::Specular;
+        if (!is_specular) {
+            PathVertex vertex { surf_info, hit->bsdf, out_dir, throughput, path_len, d_vcm, d_vc };
+            color += throughput * connect_to_light(sampler, vertex);
+            for (auto& light_vertex : light_vertices) {
+                if (light_vertex.path_len + path_len + 1 > config_.max_path_len)
+                    continue;
+                color += throughput * connect_vertices(light_vertex, vertex);
+            }
+        }
+
+        auto survival_prob = 1.0f;
+        if (path_len >= config_.min_rr_path_len) {
+            survival_prob = proto::clamp(throughput.luminance(), config_.min_survival_prob, config_.max_survival_prob);
+            if (sampler() >= survival_prob)
+                break;
+        }
+
+        auto bsdf_sample = dispatch::sample(*hit->bsdf, sampler, surf_info, out_dir);
+        if (!bsdf_sample)
+            break;
+
+        if (is_specular) {
+            d_vcm = 0.0f;
+            d_vc *= bsdf_sample->cos;
+        } else {
+            auto rev_pdf = dispatch::pdf(*hit->bsdf, out_dir, surf_info, bsdf_sample->in_dir);
+            d_vc  = bsdf_sample->cos / bsdf_sample->pdf * (d_vc * rev_pdf + d_vcm);
+            d_vcm = 1.0f / bsdf_sample->pdf;
+        }
+        throughput *= bsdf_sample->color * (bsdf_sample->cos / (bsdf_sample->pdf * survival_prob));
+        ray = proto::Rayf(surf_info.point, bsdf_sample->in_dir, config_.ray_offset);
+    }
+    return color;
+}
+
+void Bdpt::connect_to_camera(const PathVertex& vertex, const CameraInfo& camera) const {
+    auto& surf_info = vertex.surf_info;
+    auto uv = scene_.camera->project(surf_info.point);
+    if (!(std::abs(uv[0]) <= 1.0f && std::abs(uv[1]) <= 1.0f))
+        return;
+
+    auto to_eye = camera.eye - surf_info.point;
+    auto dist2 = proto::dot(to_eye, to_eye);
+    auto dir = to_eye * (1.0f / std::sqrt(dist2));
+    auto cos_surf = std::abs(proto::dot(dir, surf_info.normal()));
+    auto bsdf_value = dispatch::eval(*vertex.bsdf, dir, surf_info, vertex.out_dir);
+    if (bsdf_value.is_black())
+        return;
+
+    // Probability to sample this vertex from the camera, in area measure, divided by the number of light subpaths
+    auto lens = scene_.camera->geometry(uv);
+    auto camera_pdf = lens.area * lens.dist * lens.dist * cos_surf / (lens.cos * dist2);
+
+    auto rev_pdf  = dispatch::pdf(*vertex.bsdf, vertex.out_dir, surf_info, dir);
+    auto w_light  = camera_pdf * (vertex.d_vcm + vertex.d_vc * rev_pdf);
+    auto contrib  = vertex.throughput * bsdf_value * (camera_pdf / (1.0f + w_light));
+    if (contrib.is_black() || is_occluded(surf_info.point, camera.eye))
+        return;
+
+    auto x = std::min(static_cast<size_t>((uv[0] + 1.0f) * 0.5f * camera.width),  camera.width  - 1);
+    auto y = std::min(static_cast<size_t>((1.0f - uv[1]) * 0.5f * camera.height), camera.height - 1);
+    camera.image->atomic_accumulate(x, y, contrib);
+}
+
+Color Bdpt::connect_to_light(PcgSampler& sampler, const PathVertex& vertex) const {
+    auto& surf_info = vertex.surf_info;
+    auto light_pick = light_sampler_.sample(sampler, surf_info.point, surf_info.normal());
+    if (!light_pick)
+        return Color::black();
+    auto light = light_pick->light;
+    auto light_sample = dispatch::sample_area(*light, sampler, surf_info.point);
+    if (!light_sample)
+        return Color::black();
+
+    auto to_light = light_sample->pos - surf_info.point;
+    auto dist2 = proto::dot(to_light, to_light);
+    auto in_dir = to_light * (1.0f / std::sqrt(dist2));
+    auto cos_surf = std::abs(proto::dot(in_dir, surf_info.normal()));
+    auto bsdf_value = dispatch::eval(*vertex.bsdf, in_dir, surf_info, vertex.out_dir);
+    if (bsdf_value.is_black())
+        return Color::black();
+
+    // Pdfs of sampling the light point from the surface (solid angle), and of emitting from it (area times solid angle)
+    auto direct_pdf   = light_sample->pdf_from * dist2 / light_sample->cos * light_pick->prob;
+    auto emission_pdf = light_sample->pdf_area * light_sample->pdf_dir * light_pick->prob;
+
+    auto bsdf_pdf     = dispatch::pdf(*vertex.bsdf, in_dir, surf_info, vertex.out_dir);
+    auto bsdf_rev_pdf = dispatch::pdf(*vertex.bsdf, vertex.out_dir, surf_info, in_dir);
+    auto w_light  = dispatch::has_area(*light) ? bsdf_pdf / direct_pdf : 0.0f;
+    auto w_camera = emission_pdf * cos_surf / (direct_pdf * light_sample->cos) *
+        (vertex.d_vcm + vertex.d_vc * bsdf_rev_pdf);
+    auto mis_weight = 1.0f / (w_light + 1.0f + w_camera);
+
+    if (is_occluded(surf_info.point, light_sample->pos))
+        return Color::black();
+    return light_sample->intensity * bsdf_value * (cos_surf * mis_weight / direct_pdf);
+}
+
+Color Bdpt::connect_vertices(const PathVertex& light_vertex, const PathVertex& camera_vertex) const {
+    auto to_light = light_vertex.surf_info.point - camera_vertex.surf_info.point;
+    auto dist2 = proto::dot(to_light, to_light);
+    auto dir = to_light * (1.0f / std::sqrt(dist2));
+
+    auto camera_value = dispatch::eval(*camera_vertex.bsdf, dir, camera_vertex.surf_info, camera_vertex.out_dir);
+    auto light_value  = dispatch::eval(*light_vertex.bsdf, -dir, light_vertex.surf_info, light_vertex.out_dir);
+    if (camera_value.is_black() || light_value.is_black())
+        return Color::black();
+
+    auto cos_camera = std::abs(proto::dot(dir, camera_vertex.surf_info.normal()));
+    auto cos_light  = std::abs(proto::dot(dir, light_vertex.surf_info.normal()));
+
+    auto camera_pdf     = dispatch::pdf(*camera_vertex.bsdf, dir, camera_vertex.surf_info, camera_vertex.out_dir);
+    auto camera_rev_pdf = dispatch::pdf(*camera_vertex.bsdf, camera_vertex.out_dir, camera_vertex.surf_info, dir);
+    auto light_pdf      = dispatch::pdf(*light_vertex.bsdf, -dir, light_vertex.surf_info, light_vertex.out_dir);
+    auto light_rev_pdf  = dispatch::pdf(*light_vertex.bsdf, light_vertex.out_dir, light_vertex.surf_info, -dir);
+
+    // Convert the pdfs of sampling each vertex from the other one to the area measure
+    auto camera_pdf_area = camera_pdf * cos_light  / dist2;
+    auto light_pdf_area  = light_pdf  * cos_camera / dist2;
+    auto w_light  = camera_pdf_area * (light_vertex.d_vcm  + light_vertex.d_vc  * light_rev_pdf);
+    auto w_camera = light_pdf_area  * (camera_vertex.d_vcm + camera_vertex.d_vc * camera_rev_pdf);
+    auto mis_weight = 1.0f / (w_light + 1.0f + w_camera);
+
+    auto contrib = light_vertex.throughput * camera_value * light_value * (cos_camera * cos_light / dist2 * mis_weight);
+    if (contrib.is_black() || is_occluded(camera_vertex.surf_info.point, light_vertex.surf_info.point))
+        return Color::black();
+    return contrib;
+}
+
+bool Bdpt::is_occluded(const proto::Vec3f& from, const proto::Vec3f& to) const {
+    return scene_.root->intersect_any(proto::Rayf::between_points(from, to, config_.ray_offset));
+}
+
+} // namespace sol
@@ -1,75 +1,183 @@
+#include <vector>
+#include <mutex>
+
 #include "sol/algorithms/path_tracer.h"
 #include "sol/image.h"
 #include "sol/cameras.h"
 #include "sol/bsdfs.h"
 #include "sol/lights.h"
+#include "sol/light_sampler.h"
 
 namespace sol {
 
-void PathTracer::render(Image& image, size_t sample_index, size_t sample_count) const {
-    using Sampler = PcgSampler;
-    Renderer::for_each_pixel(
-        executor_, image.width(), image.height(),
-        [&] (size_t x, size_t y) {
+/// Vertex of a path, which records the radiance arriving from the sampled direction, for path guiding.
+struct PathTracer::GuidingVertex {
+    proto::Vec3f point;
+    proto::Vec3f dir;
+    float pdf;
+    Color throughput;   ///< Throughput of the path after this vertex, relative to the throughput at this vertex
+    Color radiance;
+};
+
+void PathTracer::render(Image& image, size_t sample_index, size_t sample_count, RenderControl* control) const {
+    // Frames update the per-pixel statistics and the guiding structure of the renderer in place,
+    // so concurrent calls are processed one after the other
+    std::lock_guard lock(mutex_);
+    if (control)
+        control->set_total_work(image.width() * image.height());
+    if (path_guiding_.is_enabled())
+        path_guiding_.start_frame(executor_, scene_.root->bbox(), sample_index);
+    if (adaptive_sampling_.is_enabled())
+        return render_adaptive(image, sample_index, sample_count, control);
+
+    auto& aovs = config_.aovs;
+    Renderer::for_each_pixel(executor_, image,
+        [&] (size_t x, size_t y, TileBuffer& tile) {
+            auto color = Color::black();
+            AovSample aov_sum;
+            for (size_t i = 0; i < sample_count; ++i)
+                color += trace_sample(x, y, image.width(), image.height(), sample_index + i, aovs.has_any() ? &aov_sum : nullptr);
+            tile.accumulate(x, y, color);
+            if (aovs.has_any())
+                aovs.accumulate(tile, x, y, aov_sum, sample_count);
+        }, control);
+}
+
+void PathTracer::render_adaptive(Image& image, size_t sample_index, size_t sample_count, RenderControl* control) const {
+    auto boost = adaptive_sampling_.start_frame(image.width(), image.height(), sample_index);
+    auto& aovs = config_.aovs;
+    Renderer::for_each_pixel(executor_, image,
+        [&] (size_t x, size_t y, TileBuffer& tile) {
+            // Converged pixels add their current mean, so that the image remains a sum of `sample_index + sample_count` samples
+            if (adaptive_sampling_.is_converged(x, y)) {
+                auto scale = static_cast<float>(sample_count) / static_cast<float>(sample_index);
+                tile.accumulate(x, y, image.rgb_at(x, y) * scale);
+                if (aovs.has_any())
+                    aovs.accumulate(tile, x, y, aovs.aovs_at(image, x, y) * scale, 0);
+                return;
+            }
+
+            thread_local std::vector<Color> samples;
+            samples.resize(sample_count * boost);
+            // Samples are numbered per pixel, since pixels do not all receive the same number of samples
+            auto first_sample = adaptive_sampling_.sample_count(x, y);
             auto color = Color::black();
-            for (size_t i = 0; i < sample_count; ++i) {
-                Sampler sampler(Renderer::pixel_seed(sample_index + i, x, y));
-                auto ray = scene_.camera->generate_ray(
-                    Renderer::sample_pixel(sampler, x, y, image.width(), image.height()));
-                color += trace_path(sampler, ray);
+            AovSample aov_sum;
+            for (size_t i = 0; i < samples.size(); ++i) {
+                color += samples[i] = trace_sample(x, y, image.width(), image.height(), first_sample + i,
+                    aovs.has_any() ? &aov_sum : nullptr);
             }
-            image.accumulate(x, y, color);
-        });
+            adaptive_sampling_.add_samples(x, y, samples.data(), samples.size());
+            auto scale = static_cast<float>(sample_count) / static_cast<float>(samples.size());
+            tile.accumulate(x, y, color * scale);
+            if (aovs.has_any())
+                aovs.accumulate(tile, x, y, aov_sum * scale, samples.size());
+        }, control);
 }
 
-static inline const Light* pick_light(Sampler& sampler, const Scene& scene) {
-    // TODO: Sample lights adaptively
-    auto light_index = std::min(static_cast<size_t>(sampler() * scene.lights.size()), scene.lights.size() - 1);
-    return scene.lights[light_index].get();
+Color PathTracer::trace_sample(size_t x, size_t y, size_t w, size_t h, size_t sample_index, AovSample* aovs) const {
+    // The sampler type is known statically in `trace_path()`, which avoids virtual calls to generate random numbers
+    auto trace = [&] (auto& sampler) {
+        auto ray = scene_.camera->generate_ray(Renderer::sample_pixel(sampler, x, y, w, h));
+        return trace_path(sampler, ray, aovs);
+    };
+    switch (config_.sampler) {
+        case SamplerType::Sobol: {
+            SobolSampler sampler(Renderer::pixel_seed(0, x, y), sample_index);
+            return trace(sampler);
+        }
+        case SamplerType::Pmj02: {
+            Pmj02Sampler sampler(Renderer::pixel_seed(0, x, y), sample_index);
+            return trace(sampler);
+        }
+        default: {
+            PcgSampler sampler(Renderer::pixel_seed(sample_index, x, y));
+            return trace(sampler);
+        }
+    }
 }
 
-Color PathTracer::trace_path(Sampler& sampler, proto::Rayf ray) const {
+bool PathTracer::is_converged() const {
+    std::lock_guard lock(mutex_);
+    return adaptive_sampling_.is_enabled() && adaptive_sampling_.is_converged();
+}
+
+template <typename SamplerType>
+Color PathTracer::trace_path(SamplerType& sampler, proto::Rayf ray, AovSample* aovs) const {
     static constexpr bool disable_mis = false;
     static constexpr bool disable_nee = false;
     static constexpr bool disable_rr  = false;
 
-    auto light_pick_prob = 1.0f / scene_.lights.size();
+    // Dimensions used by low-discrepancy samplers: The camera uses the first group of four dimensions,
+    // and each bounce uses two groups: one for light sampling and Russian Roulette, and one for the BSDF.
+    static constexpr size_t camera_dims = 4;
+    static constexpr size_t dims_per_bounce = 8;
+
+    auto& light_sampler = *scene_.light_sampler;
     auto pdf_prev_bounce = 0.0f;
+    auto prev_normal = proto::Vec3f(0);
     auto throughput = Color::constant(1.0f);
     auto color = Color::black();
+    auto path_dist = 0.0f;
+
+    // Contributions are also given to the previous vertices of the path, when recording radiance for path guiding
+    auto is_guiding_enabled = path_guiding_.is_enabled();
+    auto can_guide = is_guiding_enabled && path_guiding_.can_sample();
+    thread_local std::vector<GuidingVertex> guiding_vertices;
+    guiding_vertices.clear();
+    auto add_contribution = [&] (const Color& contribution) {
+        color += throughput * contribution;
+        for (auto& vertex : guiding_vertices)
+            vertex.radiance += vertex.throughput * contribution;
+    };
 
     for (size_t path_len = 0; path_len < config_.max_path_len; path_len++) {
-        auto hit = scene_.root->intersect_closest(ray);
-        if (!hit)
+        // Surface information is only computed when the hit point contributes to the path
+        auto hit = scene_.root->intersect_closest_record(ray);
+        if (!hit || (!hit->light && !hit->bsdf))
             break;
+        auto surf_info = hit->surface_info(ray);
 
         auto out_dir = -ray.dir;
 
         // Direct hits on a light source
-        if (hit->light && hit->surf_info.is_front_side) {
+        if (hit->light && surf_info.is_front_side) {
             // Convert the bounce pdf from solid angle to area measure
             auto pdf_prev_bounce_area =
-                pdf_prev_bounce * proto::dot(out_dir, hit->surf_info.normal()) / (ray.tmax * ray.tmax);
+                pdf_prev_bounce * proto::dot(out_dir, surf_info.normal()) / (ray.tmax * ray.tmax);
 
-            auto emission = hit->light->emission(ray.org, out_dir, hit->surf_info.surf_coords);
+            auto emission = dispatch::emission(*hit->light, ray.org, out_dir, surf_info.surf_coords);
             auto mis_weight = pdf_prev_bounce != 0.0f ?
-                Renderer::balance_heuristic(pdf_prev_bounce_area, emission.pdf_from * light_pick_prob) : 1.0f;
+                Renderer::balance_heuristic(pdf_prev_bounce_area,
+                    emission.pdf_from * light_sampler.pdf(*hit->light, ray.org, prev_normal)) : 1.0f;
             if constexpr (disable_mis || disable_nee)
                 mis_weight = pdf_prev_bounce != 0 ? 0 : 1;
-            color += throughput * emission.intensity * mis_weight;
+            add_contribution(emission.intensity * mis_weight);
         }
 
         if (!hit->bsdf)
             break;
 
+        // AOVs are recorded at the first non-specular hit, and only once per path
+        path_dist += ray.tmax;
+        if (aovs && hit->bsdf->type != Bsdf::Type::Specular) {
+            aovs->albedo += throughput * dispatch::albedo(*hit->bsdf, surf_info);
+            aovs->normal += surf_info.normal();
+            aovs->depth  += path_dist;
+            aovs = nullptr;
+        }
+
         // Evaluate direct lighting
+        auto first_dim = camera_dims + path_len * dims_per_bounce;
         bool skip_nee = disable_nee || hit->bsdf->type == Bsdf::Type::Specular;
         if (!skip_nee) {
-            auto light = pick_light(sampler, scene_);
-            if (auto light_sample = light->sample_area(sampler, hit->surf_info.point)) {
-                auto in_dir   = light_sample->pos - hit->surf_info.point;
-                auto cos_surf = proto::dot(in_dir, hit->surf_info.normal());
-                auto shadow_ray = proto::Rayf::between_points(hit->surf_info.point, light_sample->pos, config_.ray_offset);
+            sampler.set_dimension(first_dim);
+            auto light_pick = light_sampler.sample(sampler, surf_info.point, surf_info.normal());
+            auto light = light_pick ? light_pick->light : nullptr;
+            if (auto light_sample = light ? dispatch::sample_area(*light, sampler, surf_info.point) : std::nullopt) {
+                auto in_dir   = light_sample->pos - surf_info.point;
+                auto cos_surf = proto::dot(in_dir, surf_info.normal());
+                auto shadow_ray = proto::Rayf::between_points(surf_info.point, light_sample->pos, config_.ray_offset);
 
                 if (!scene_.root->intersect_any(shadow_ray)) {
                     // Normalize the incoming direction
@@ -77,21 +185,22 @@ Color PathTracer::trace_path(Sampler& sampler, proto::Rayf ray) const {
                     cos_surf *= inv_light_dist;
                     in_dir   *= inv_light_dist;
 
-                    auto pdf_bounce = light->has_area() ? hit->bsdf->pdf(in_dir, hit->surf_info, out_dir) : 0.0f;
-                    auto pdf_light  = light_sample->pdf_from * light_pick_prob;
+                    auto pdf_bounce = dispatch::has_area(*light) ? dispatch::pdf(*hit->bsdf, in_dir, surf_info, out_dir) : 0.0f;
+                    if (can_guide)
+                        pdf_bounce = guided_pdf(pdf_bounce, surf_info.point, in_dir);
+                    auto pdf_light  = light_sample->pdf_from * light_pick->prob;
                     auto geom_term  = light_sample->cos * inv_light_dist * inv_light_dist;
 
-                    auto mis_weight = light->has_area() ?
+                    auto mis_weight = dispatch::has_area(*light) ?
                         Renderer::balance_heuristic(pdf_light, pdf_bounce * geom_term) : 1.0f;
 
                     if constexpr (disable_mis)
                         mis_weight = 1;
 
-                    color +=
+                    add_contribution(
                         light_sample->intensity *
-                        throughput *
-                        hit->bsdf->eval(in_dir, hit->surf_info, out_dir) *
-                        (geom_term * cos_surf * mis_weight / pdf_light);
+                        dispatch::eval(*hit->bsdf, in_dir, surf_info, out_dir) *
+                        (geom_term * cos_surf * mis_weight / pdf_light));
                 }
             }
         }
@@ -99,6 +208,7 @@ Color PathTracer::trace_path(Sampler& sampler, proto::Rayf ray) const {
         // Russian Roulette
         auto survival_prob = 1.0f;
         if (!disable_rr && path_len >= config_.min_rr_path_len) {
+            sampler.set_dimension(first_dim + 3);
             survival_prob = proto::clamp(
                 throughput.luminance(),
                 config_.min_survival_prob,
@@ -107,16 +217,75 @@ Color PathTracer::trace_path(Sampler& sampler, proto::Rayf ray) const {
                 break;
         }
 
-        // Bounce
-        auto bsdf_sample = hit->bsdf->sample(sampler, hit->surf_info, out_dir);
+        // Bounce, using the learned distribution of incident radiance on non-specular surfaces when path guiding is enabled
+        auto is_guided = can_guide && hit->bsdf->type != Bsdf::Type::Specular;
+        auto u_guiding = 0.0f;
+        if (is_guided) {
+            sampler.set_dimension(first_dim + 7);
+            u_guiding = sampler();
+        }
+        sampler.set_dimension(first_dim + 4);
+        auto bsdf_sample = is_guided
+            ? sample_guided(sampler, u_guiding, *hit->bsdf, surf_info, out_dir)
+            : dispatch::sample(*hit->bsdf, sampler, surf_info, out_dir);
         if (!bsdf_sample)
             break;
 
-        throughput *= bsdf_sample->color * (bsdf_sample->cos / (bsdf_sample->pdf * survival_prob));
-        ray = proto::Rayf(hit->surf_info.point, bsdf_sample->in_dir, config_.ray_offset);
+        auto weight = bsdf_sample->color * (bsdf_sample->cos / (bsdf_sample->pdf * survival_prob));
+        throughput *= weight;
+        ray = proto::Rayf(surf_info.point, bsdf_sample->in_dir, config_.ray_offset);
         pdf_prev_bounce = skip_nee ? 0.0f : bsdf_sample->pdf;
+        prev_normal = surf_info.normal();
+
+        if (is_guiding_enabled) {
+            for (auto& vertex : guiding_vertices)
+                vertex.throughput *= weight;
+            if (hit->bsdf->type != Bsdf::Type::Specular) {
+                guiding_vertices.push_back(GuidingVertex {
+                    surf_info.point, bsdf_sample->in_dir, bsdf_sample->pdf, Color::constant(1.0f), Color::black()
+                });
+            }
+        }
     }
+
+    for (auto& vertex : guiding_vertices)
+        path_guiding_.record(vertex.point, vertex.dir, vertex.radiance.luminance() / vertex.pdf);
     return color;
 }
 
+template <typename SamplerType>
+std::optional<BsdfSample> PathTracer::sample_guided(
+    SamplerType& sampler,
+    float u,
+    const Bsdf& bsdf,
+    const SurfaceInfo& surf_info,
+    const proto::Vec3f& out_dir) const
+{
+    // One-sample MIS: The direction comes from either the BSDF or the learned distribution,
+    // and its pdf is the mixture of both, which corresponds to the balance heuristic.
+    std::optional<BsdfSample> bsdf_sample;
+    if (u < config_.path_guiding.bsdf_sampling_fraction) {
+        bsdf_sample = dispatch::sample(bsdf, sampler, surf_info, out_dir);
+        if (!bsdf_sample)
+            return std::nullopt;
+    } else {
+        auto [in_dir, pdf] = path_guiding_.sample(surf_info.point, sampler(), sampler());
+        if (pdf <= 0 || proto::dot(in_dir, surf_info.face_normal) <= 0)
+            return std::nullopt;
+        bsdf_sample = BsdfSample {
+            .in_dir = in_dir,
+            .pdf    = dispatch::pdf(bsdf, in_dir, surf_info, out_dir),
+            .cos    = proto::positive_dot(in_dir, surf_info.normal()),
+            .color  = dispatch::eval(bsdf, in_dir, surf_info, out_dir)
+        };
+    }
+    bsdf_sample->pdf = guided_pdf(bsdf_sample->pdf, surf_info.point, bsdf_sample->in_dir);
+    return bsdf_sample->pdf > 0 ? bsdf_sample : std::nullopt;
+}
+
+float PathTracer::guided_pdf(float bsdf_pdf, const proto::Vec3f& point, const proto::Vec3f& in_dir) const {
+    auto fraction = config_.path_guiding.bsdf_sampling_fraction;
+    return fraction * bsdf_pdf + (1.0f - fraction) * path_guiding_.pdf(point, in_dir);
+}
+
 } // namespace sol
@@ -0,0 +1,316 @@
+#include <algorithm>
+#include <numeric>
+#include <atomic>
+#include <limits>
+#include <numbers>
+#include <cmath>
+#include <cassert>
+#include <mutex>
+
+#include "sol/algorithms/sppm.h"
+#include "sol/scene.h"
+#include "sol/image.h"
+#include "sol/geometry.h"
+#include "sol/cameras.h"
+#include "sol/bsdfs.h"
+#include "sol/lights.h"
+
+namespace sol {
+
+static constexpr size_t photon_batch_size = 1024;
+
+// Photon paths use the same seeds as pixels, but with a row index that no image can have
+static constexpr size_t photon_seed_row = std::numeric_limits<size_t>::max();
+
+Sppm::Sppm(const Scene& scene, const Config& config)
+    : Renderer("Sppm", scene), config_(config), light_sampler_([&] {
+        // Photons are emitted independently of any surface point, proportionally to the power of each light
+        std::vector<const Light*> lights;
+        for (auto& light : scene.lights)
+            lights.push_back(light.get());
+        return PowerLightSampler(lights);
+    }())
+{
+    // Next-event estimation at visible points uses the light sampler of the scene
+    assert(scene.light_sampler && "the light sampler of the scene must be built with `Scene::finalize()` before creating this renderer");
+}
+
+/// First non-specular vertex of the camera path of a pixel, where photons are gathered.
+struct Sppm::VisiblePoint {
+    SurfaceInfo surf_info;
+    proto::Vec3f out_dir;
+    Color throughput;
+    const Bsdf* bsdf = nullptr;     ///< Null if the camera path has no non-specular vertex
+};
+
+void Sppm::render(Image& image, size_t sample_index, size_t sample_count, RenderControl* control) const {
+    // Iterations update the statistics of each pixel in place, so concurrent calls are processed one after the other
+    std::lock_guard lock(mutex_);
+
+    // Photon tracing is not accounted for in the progress, which only counts pixel updates
+    if (control)
+        control->set_total_work(sample_count * image.width() * image.height());
+    std::vector<VisiblePoint> visible_points(image.width() * image.height());
+    for (size_t i = 0; i < sample_count; ++i) {
+        if (control && control->is_cancelled())
+            return;
+        auto iteration = sample_index + i;
+        if (iteration == 0 || pixels_.size() != image.width() * image.height()) {
+            pixels_.assign(image.width() * image.height(), PixelStats {
+                config_.initial_radius, 0.0f, Color::black(), Color::black()
+            });
+        }
+
+        // Camera paths are traced first, so that the grid cells are sized after the radii of the pixels
+        // that gather photons in this iteration only (pixels that see the background keep their initial radius).
+        par::for_each(executor_, par::range_1d(size_t{0}, image.height()), [&] (size_t y) {
+            if (control && control->is_cancelled())
+                return;
+            for (size_t x = 0; x < image.width(); ++x) {
+                PcgSampler sampler(Renderer::pixel_seed(iteration, x, y));
+                auto ray = scene_.camera->generate_ray(
+                    Renderer::sample_pixel(sampler, x, y, image.width(), image.height()));
+                auto pixel = y * image.width() + x;
+                trace_visible_point(sampler, ray, pixels_[pixel], visible_points[pixel]);
+            }
+        });
+        if (control && control->is_cancelled())
+            return;
+
+        auto max_radius = 0.0f;
+        for (size_t j = 0; j < visible_points.size(); ++j) {
+            if (visible_points[j].bsdf)
+                max_radius = std::max(max_radius, pixels_[j].radius);
+        }
+        if (max_radius > 0) {
+            trace_photons(iteration, control);
+            if (control && control->is_cancelled())
+                return;
+            build_photon_grid(max_radius);
+        }
+
+        Renderer::for_each_pixel(executor_, image,
+            [&] (size_t x, size_t y, TileBuffer& tile) {
+                auto& stats = pixels_[y * image.width() + x];
+                auto& visible_point = visible_points[y * image.width() + x];
+                if (visible_point.bsdf)
+                    gather_photons(visible_point, stats);
+
+                // The image must contain the estimate times the number of iterations, which only depends on the
+                // current statistics of the pixel, so the difference with the previous contents is accumulated.
+                auto radius2 = stats.radius * stats.radius;
+                auto color = stats.direct + stats.flux * (1.0f / (std::numbers::pi_v<float> * radius2));
+                tile.accumulate(x, y, color - image.rgb_at(x, y));
+            }, control);
+    }
+}
+
+void Sppm::trace_photons(size_t iteration, RenderControl* control) const {
+    auto batch_count = (config_.photon_count + photon_batch_size - 1) / photon_batch_size;
+    photon_batches_.resize(batch_count);
+    par::for_each(executor_, par::range_1d(size_t{0}, batch_count), [&] (size_t batch) {
+        auto& photons = photon_batches_[batch];
+        photons.clear();
+        if (control && control->is_cancelled())
+            return;
+
+        auto end = std::min(config_.photon_count, (batch + 1) * photon_batch_size);
+        for (size_t i = batch * photon_batch_size; i < end; ++i) {
+            PcgSampler sampler(Renderer::pixel_seed(iteration, i, photon_seed_row));
+            auto light_pick = light_sampler_.sample(sampler, proto::Vec3f(0), proto::Vec3f(0));
+            if (!light_pick)
+                continue;
+            auto light_sample = dispatch::sample_emission(*light_pick->light, sampler);
+            if (!light_sample)
+                continue;
+
+            auto emission_pdf = light_sample->pdf_area * light_sample->pdf_dir * light_pick->prob;
+            auto power = light_sample->intensity *
+                (light_sample->cos / (emission_pdf * static_cast<float>(config_.photon_count)));
+            auto throughput = Color::constant(1.0f);
+            auto ray = proto::Rayf(light_sample->pos, light_sample->dir, config_.ray_offset);
+
+            for (size_t path_len = 1; path_len <= config_.max_path_len; ++path_len) {
+                auto hit = scene_.root->intersect_closest_record(ray);
+                if (!hit || !hit->bsdf)
+                    break;
+                auto surf_info = hit->surface_info(ray);
+                auto in_dir = -ray.dir;
+
+                // Photons that come directly from a light source are accounted for by direct lighting
+                if (hit->bsdf->type != Bsdf::Type::Specular && path_len > 1)
+                    photons.push_back(Photon { surf_info.point, in_dir, power * throughput });
+
+                auto survival_prob = 1.0f;
+                if (path_len >= config_.min_rr_path_len) {
+                    survival_prob = proto::clamp(
+                        throughput.luminance(),
+                        config_.min_survival_prob,
+                        config_.max_survival_prob);
+                    if (sampler() >= survival_prob)
+                        break;
+                }
+
+                auto bsdf_sample = dispatch::sample(*hit->bsdf, sampler, surf_info, in_dir, true);
+                if (!bsdf_sample)
+                    break;
+                throughput *= bsdf_sample->color * (bsdf_sample->cos / (bsdf_sample->pdf * survival_prob));
+                ray = proto::Rayf(surf_info.point, bsdf_sample->in_dir, config_.ray_offset);
+            }
+        }
+    });
+}
+
+void Sppm::build_photon_grid(float max_radius) const {
+    // Cells are twice as large as the largest radius, so that gathering visits at most 2x2x2 cells
+    cell_size_ = 2.0f * max_radius;
+
+    size_t photon_count = 0;
+    for (auto& photons : photon_batches_)
+        photon_count += photons.size();
+    size_t table_size = 1;
+    while (table_size < photon_count)
+        table_size *= 2;
+    cell_starts_.assign(table_size + 1, 0);
+    photons_.resize(photon_count);
+
+    // Photons are sorted by cell with a counting sort, in parallel over batches
+    par::for_each(executor_, par::range_1d(size_t{0}, photon_batches_.size()), [&] (size_t batch) {
+        for (auto& photon : photon_batches_[batch])
+            std::atomic_ref<uint32_t>(cell_starts_[cell_index(photon.pos)]).fetch_add(1, std::memory_order_relaxed);
+    });
+    std::exclusive_scan(cell_starts_.begin(), cell_starts_.end(), cell_starts_.begin(), uint32_t{0});
+    par::for_each(executor_, par::range_1d(size_t{0}, photon_batches_.size()), [&] (size_t batch) {
+        for (auto& photon : photon_batches_[batch]) {
+            auto index = std::atomic_ref<uint32_t>(cell_starts_[cell_index(photon.pos)]).fetch_add(1, std::memory_order_relaxed);
+            photons_[index] = photon;
+        }
+    });
+
+    // Each entry now contains the end of its cell, which is the start of the next one
+    std::copy_backward(cell_starts_.begin(), cell_starts_.end() - 2, cell_starts_.end() - 1);
+    cell_starts_[0] = 0;
+}
+
+void Sppm::trace_visible_point(PcgSampler& sampler, const proto::Rayf& camera_ray, PixelStats& stats, VisiblePoint& visible_point) const {
+    auto ray = camera_ray;
+    auto throughput = Color::constant(1.0f);
+    visible_point.bsdf = nullptr;
+
+    // Follow the camera path through specular surfaces, up to its first non-specular vertex
+    for (size_t path_len = 1; path_len <= config_.max_path_len; ++path_len) {
+        auto hit = scene_.root->intersect_closest_record(ray);
+        if (!hit || (!hit->light && !hit->bsdf))
+            break;
+        auto surf_info = hit->surface_info(ray);
+        auto out_dir = -ray.dir;
+
+        // All the previous vertices are specular, so direct hits on light sources cannot be sampled otherwise
+        if (hit->light && surf_info.is_front_side) {
+            auto emission = dispatch::emission(*hit->light, ray.org, out_dir, surf_info.surf_coords);
+            stats.direct += throughput * emission.intensity;
+        }
+
+        if (!hit->bsdf)
+            break;
+
+        if (hit->bsdf->type != Bsdf::Type::Specular) {
+            if (path_len < config_.max_path_len)
+                stats.direct += throughput * estimate_direct(sampler, surf_info, *hit->bsdf, out_dir);
+            visible_point = VisiblePoint { surf_info, out_dir, throughput, hit->bsdf };
+            break;
+        }
+
+        auto bsdf_sample = dispatch::sample(*hit->bsdf, sampler, surf_info, out_dir);
+        if (!bsdf_sample)
+            break;
+        throughput *= bsdf_sample->color * (bsdf_sample->cos / bsdf_sample->pdf);
+        ray = proto::Rayf(surf_info.point, bsdf_sample->in_dir, config_.ray_offset);
+    }
+}
+
+void Sppm::gather_photons(const VisiblePoint& visible_point, PixelStats& stats) const {
+    auto& surf_info = visible_point.surf_info;
+
+    // Gather photons in the cells that overlap the sphere of radius `stats.radius`.
+    // Different cells may map to the same hash table entry, which must only be visited once.
+    // There are at most 2x2x2 cells, or 3x3x3 with rounding errors for the largest radius.
+    size_t visited[27];
+    size_t visited_count = 0;
+    auto min_cell = (surf_info.point - proto::Vec3f(stats.radius)) * (1.0f / cell_size_);
+    auto max_cell = (surf_info.point + proto::Vec3f(stats.radius)) * (1.0f / cell_size_);
+    auto radius2 = stats.radius * stats.radius;
+    auto flux = Color::black();
+    size_t count = 0;
+    for (auto z = static_cast<int32_t>(std::floor(min_cell[2])); z <= static_cast<int32_t>(std::floor(max_cell[2])); ++z) {
+        for (auto y = static_cast<int32_t>(std::floor(min_cell[1])); y <= static_cast<int32_t>(std::floor(max_cell[1])); ++y) {
+            for (auto x = static_cast<int32_t>(std::floor(min_cell[0])); x <= static_cast<int32_t>(std::floor(max_cell[0])); ++x) {
+                auto cell = cell_index(x, y, z);
+                if (std::find(visited, visited + visited_count, cell) != visited + visited_count)
+                    continue;
+                visited[visited_count++] = cell;
+
+                for (auto i = cell_starts_[cell], n = cell_starts_[cell + 1]; i < n; ++i) {
+                    auto& photon = photons_[i];
+                    auto d = photon.pos - surf_info.point;
+                    if (proto::dot(d, d) > radius2)
+                        continue;
+                    flux += photon.power * dispatch::eval(*visible_point.bsdf, photon.in_dir, surf_info, visible_point.out_dir);
+                    count++;
+                }
+            }
+        }
+    }
+
+    // Progressive radius reduction: Only a fraction of the new photons is kept, and the radius
+    // shrinks such that the photon density remains the same.
+    if (count > 0) {
+        auto photon_count = stats.photon_count + config_.radius_alpha * static_cast<float>(count);
+        auto ratio = photon_count / (stats.photon_count + static_cast<float>(count));
+        stats.flux = (stats.flux + visible_point.throughput * flux) * ratio;
+        stats.radius *= std::sqrt(ratio);
+        stats.photon_count = photon_count;
+    }
+}
+
+Color Sppm::estimate_direct(PcgSampler& sampler, const SurfaceInfo& surf_info, const Bsdf& bsdf, const proto::Vec3f& out_dir) const {
+    auto light_pick = scene_.light_sampler->sample(sampler, surf_info.point, surf_info.normal());
+    if (!light_pick)
+        return Color::black();
+    auto light_sample = dispatch::sample_area(*light_pick->light, sampler, surf_info.point);
+    if (!light_sample)
+        return Color::black();
+
+    auto shadow_ray = proto::Rayf::between_points(surf_info.point, light_sample->pos, config_.ray_offset);
+    if (scene_.root->intersect_any(shadow_ray))
+        return Color::black();
+
+    auto in_dir = light_sample->pos - surf_info.point;
+    auto inv_light_dist = 1.0f / proto::length(in_dir);
+    in_dir *= inv_light_dist;
+    auto cos_surf  = proto::dot(in_dir, surf_info.normal());
+    auto geom_term = light_sample->cos * inv_light_dist * inv_light_dist;
+    return
+        light_sample->intensity *
+        dispatch::eval(bsdf, in_dir, surf_info, out_dir) *
+        (geom_term * cos_surf / (light_sample->pdf_from * light_pick->prob));
+}
+
+size_t Sppm::cell_index(const proto::Vec3f& pos) const {
+    auto cell = pos * (1.0f / cell_size_);
+    return cell_index(
+        static_cast<int32_t>(std::floor(cell[0])),
+        static_cast<int32_t>(std::floor(cell[1])),
+        static_cast<int32_t>(std::floor(cell[2])));
+}
+
+size_t Sppm::cell_index(int32_t x, int32_t y, int32_t z) const {
+    // See "Optimized Spatial Hashing for Collision Detection of Deformable Objects", by M. Teschner et al.
+    auto hash =
+        (static_cast<uint32_t>(x) * UINT32_C(73856093)) ^
+        (static_cast<uint32_t>(y) * UINT32_C(19349663)) ^
+        (static_cast<uint32_t>(z) * UINT32_C(83492791));
+    return hash & (cell_starts_.size() - 2);
+}
+
+} // namespace sol
@@ -0,0 +1,303 @@
+#include <vector>
+#include <array>
+#include <memory>
+#include <algorithm>
+#include <span>
+
+#include "sol/algorithms/wavefront_path_tracer.h"
+#include "sol/image.h"
+#include "sol/color.h"
+#include "sol/cameras.h"
+#include "sol/bsdfs.h"
+#include "sol/lights.h"
+#include "sol/light_sampler.h"
+
+namespace sol {
+
+/// State of a set of paths that are traced together, in SoA form.
+/// Arrays indexed by path contain the persistent state of each path, while arrays indexed by
+/// queue slot only hold the data of the current stage, for the paths that are still alive.
+struct WavefrontPathTracer::Wave {
+    size_t first_pixel;
+    size_t pixel_count;
+    size_t sample_index;
+    size_t sample_count;
+    size_t width, height;
+
+    // Per-path state
+    std::vector<PcgSampler> samplers;
+    std::vector<proto::Rayf> rays;
+    std::vector<Color> throughput;
+    std::vector<Color> color;
+    std::vector<float> pdf_prev_bounce;
+    std::vector<proto::Vec3f> prev_normal;
+    std::vector<SurfaceInfo> surf_infos;
+    std::vector<const Bsdf*> bsdfs;
+
+    // Per-slot state
+    std::vector<uint32_t> alive;
+    std::vector<uint32_t> sorted;
+    std::unique_ptr<bool[]> keep;
+    std::vector<proto::Rayf> queue_rays;
+    std::vector<std::optional<HitRecord>> hits;
+    std::unique_ptr<bool[]> all_active;
+    std::vector<proto::Rayf> shadow_rays;
+    std::vector<Color> shadow_color;
+    std::vector<float> rr_randoms;
+    std::unique_ptr<bool[]> shadow_active;
+    std::unique_ptr<bool[]> shadow_hits;
+
+    Wave(size_t max_path_count)
+        : rays(max_path_count)
+        , throughput(max_path_count)
+        , color(max_path_count)
+        , pdf_prev_bounce(max_path_count)
+        , prev_normal(max_path_count)
+        , surf_infos(max_path_count)
+        , bsdfs(max_path_count)
+        , sorted(max_path_count)
+        , keep(std::make_unique<bool[]>(max_path_count))
+        , queue_rays(max_path_count)
+        , hits(max_path_count)
+        , all_active(std::make_unique<bool[]>(max_path_count))
+        , shadow_rays(max_path_count)
+        , shadow_color(max_path_count)
+        , rr_randoms(max_path_count)
+        , shadow_active(std::make_unique<bool[]>(max_path_count))
+        , shadow_hits(std::make_unique<bool[]>(max_path_count))
+    {
+        samplers.reserve(max_path_count);
+        alive.reserve(max_path_count);
+        std::fill_n(all_active.get(), max_path_count, true);
+    }
+
+    size_t path_count() const { return pixel_count * sample_count; }
+    size_t pixel_of(size_t path) const { return first_pixel + path / sample_count; }
+    size_t sample_of(size_t path) const { return path % sample_count; }
+};
+
+void WavefrontPathTracer::render(Image& image, size_t sample_index, size_t sample_count, RenderControl* control) const {
+    if (sample_count == 0)
+        return;
+    auto pixels_per_wave = std::max(size_t{1}, config_.wave_size / sample_count);
+    auto total_pixels = image.width() * image.height();
+    if (control)
+        control->set_total_work(total_pixels);
+    Wave wave(pixels_per_wave * sample_count);
+    wave.sample_index = sample_index;
+    wave.sample_count = sample_count;
+    wave.width  = image.width();
+    wave.height = image.height();
+
+    for (size_t first_pixel = 0; first_pixel < total_pixels; first_pixel += pixels_per_wave) {
+        // Waves play the role of tiles: cancellation is checked before each of them
+        if (control && control->is_cancelled())
+            return;
+        wave.first_pixel = first_pixel;
+        wave.pixel_count = std::min(pixels_per_wave, total_pixels - first_pixel);
+
+        // Generate camera rays. Each path uses the same seed as it would with `PathTracer`.
+        wave.samplers.clear();
+        for (size_t path = 0; path < wave.path_count(); ++path) {
+            auto pixel = wave.pixel_of(path);
+            wave.samplers.emplace_back(Renderer::pixel_seed(
+                sample_index + wave.sample_of(path), pixel % wave.width, pixel / wave.width));
+        }
+        par::for_each(executor_, par::range_1d(size_t{0}, wave.path_count()), [&] (size_t path) {
+            auto pixel = wave.pixel_of(path);
+            wave.rays[path] = scene_.camera->generate_ray(Renderer::sample_pixel(
+                wave.samplers[path], pixel % wave.width, pixel / wave.width, wave.width, wave.height));
+            wave.throughput[path] = Color::constant(1.0f);
+            wave.color[path] = Color::black();
+            wave.pdf_prev_bounce[path] = 0.0f;
+        });
+
+        trace_wave(wave);
+
+        // Accumulate samples per pixel, so that no two threads write to the same pixel
+        par::for_each(executor_, par::range_1d(size_t{0}, wave.pixel_count), [&] (size_t i) {
+            auto color = Color::black();
+            for (size_t j = 0; j < sample_count; ++j)
+                color += wave.color[i * sample_count + j];
+            auto pixel = first_pixel + i;
+            image.accumulate(pixel % wave.width, pixel / wave.width, color);
+        });
+        if (control)
+            control->advance(wave.pixel_count);
+    }
+}
+
+void WavefrontPathTracer::trace_wave(Wave& wave) const {
+    static constexpr size_t tag_count = static_cast<size_t>(Bsdf::Tag::Custom) + 1;
+
+    auto& light_sampler = *scene_.light_sampler;
+
+    wave.alive.resize(wave.path_count());
+    for (size_t path = 0; path < wave.path_count(); ++path)
+        wave.alive[path] = path;
+
+    // Runs the given function over batches of consecutive slots, for batched ray queries
+    auto for_each_batch = [&] (size_t count, auto&& f) {
+        auto batch_count = (count + config_.batch_size - 1) / config_.batch_size;
+        par::for_each(executor_, par::range_1d(size_t{0}, batch_count), [&] (size_t batch) {
+            auto begin = batch * config_.batch_size;
+            f(begin, std::min(count, begin + config_.batch_size) - begin);
+        });
+    };
+
+    // Removes the paths that are not marked as kept from the list of alive paths
+    auto compact = [&] {
+        size_t alive_count = 0;
+        for (size_t i = 0; i < wave.alive.size(); ++i) {
+            if (wave.keep[i])
+                wave.alive[alive_count++] = wave.alive[i];
+        }
+        wave.alive.resize(alive_count);
+    };
+
+    for (size_t path_len = 0; path_len < config_.max_path_len && !wave.alive.empty(); path_len++) {
+        auto alive_count = wave.alive.size();
+        std::fill_n(wave.keep.get(), alive_count, false);
+
+        // Extend: Find the closest intersection along each ray. Rays are gathered in a contiguous queue first.
+        par::for_each(executor_, par::range_1d(size_t{0}, alive_count), [&] (size_t i) {
+            wave.queue_rays[i] = wave.rays[wave.alive[i]];
+        });
+        for_each_batch(alive_count, [&] (size_t begin, size_t count) {
+            scene_.root->intersect_closest_batch(
+                std::span(wave.queue_rays.data() + begin, count),
+                std::span<const bool>(wave.all_active.get() + begin, count),
+                std::span(wave.hits.data() + begin, count));
+        });
+
+        // Emission: Compute surface information, and add the contribution of lights that are hit directly
+        par::for_each(executor_, par::range_1d(size_t{0}, alive_count), [&] (size_t i) {
+            auto path = wave.alive[i];
+            auto& hit = wave.hits[i];
+            if (!hit || (!hit->light && !hit->bsdf))
+                return;
+
+            auto& ray = wave.queue_rays[i];
+            auto& surf_info = wave.surf_infos[path] = hit->surface_info(ray);
+            auto out_dir = -ray.dir;
+            if (hit->light && surf_info.is_front_side) {
+                auto pdf_prev_bounce = wave.pdf_prev_bounce[path];
+                auto pdf_prev_bounce_area =
+                    pdf_prev_bounce * proto::dot(out_dir, surf_info.normal()) / (ray.tmax * ray.tmax);
+                auto emission = dispatch::emission(*hit->light, ray.org, out_dir, surf_info.surf_coords);
+                auto mis_weight = pdf_prev_bounce != 0.0f ?
+                    Renderer::balance_heuristic(pdf_prev_bounce_area,
+                        emission.pdf_from * light_sampler.pdf(*hit->light, ray.org, wave.prev_normal[path])) : 1.0f;
+                wave.color[path] += wave.throughput[path] * emission.intensity * mis_weight;
+            }
+
+            wave.bsdfs[path] = hit->bsdf;
+            wave.keep[i] = hit->bsdf != nullptr;
+        });
+        compact();
+
+        // Sort the remaining paths by BSDF, so that shading stages process similar materials together
+        alive_count = wave.alive.size();
+        std::array<size_t, tag_count + 1> offsets {};
+        for (auto path : wave.alive)
+            offsets[static_cast<size_t>(wave.bsdfs[path]->tag) + 1]++;
+        for (size_t i = 1; i <= tag_count; ++i)
+            offsets[i] += offsets[i - 1];
+        for (auto path : wave.alive)
+            wave.sorted[offsets[static_cast<size_t>(wave.bsdfs[path]->tag)]++] = path;
+        std::copy_n(wave.sorted.begin(), alive_count, wave.alive.begin());
+
+        // Shadow rays: Sample lights for the paths that are on a non-specular surface
+        par::for_each(executor_, par::range_1d(size_t{0}, alive_count), [&] (size_t i) {
+            auto path = wave.alive[i];
+            auto bsdf = wave.bsdfs[path];
+            auto& surf_info = wave.surf_infos[path];
+            auto& sampler = wave.samplers[path];
+            auto out_dir = -wave.rays[path].dir;
+
+            wave.shadow_active[i] = false;
+            if (bsdf->type == Bsdf::Type::Specular)
+                return;
+
+            auto light_pick = light_sampler.sample(sampler, surf_info.point, surf_info.normal());
+            if (!light_pick)
+                return;
+            auto light = light_pick->light;
+            auto light_sample = dispatch::sample_area(*light, sampler, surf_info.point);
+            if (!light_sample)
+                return;
+
+            auto in_dir   = light_sample->pos - surf_info.point;
+            auto cos_surf = proto::dot(in_dir, surf_info.normal());
+            wave.shadow_rays[i] = proto::Rayf::between_points(surf_info.point, light_sample->pos, config_.ray_offset);
+
+            auto inv_light_dist = 1.0f / proto::length(in_dir);
+            cos_surf *= inv_light_dist;
+            in_dir   *= inv_light_dist;
+
+            auto pdf_bounce = dispatch::has_area(*light) ? dispatch::pdf(*bsdf, in_dir, surf_info, out_dir) : 0.0f;
+            auto pdf_light  = light_sample->pdf_from * light_pick->prob;
+            auto geom_term  = light_sample->cos * inv_light_dist * inv_light_dist;
+            auto mis_weight = dispatch::has_area(*light) ?
+                Renderer::balance_heuristic(pdf_light, pdf_bounce * geom_term) : 1.0f;
+
+            wave.shadow_color[i] =
+                light_sample->intensity *
+                wave.throughput[path] *
+                dispatch::eval(*bsdf, in_dir, surf_info, out_dir) *
+                (geom_term * cos_surf * mis_weight / pdf_light);
+            wave.shadow_active[i] = true;
+        });
+
+        // Occlusion: Test the shadow rays in batches
+        for_each_batch(alive_count, [&] (size_t begin, size_t count) {
+            scene_.root->intersect_any_batch(
+                std::span<const proto::Rayf>(wave.shadow_rays.data() + begin, count),
+                std::span<const bool>(wave.shadow_active.get() + begin, count),
+                std::span(wave.shadow_hits.get() + begin, count));
+        });
+
+        // Random numbers for Russian Roulette are generated for the whole wave at once, with vectorized generators.
+        // The seed depends on each of the sample index, path length, and wave separately, so that no two bounces share a stream.
+        if (path_len >= config_.min_rr_path_len) {
+            PcgLanes<8> rr_lanes(proto::fnv::Hasher().combine(wave.sample_index).combine(path_len).combine(wave.first_pixel));
+            rr_lanes.fill(wave.rr_randoms.data(), alive_count);
+        }
+
+        // Bounce: Add the contribution of unoccluded shadow rays, apply Russian Roulette, and sample the BSDFs
+        std::fill_n(wave.keep.get(), alive_count, false);
+        par::for_each(executor_, par::range_1d(size_t{0}, alive_count), [&] (size_t i) {
+            auto path = wave.alive[i];
+            auto bsdf = wave.bsdfs[path];
+            auto& surf_info = wave.surf_infos[path];
+            auto& sampler = wave.samplers[path];
+            auto& throughput = wave.throughput[path];
+
+            if (wave.shadow_active[i] && !wave.shadow_hits[i])
+                wave.color[path] += wave.shadow_color[i];
+
+            auto survival_prob = 1.0f;
+            if (path_len >= config_.min_rr_path_len) {
+                survival_prob = proto::clamp(
+                    throughput.luminance(),
+                    config_.min_survival_prob,
+                    config_.max_survival_prob);
+                if (wave.rr_randoms[i] >= survival_prob)
+                    return;
+            }
+
+            auto bsdf_sample = dispatch::sample(*bsdf, sampler, surf_info, -wave.rays[path].dir);
+            if (!bsdf_sample)
+                return;
+
+            throughput *= bsdf_sample->color * (bsdf_sample->cos / (bsdf_sample->pdf * survival_prob));
+            wave.rays[path] = proto::Rayf(surf_info.point, bsdf_sample->in_dir, config_.ray_offset);
+            wave.pdf_prev_bounce[path] = bsdf->type == Bsdf::Type::Specular ? 0.0f : bsdf_sample->pdf;
+            wave.prev_normal[path] = surf_info.normal();
+            wave.keep[i] = true;
+        });
+        compact();
+    }
+}
+
+} // namespace sol
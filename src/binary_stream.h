@@ -0,0 +1,99 @@
+#ifndef SOL_BINARY_STREAM_H
+#define SOL_BINARY_STREAM_H
+
+#include <cstddef>
+#include <cstring>
+#include <vector>
+#include <string>
+#include <span>
+#include <ostream>
+#include <stdexcept>
+#include <type_traits>
+
+namespace sol {
+
+/// Writes plain data to a binary output stream. Data is written in the native byte order,
+/// since the resulting files are only meant to be read back on the same machine.
+struct BinaryWriter {
+    std::ostream& os;
+
+    BinaryWriter(std::ostream& os)
+        : os(os)
+    {}
+
+    template <typename T>
+    void write(const T& t) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        os.write(reinterpret_cast<const char*>(&t), sizeof(T));
+    }
+
+    template <typename T>
+    void write(const T* data, size_t count) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        os.write(reinterpret_cast<const char*>(data), sizeof(T) * count);
+    }
+
+    template <typename T>
+    void write(const std::vector<T>& vector) {
+        write(vector.size());
+        write(vector.data(), vector.size());
+    }
+
+    void write(const std::string& string) {
+        write(string.size());
+        write(string.data(), string.size());
+    }
+};
+
+/// Reads plain data from a buffer in memory, typically a memory-mapped file.
+/// Throws an exception when trying to read past the end of the buffer.
+struct BinaryReader {
+    std::span<const std::byte> data;
+
+    BinaryReader(std::span<const std::byte> data)
+        : data(data)
+    {}
+
+    template <typename T>
+    T read() {
+        T t;
+        read(&t, 1);
+        return t;
+    }
+
+    template <typename T>
+    void read(T* ptr, size_t count) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        if (count > data.size() / sizeof(T))
+            throw std::runtime_error("Unexpected end of binary stream");
+        auto size = sizeof(T) * count;
+        std::memcpy(static_cast<void*>(ptr), data.data(), size);
+        data = data.subspan(size);
+    }
+
+    /// Reads a number of elements, and checks that the rest of the buffer is large enough to contain
+    /// that many elements of the given size, so that the elements can be allocated before being read.
+    size_t read_count(size_t element_size) {
+        auto count = read<size_t>();
+        if (count > data.size() / element_size)
+            throw std::runtime_error("Invalid element count in binary stream");
+        return count;
+    }
+
+    template <typename T>
+    std::vector<T> read_vector() {
+        std::vector<T> vector(read_count(sizeof(T)));
+        read(vector.data(), vector.size());
+        return vector;
+    }
+
+    std::string read_string() {
+        std::string string(read_count(sizeof(char)), '\0');
+        read(string.data(), string.size());
+        return string;
+    }
+};
+
+} // namespace sol
+
+#endif
@@ -33,10 +33,15 @@ DiffuseBsdf::DiffuseBsdf(const ColorTexture& kd)
 {}
 
 Color DiffuseBsdf::eval(const proto::Vec3f&, const SurfaceInfo& surf_info, const proto::Vec3f&) const {
-    return kd_.sample_color(surf_info.tex_coords) * std::numbers::inv_pi_v<float>;
+    return dispatch::sample_color(kd_, surf_info.tex_coords) * std::numbers::inv_pi_v<float>;
 }
 
-std::optional<BsdfSample> DiffuseBsdf::sample(Sampler& sampler, const SurfaceInfo& surf_info, const proto::Vec3f& out_dir, bool) const {
+std::optional<BsdfSample> DiffuseBsdf::sample(Sampler& sampler, const SurfaceInfo& surf_info, const proto::Vec3f& out_dir, bool is_adjoint) const {
+    return sample<Sampler>(sampler, surf_info, out_dir, is_adjoint);
+}
+
+template <BuiltinSampler SamplerType>
+std::optional<BsdfSample> DiffuseBsdf::sample(SamplerType& sampler, const SurfaceInfo& surf_info, const proto::Vec3f& out_dir, bool) const {
     auto [in_dir, pdf] = proto::sample_cosine_hemisphere(sampler(), sampler());
     auto local_in_dir = surf_info.local * in_dir;
     return validate_sample(surf_info, BsdfSample {
@@ -51,6 +56,10 @@ float DiffuseBsdf::pdf(const proto::Vec3f& in_dir, const SurfaceInfo& surf_info,
     return proto::cosine_hemisphere_pdf(proto::positive_dot(in_dir, surf_info.normal()));
 }
 
+Color DiffuseBsdf::albedo(const SurfaceInfo& surf_info) const {
+    return dispatch::sample_color(kd_, surf_info.tex_coords);
+}
+
 proto::fnv::Hasher& DiffuseBsdf::hash(proto::fnv::Hasher& hasher) const {
     return hasher.combine(tag).combine(&kd_);
 }
@@ -66,12 +75,19 @@ PhongBsdf::PhongBsdf(const ColorTexture& ks, const Texture& ns)
 {}
 
 Color PhongBsdf::eval(const proto::Vec3f& in_dir, const SurfaceInfo& surf_info, const proto::Vec3f& out_dir) const {
-    return eval(in_dir, surf_info, out_dir, ks_.sample_color(surf_info.tex_coords), ns_.sample(surf_info.tex_coords));
+    return eval(in_dir, surf_info, out_dir,
+        dispatch::sample_color(ks_, surf_info.tex_coords),
+        dispatch::sample(ns_, surf_info.tex_coords));
+}
+
+std::optional<BsdfSample> PhongBsdf::sample(Sampler& sampler, const SurfaceInfo& surf_info, const proto::Vec3f& out_dir, bool is_adjoint) const {
+    return sample<Sampler>(sampler, surf_info, out_dir, is_adjoint);
 }
 
-std::optional<BsdfSample> PhongBsdf::sample(Sampler& sampler, const SurfaceInfo& surf_info, const proto::Vec3f& out_dir, bool) const {
-    auto ks = ks_.sample_color(surf_info.tex_coords);
-    auto ns = ns_.sample(surf_info.tex_coords);
+template <BuiltinSampler SamplerType>
+std::optional<BsdfSample> PhongBsdf::sample(SamplerType& sampler, const SurfaceInfo& surf_info, const proto::Vec3f& out_dir, bool) const {
+    auto ks = dispatch::sample_color(ks_, surf_info.tex_coords);
+    auto ns = dispatch::sample(ns_, surf_info.tex_coords);
     auto basis = proto::ortho_basis(proto::reflect(-out_dir, surf_info.normal()));
     auto [in_dir, pdf] = proto::sample_cosine_power_hemisphere(ns, sampler(), sampler());
     auto local_in_dir = basis * in_dir;
@@ -85,7 +101,11 @@ std::optional<BsdfSample> PhongBsdf::sample(Sampler& sampler, const SurfaceInfo&
 }
 
 float PhongBsdf::pdf(const proto::Vec3f& in_dir, const SurfaceInfo& surf_info, const proto::Vec3f& out_dir) const {
-    return proto::cosine_power_hemisphere_pdf(ns_.sample(surf_info.tex_coords), reflect_cosine(in_dir, surf_info.normal(), out_dir));
+    return proto::cosine_power_hemisphere_pdf(dispatch::sample(ns_, surf_info.tex_coords), reflect_cosine(in_dir, surf_info.normal(), out_dir));
+}
+
+Color PhongBsdf::albedo(const SurfaceInfo& surf_info) const {
+    return dispatch::sample_color(ks_, surf_info.tex_coords);
 }
 
 proto::fnv::Hasher& PhongBsdf::hash(proto::fnv::Hasher& hasher) const {
@@ -109,15 +129,24 @@ MirrorBsdf::MirrorBsdf(const ColorTexture& ks)
     : Bsdf(Tag::MirrorBsdf, Type::Specular), ks_(ks)
 {}
 
-std::optional<BsdfSample> MirrorBsdf::sample(Sampler&, const SurfaceInfo& surf_info, const proto::Vec3f& out_dir, bool) const {
+std::optional<BsdfSample> MirrorBsdf::sample(Sampler& sampler, const SurfaceInfo& surf_info, const proto::Vec3f& out_dir, bool is_adjoint) const {
+    return sample<Sampler>(sampler, surf_info, out_dir, is_adjoint);
+}
+
+template <BuiltinSampler SamplerType>
+std::optional<BsdfSample> MirrorBsdf::sample(SamplerType&, const SurfaceInfo& surf_info, const proto::Vec3f& out_dir, bool) const {
     return validate_sample(surf_info, BsdfSample {
         .in_dir = proto::reflect(-out_dir, surf_info.normal()),
         .pdf    = 1.0f,
         .cos    = 1.0f,
-        .color  = ks_.sample_color(surf_info.tex_coords)
+        .color  = dispatch::sample_color(ks_, surf_info.tex_coords)
     });
 }
 
+Color MirrorBsdf::albedo(const SurfaceInfo& surf_info) const {
+    return dispatch::sample_color(ks_, surf_info.tex_coords);
+}
+
 proto::fnv::Hasher& MirrorBsdf::hash(proto::fnv::Hasher& hasher) const {
     return hasher.combine(tag).combine(&ks_);
 }
@@ -136,7 +165,12 @@ GlassBsdf::GlassBsdf(
 {}
 
 std::optional<BsdfSample> GlassBsdf::sample(Sampler& sampler, const SurfaceInfo& surf_info, const proto::Vec3f& out_dir, bool is_adjoint) const {
-    auto eta = eta_.sample(surf_info.tex_coords);
+    return sample<Sampler>(sampler, surf_info, out_dir, is_adjoint);
+}
+
+template <BuiltinSampler SamplerType>
+std::optional<BsdfSample> GlassBsdf::sample(SamplerType& sampler, const SurfaceInfo& surf_info, const proto::Vec3f& out_dir, bool is_adjoint) const {
+    auto eta = dispatch::sample(eta_, surf_info.tex_coords);
     eta = surf_info.is_front_side ? eta : 1.0f / eta;
     auto cos_i = proto::dot(out_dir, surf_info.normal());
     auto cos2_t = 1.0f - eta * eta * (1.0f - cos_i * cos_i);
@@ -150,7 +184,7 @@ std::optional<BsdfSample> GlassBsdf::sample(Sampler& sampler, const SurfaceInfo&
                 .in_dir = refract_dir,
                 .pdf    = 1.0f,
                 .cos    = 1.0f,
-                .color  = kt_.sample_color(surf_info.tex_coords) * adjoint_fix
+                .color  = dispatch::sample_color(kt_, surf_info.tex_coords) * adjoint_fix
             });
         }
     }
@@ -160,10 +194,15 @@ std::optional<BsdfSample> GlassBsdf::sample(Sampler& sampler, const SurfaceInfo&
         .in_dir = proto::reflect(-out_dir, surf_info.normal()),
         .pdf    = 1.0f,
         .cos    = 1.0f,
-        .color  = ks_.sample_color(surf_info.tex_coords)
+        .color  = dispatch::sample_color(ks_, surf_info.tex_coords)
     });
 }
 
+Color GlassBsdf::albedo(const SurfaceInfo& surf_info) const {
+    // Most of the light goes through glass, except at grazing angles
+    return dispatch::sample_color(kt_, surf_info.tex_coords);
+}
+
 proto::fnv::Hasher& GlassBsdf::hash(proto::fnv::Hasher& hasher) const {
     return hasher.combine(tag).combine(&ks_).combine(&kt_).combine(&eta_);
 }
@@ -184,21 +223,26 @@ InterpBsdf::InterpBsdf(const Bsdf* a, const Bsdf* b, const Texture& k)
 
 RgbColor InterpBsdf::eval(const proto::Vec3f& in_dir, const SurfaceInfo& surf_info, const proto::Vec3f& out_dir) const {
     return lerp(
-        a_->eval(in_dir, surf_info, out_dir),
-        b_->eval(in_dir, surf_info, out_dir),
-        k_.sample(surf_info.tex_coords));
+        dispatch::eval(*a_, in_dir, surf_info, out_dir),
+        dispatch::eval(*b_, in_dir, surf_info, out_dir),
+        dispatch::sample(k_, surf_info.tex_coords));
 }
 
 std::optional<BsdfSample> InterpBsdf::sample(Sampler& sampler, const SurfaceInfo& surf_info, const proto::Vec3f& out_dir, bool is_adjoint) const {
-    auto k = k_.sample(surf_info.tex_coords);
+    return sample<Sampler>(sampler, surf_info, out_dir, is_adjoint);
+}
+
+template <BuiltinSampler SamplerType>
+std::optional<BsdfSample> InterpBsdf::sample(SamplerType& sampler, const SurfaceInfo& surf_info, const proto::Vec3f& out_dir, bool is_adjoint) const {
+    auto k = dispatch::sample(k_, surf_info.tex_coords);
     auto target = b_, other = a_;
     if (sampler() > k) {
         std::swap(target, other);
         k = 1.0f - k;
     }
-    if (auto sample = target->sample(sampler, surf_info, out_dir, is_adjoint)) {
-        sample->pdf   = proto::lerp(other->pdf(sample->in_dir, surf_info, out_dir), sample->pdf, k);
-        sample->color = lerp(other->eval(sample->in_dir, surf_info, out_dir), sample->color, k);
+    if (auto sample = dispatch::sample(*target, sampler, surf_info, out_dir, is_adjoint)) {
+        sample->pdf   = proto::lerp(dispatch::pdf(*other, sample->in_dir, surf_info, out_dir), sample->pdf, k);
+        sample->color = lerp(dispatch::eval(*other, sample->in_dir, surf_info, out_dir), sample->color, k);
         return sample;
     }
     return std::nullopt;
@@ -206,9 +250,16 @@ std::optional<BsdfSample> InterpBsdf::sample(Sampler& sampler, const SurfaceInfo
 
 float InterpBsdf::pdf(const proto::Vec3f& in_dir, const SurfaceInfo& surf_info, const proto::Vec3f& out_dir) const {
     return proto::lerp(
-        a_->pdf(in_dir, surf_info, out_dir),
-        b_->pdf(in_dir, surf_info, out_dir),
-        k_.sample(surf_info.tex_coords));
+        dispatch::pdf(*a_, in_dir, surf_info, out_dir),
+        dispatch::pdf(*b_, in_dir, surf_info, out_dir),
+        dispatch::sample(k_, surf_info.tex_coords));
+}
+
+Color InterpBsdf::albedo(const SurfaceInfo& surf_info) const {
+    return lerp(
+        dispatch::albedo(*a_, surf_info),
+        dispatch::albedo(*b_, surf_info),
+        dispatch::sample(k_, surf_info.tex_coords));
 }
 
 proto::fnv::Hasher& InterpBsdf::hash(proto::fnv::Hasher& hasher) const {
@@ -229,4 +280,18 @@ Bsdf::Type InterpBsdf::infer_type(Type a, Type b) {
     return Type::Specular;
 }
 
+// The sampling functions are compiled for each of the built-in samplers (see `BuiltinSampler`).
+#define SOL_INSTANTIATE_BSDF_SAMPLE(SamplerType) \
+    template std::optional<BsdfSample> DiffuseBsdf::sample<SamplerType>(SamplerType&, const SurfaceInfo&, const proto::Vec3f&, bool) const; \
+    template std::optional<BsdfSample> PhongBsdf::sample<SamplerType>(SamplerType&, const SurfaceInfo&, const proto::Vec3f&, bool) const; \
+    template std::optional<BsdfSample> MirrorBsdf::sample<SamplerType>(SamplerType&, const SurfaceInfo&, const proto::Vec3f&, bool) const; \
+    template std::optional<BsdfSample> GlassBsdf::sample<SamplerType>(SamplerType&, const SurfaceInfo&, const proto::Vec3f&, bool) const; \
+    template std::optional<BsdfSample> InterpBsdf::sample<SamplerType>(SamplerType&, const SurfaceInfo&, const proto::Vec3f&, bool) const;
+
+SOL_INSTANTIATE_BSDF_SAMPLE(PcgSampler)
+SOL_INSTANTIATE_BSDF_SAMPLE(SobolSampler)
+SOL_INSTANTIATE_BSDF_SAMPLE(Pmj02Sampler)
+
+#undef SOL_INSTANTIATE_BSDF_SAMPLE
+
 } // namespace sol
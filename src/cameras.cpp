@@ -1,3 +1,5 @@
+#include <limits>
+
 #include "sol/cameras.h"
 
 namespace sol {
@@ -25,8 +27,11 @@ proto::Rayf PerspectiveCamera::generate_ray(const proto::Vec2f& uv) const {
 }
 
 proto::Vec2f PerspectiveCamera::project(const proto::Vec3f& point) const {
-    auto d = proto::normalize(point - eye_);
-    return proto::Vec2f(dot(d, right_) / (w_ * w_), dot(d, up_) / (h_ * h_));
+    auto d = point - eye_;
+    auto z = dot(d, dir_);
+    if (z <= 0)
+        return proto::Vec2f(std::numeric_limits<float>::infinity());
+    return proto::Vec2f(dot(d, right_) / (w_ * w_ * z), dot(d, up_) / (h_ * h_ * z));
 }
 
 proto::Vec3f PerspectiveCamera::unproject(const proto::Vec2f& uv) const {
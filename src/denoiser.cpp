@@ -0,0 +1,102 @@
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include <proto/vec.h>
+
+#include "sol/denoiser.h"
+
+namespace sol {
+
+// Avoids divisions by zero when comparing colors, and when removing the albedo from colors
+static constexpr float color_epsilon = 1.0e-3f;
+
+Image Denoiser::denoise(const Image& image, const AovLayout& aovs, float scale) const {
+    auto width  = image.width();
+    auto height = image.height();
+    auto albedo_channel = aovs.first_channel(Aov::Albedo);
+    auto normal_channel = aovs.first_channel(Aov::Normal);
+    auto depth_channel  = aovs.first_channel(Aov::Depth);
+
+    // Gather the colors and guides, with the albedo removed from the colors
+    std::vector<Color> colors(width * height);
+    std::vector<Color> albedos(width * height, Color::constant(1.0f));
+    std::vector<proto::Vec3f> normals(normal_channel ? width * height : 0);
+    std::vector<float> depths(depth_channel ? width * height : 0);
+    par::for_each(executor_, par::range_1d(size_t{0}, height), [&] (size_t y) {
+        for (size_t x = 0, i = y * width; x < width; ++x, ++i) {
+            auto channel = [&] (size_t c) { return image.channel(c)[i] * scale; };
+            if (albedo_channel)
+                albedos[i] = Color(channel(*albedo_channel), channel(*albedo_channel + 1), channel(*albedo_channel + 2));
+            if (normal_channel)
+                normals[i] = proto::Vec3f(channel(*normal_channel), channel(*normal_channel + 1), channel(*normal_channel + 2));
+            if (depth_channel)
+                depths[i] = channel(*depth_channel);
+            colors[i] = Color(channel(0), channel(1), channel(2)) / (albedos[i] + Color::constant(color_epsilon));
+        }
+    });
+
+    auto radius = static_cast<int>(config_.radius);
+    auto patch_radius = static_cast<int>(config_.patch_radius);
+    auto patch_size = static_cast<float>((2 * patch_radius + 1) * (2 * patch_radius + 1));
+    auto inv_spatial  = 0.5f / (config_.spatial_sigma * config_.spatial_sigma);
+    auto inv_color    = 0.5f / (config_.color_sigma   * config_.color_sigma * patch_size * 3.0f);
+    auto inv_albedo   = 0.5f / (config_.albedo_sigma  * config_.albedo_sigma);
+    auto inv_normal   = 0.5f / (config_.normal_sigma  * config_.normal_sigma);
+    auto inv_depth    = 0.5f / (config_.depth_sigma   * config_.depth_sigma);
+
+    auto at = [&] (int x, int y) {
+        return static_cast<size_t>(std::clamp(y, 0, static_cast<int>(height) - 1)) * width +
+               static_cast<size_t>(std::clamp(x, 0, static_cast<int>(width)  - 1));
+    };
+    auto relative_dist = [] (float a, float b) {
+        return (a - b) * (a - b) / (color_epsilon + a * a + b * b);
+    };
+
+    Image output(width, height, 3);
+    tile_scheduler_.for_each_pixel(executor_, output, [&] (size_t x, size_t y, TileBuffer& tile) {
+        auto i = y * width + x;
+        auto sum = Color::black();
+        auto weight_sum = 0.0f;
+        for (int dy = -radius; dy <= radius; ++dy) {
+            for (int dx = -radius; dx <= radius; ++dx) {
+                auto qx = static_cast<int>(x) + dx;
+                auto qy = static_cast<int>(y) + dy;
+                if (qx < 0 || qy < 0 || qx >= static_cast<int>(width) || qy >= static_cast<int>(height))
+                    continue;
+                auto j = static_cast<size_t>(qy) * width + static_cast<size_t>(qx);
+
+                // Non-local means: Compare the patches around both pixels, in a scale-independent way
+                auto patch_dist = 0.0f;
+                for (int py = -patch_radius; py <= patch_radius; ++py) {
+                    for (int px = -patch_radius; px <= patch_radius; ++px) {
+                        auto& a = colors[at(static_cast<int>(x) + px, static_cast<int>(y) + py)];
+                        auto& b = colors[at(qx + px, qy + py)];
+                        patch_dist += relative_dist(a.r, b.r) + relative_dist(a.g, b.g) + relative_dist(a.b, b.b);
+                    }
+                }
+
+                auto exponent = static_cast<float>(dx * dx + dy * dy) * inv_spatial + patch_dist * inv_color;
+                if (albedo_channel) {
+                    auto d = albedos[i] - albedos[j];
+                    exponent += (d.r * d.r + d.g * d.g + d.b * d.b) * inv_albedo;
+                }
+                if (normal_channel) {
+                    auto d = normals[i] - normals[j];
+                    exponent += proto::dot(d, d) * inv_normal;
+                }
+                if (depth_channel)
+                    exponent += relative_dist(depths[i], depths[j]) * inv_depth;
+
+                auto weight = std::exp(-exponent);
+                sum += colors[j] * weight;
+                weight_sum += weight;
+            }
+        }
+        // The weight of the center pixel is always 1, so the sum of the weights is never zero
+        tile.accumulate(x, y, sum * (1.0f / weight_sum) * (albedos[i] + Color::constant(color_epsilon)));
+    });
+    return output;
+}
+
+} // namespace sol
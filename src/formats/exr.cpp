@@ -1,4 +1,10 @@
 #include <cstring>
+#include <numeric>
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <iterator>
+#include <vector>
 
 #define TINYEXR_IMPLEMENTATION
 #include <tinyexr.h>
@@ -35,9 +41,29 @@ std::optional<Image> load(const std::string_view& path) {
         return std::nullopt;
     }
 
-    Image image(exr_image.width, exr_image.height, exr_header.num_channels);
-    for (int i = 0; i < exr_header.num_channels; ++i)
-        std::memcpy(image.channel(i).get(), exr_image.images[i], sizeof(float) * exr_image.width * exr_image.height);
+    // Channels are stored sorted by name, so they are mapped by name: The color channels come first,
+    // in the order R, G, B, A, followed by the other channels in the order of the file.
+    static constexpr std::string_view color_names[] = { "R", "G", "B", "A" };
+    size_t channel_count = exr_header.num_channels;
+    std::vector<size_t> ranks(channel_count);
+    for (size_t i = 0; i < channel_count; ++i) {
+        ranks[i] = std::find(std::begin(color_names), std::end(color_names),
+            std::string_view(exr_header.channels[i].name)) - std::begin(color_names);
+    }
+    std::vector<size_t> order(channel_count);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&] (size_t i, size_t j) { return ranks[i] < ranks[j]; });
+
+    Image image(exr_image.width, exr_image.height, channel_count);
+    bool has_default_names = channel_count >= 3 && channel_count <= 4;
+    std::vector<std::string> names(channel_count);
+    for (size_t i = 0; i < channel_count; ++i) {
+        std::memcpy(image.channel(i).get(), exr_image.images[order[i]], sizeof(float) * exr_image.width * exr_image.height);
+        names[i] = exr_header.channels[order[i]].name;
+        has_default_names &= ranks[order[i]] == i;
+    }
+    if (!has_default_names)
+        image.set_channel_names(std::move(names));
 
     FreeEXRImage(&exr_image);
     FreeEXRHeader(&exr_header);
@@ -52,17 +78,26 @@ bool save(const Image& image, const std::string_view& path) {
     InitEXRHeader(&exr_header);
     InitEXRImage(&exr_image);
 
-    std::vector<float*> images(image.channel_count());
-    if (image.channel_count() >= 3) {
-        images[0] = image.channel(2).get();
-        images[1] = image.channel(1).get();
-        images[2] = image.channel(0).get();
-        for (size_t i = 3; i < image.channel_count(); ++i)
-            images[i] = image.channel(i).get();
-    } else {
+    // Readers expect channels to be sorted by name, hence the order A, B, G, R for default names (see `load()`)
+    std::vector<std::string> names(image.channel_names());
+    if (names.empty()) {
         for (size_t i = 0; i < image.channel_count(); ++i)
-            images[i] = image.channel(i).get();
+            names.push_back("Channel_" + std::to_string(i));
+        if (image.channel_count() >= 3) {
+            names[0] = "R";
+            names[1] = "G";
+            names[2] = "B";
+            if (image.channel_count() >= 4)
+                names[3] = "A";
+        }
     }
+    std::vector<size_t> order(image.channel_count());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&] (size_t i, size_t j) { return names[i] < names[j]; });
+
+    std::vector<float*> images(image.channel_count());
+    for (size_t i = 0; i < image.channel_count(); ++i)
+        images[i] = image.channel(order[i]).get();
 
     exr_image.images = reinterpret_cast<unsigned char**>(images.data());
     exr_image.width = image.width();
@@ -74,16 +109,8 @@ bool save(const Image& image, const std::string_view& path) {
 
     size_t name_len = sizeof(EXRChannelInfo::name) - 1;
     for (size_t i = 0; i < image.channel_count(); ++i) {
-        auto channel_name = "Channel_" + std::to_string(i);
         // Note: That syntax here makes sure that the name is a proper C-string
-        std::strncpy(exr_header.channels[i].name, channel_name.c_str(), name_len)[name_len] = 0;
-    }
-    if (image.channel_count() >= 3) {
-        if (image.channel_count() >= 4)
-            std::strncpy(exr_header.channels[3].name, "A", name_len)[name_len] = 0;
-        std::strncpy(exr_header.channels[2].name, "R", name_len)[name_len] = 0;
-        std::strncpy(exr_header.channels[1].name, "G", name_len)[name_len] = 0;
-        std::strncpy(exr_header.channels[0].name, "B", name_len)[name_len] = 0;
+        std::strncpy(exr_header.channels[i].name, names[order[i]].c_str(), name_len)[name_len] = 0;
     }
 
     std::vector<int> pixel_types(image.channel_count(), TINYEXR_PIXELTYPE_FLOAT);
@@ -9,6 +9,9 @@
 #include <cstring>
 #include <filesystem>
 #include <system_error>
+#include <fstream>
+#include <random>
+#include <span>
 
 #include <proto/hash.h>
 
@@ -19,6 +22,8 @@
 #include "sol/triangle_mesh.h"
 
 #include "formats/obj.h"
+#include "binary_stream.h"
+#include "mapped_file.h"
 
 namespace sol::obj {
 
@@ -72,6 +77,19 @@ struct Material {
 
 using MaterialLib = std::unordered_map<std::string, Material>;
 
+struct EmissiveTriangle {
+    size_t index;
+    proto::Vec3f v0, v1, v2;
+};
+
+/// Material information that is stored in the cache along with the mesh data,
+/// so that the BSDFs and lights of the mesh can be re-created without parsing the OBJ file.
+struct MaterialInfo {
+    std::vector<std::string> materials;
+    std::vector<uint32_t> material_indices;
+    std::vector<EmissiveTriangle> emissive_triangles;
+};
+
 struct File {
     std::vector<Object> objects;
     std::vector<proto::Vec3f> vertices;
@@ -425,6 +443,8 @@ static std::unique_ptr<TriangleMesh> build_mesh(
     SceneLoader& scene_loader,
     const File& file,
     const MaterialLib& material_lib,
+    const TriangleMesh::Config& config,
+    MaterialInfo& material_info,
     bool is_strict)
 {
     auto hash = [] (const Index& idx) { return idx.hash(); };
@@ -477,7 +497,11 @@ static std::unique_ptr<TriangleMesh> build_mesh(
                         auto intensity = get_color_texture(scene_loader, material.map_ke, material.ke, is_strict);
                         auto light = scene_loader.get_or_insert_light<UniformTriangleLight>(triangle, *intensity);
                         lights.emplace(indices.size() / 3, light);
+                        material_info.emissive_triangles.push_back(EmissiveTriangle {
+                            indices.size() / 3, triangle.v0, triangle.v1, triangle.v2
+                        });
                     }
+                    material_info.material_indices.push_back(static_cast<uint32_t>(face.material));
 
                     indices.push_back(first_index);
                     indices.push_back(cur_index);
@@ -512,24 +536,175 @@ static std::unique_ptr<TriangleMesh> build_mesh(
         std::move(normals),
         std::move(tex_coords),
         std::move(bsdfs),
-        std::move(lights));
+        std::move(lights),
+        config);
+}
+
+// Mesh cache ----------------------------------------------------------------------
+
+static constexpr uint32_t cache_magic   = 0x434c4f53; // 'SOLC'
+static constexpr uint32_t cache_version = 6;
+
+static uint64_t hash_files(const std::string& obj_file, const std::vector<std::string>& mtl_files, const TriangleMesh::Config& config) {
+    // 64-bit FNV-1a over the contents of the OBJ and MTL files, and the mesh configuration
+    uint64_t h = UINT64_C(0xcbf29ce484222325);
+    auto combine = [&] (std::span<const std::byte> bytes) {
+        for (auto byte : bytes)
+            h = (h ^ static_cast<uint64_t>(byte)) * UINT64_C(0x100000001b3);
+    };
+    combine(std::as_bytes(std::span(&config.bvh_quality, 1)));
+    combine(std::as_bytes(std::span(&config.bvh_arity, 1)));
+    combine(std::as_bytes(std::span(&config.compress_bvh, 1)));
+    combine(std::as_bytes(std::span(&config.compact, 1)));
+    combine(MappedFile(obj_file).data());
+    for (auto& file_name : mtl_files) {
+        MappedFile file(file_name);
+        combine(file.data());
+    }
+    return h;
+}
+
+static std::unique_ptr<TriangleMesh> load_from_cache(
+    SceneLoader& scene_loader,
+    const std::string& cache_file,
+    const std::string& obj_file,
+    const TriangleMesh::Config& config,
+    bool is_strict)
+{
+    MappedFile file(cache_file);
+    if (!file.is_open())
+        return nullptr;
+
+    try {
+        BinaryReader reader(file.data());
+        if (reader.read<uint32_t>() != cache_magic || reader.read<uint32_t>() != cache_version)
+            return nullptr;
+        auto hash = reader.read<uint64_t>();
+        std::vector<std::string> mtl_files(reader.read_count(sizeof(size_t)));
+        for (auto& mtl_file : mtl_files)
+            mtl_file = reader.read_string();
+        if (hash != hash_files(obj_file, mtl_files, config))
+            return nullptr;
+
+        MaterialInfo material_info;
+        material_info.materials.resize(reader.read_count(sizeof(size_t)));
+        for (auto& material : material_info.materials)
+            material = reader.read_string();
+        material_info.material_indices   = reader.read_vector<uint32_t>();
+        material_info.emissive_triangles = reader.read_vector<EmissiveTriangle>();
+
+        MaterialLib material_lib;
+        material_lib.emplace("#dummy", Material {});
+        for (auto& mtl_file : mtl_files)
+            parse_mtl(mtl_file, material_lib, is_strict);
+
+        std::vector<const Bsdf*> material_bsdfs;
+        for (auto& material : material_info.materials) {
+            if (!material_lib.contains(material))
+                return nullptr;
+            material_bsdfs.push_back(convert_material(scene_loader, material_lib[material], is_strict));
+        }
+
+        std::vector<const Bsdf*> bsdfs(material_info.material_indices.size());
+        for (size_t i = 0; i < bsdfs.size(); ++i) {
+            if (material_info.material_indices[i] >= material_bsdfs.size())
+                return nullptr;
+            bsdfs[i] = material_bsdfs[material_info.material_indices[i]];
+        }
+
+        std::unordered_map<size_t, const Light*> lights;
+        for (auto& emissive_triangle : material_info.emissive_triangles) {
+            if (emissive_triangle.index >= material_info.material_indices.size())
+                return nullptr;
+            auto material_index = material_info.material_indices[emissive_triangle.index];
+            if (material_index >= material_info.materials.size())
+                return nullptr;
+            auto& material = material_lib[material_info.materials[material_index]];
+            proto::Trianglef triangle(emissive_triangle.v0, emissive_triangle.v1, emissive_triangle.v2);
+            auto intensity = get_color_texture(scene_loader, material.map_ke, material.ke, is_strict);
+            auto light = scene_loader.get_or_insert_light<UniformTriangleLight>(triangle, *intensity);
+            lights.emplace(emissive_triangle.index, light);
+        }
+
+        return std::make_unique<TriangleMesh>(reader, std::move(bsdfs), std::move(lights), config);
+    } catch (std::runtime_error&) {
+        // Invalid or outdated cache files are simply ignored
+        return nullptr;
+    }
+}
+
+static void save_to_cache(
+    const std::string& cache_file,
+    const std::string& obj_file,
+    const std::vector<std::string>& mtl_files,
+    const MaterialInfo& material_info,
+    const TriangleMesh::Config& config,
+    const TriangleMesh& mesh)
+{
+    // The cache is written to a temporary file first, and then renamed, so that a crash or another process
+    // writing the same cache never leaves a truncated cache file behind.
+    auto tmp_file = cache_file + ".tmp" + std::to_string(std::random_device()());
+    std::ofstream os(tmp_file, std::ios::binary);
+    if (!os)
+        return;
+
+    BinaryWriter writer(os);
+    writer.write(cache_magic);
+    writer.write(cache_version);
+    writer.write(hash_files(obj_file, mtl_files, config));
+    writer.write(mtl_files.size());
+    for (auto& mtl_file : mtl_files)
+        writer.write(mtl_file);
+    writer.write(material_info.materials.size());
+    for (auto& material : material_info.materials)
+        writer.write(material);
+    writer.write(material_info.material_indices);
+    writer.write(material_info.emissive_triangles);
+    mesh.write(writer);
+    os.close();
+
+    std::error_code err_code;
+    if (os)
+        std::filesystem::rename(tmp_file, cache_file, err_code);
+    if (!os || err_code)
+        std::filesystem::remove(tmp_file, err_code);
 }
 
-std::unique_ptr<TriangleMesh> load(SceneLoader& scene_loader, const std::string_view& file_name) {
+std::unique_ptr<TriangleMesh> load(
+    SceneLoader& scene_loader,
+    const std::string_view& file_name,
+    const TriangleMesh::Config& config,
+    bool use_cache)
+{
     static constexpr bool is_strict = false;
 
-    auto file = parse_obj(std::string(file_name), is_strict);
+    auto obj_file = std::string(file_name);
+    auto cache_file = obj_file + ".cache";
+    if (use_cache) {
+        if (auto mesh = load_from_cache(scene_loader, cache_file, obj_file, config, is_strict))
+            return mesh;
+    }
+
+    auto file = parse_obj(obj_file, is_strict);
     MaterialLib material_lib;
     material_lib.emplace("#dummy", Material {});
 
+    std::vector<std::string> mtl_files;
     for (auto& mtl_file : file.mtl_files) {
         std::error_code err_code;
         auto full_path = std::filesystem::absolute(file_name, err_code).parent_path().string() + "/" + mtl_file;
         parse_mtl(full_path, material_lib, is_strict);
+        mtl_files.push_back(full_path);
     }
 
     check_materials(file, material_lib, is_strict);
-    return build_mesh(scene_loader, file, material_lib, is_strict);
+    MaterialInfo material_info;
+    auto mesh = build_mesh(scene_loader, file, material_lib, config, material_info, is_strict);
+    if (use_cache) {
+        material_info.materials = file.materials;
+        save_to_cache(cache_file, obj_file, mtl_files, material_info, config, *mesh);
+    }
+    return mesh;
 }
 
 } // namespace sol::obj
@@ -8,7 +8,10 @@
 
 namespace sol::obj {
 
-std::unique_ptr<TriangleMesh> load(SceneLoader&, const std::string_view&);
+/// Loads an OBJ file as a triangle mesh. When `use_cache` is true, the mesh data and its acceleration
+/// data structure are saved in a cache file next to the OBJ file, and re-used on the next load,
+/// provided that the OBJ file, its material libraries, and the mesh configuration have not changed.
+std::unique_ptr<TriangleMesh> load(SceneLoader&, const std::string_view&, const TriangleMesh::Config& = {}, bool use_cache = false);
 
 } // namespace sol::obj
 
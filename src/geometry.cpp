@@ -0,0 +1,21 @@
+#include "sol/geometry.h"
+#include "sol/transform.h"
+
+namespace sol {
+
+SurfaceInfo HitRecord::surface_info(const proto::Rayf& ray) const {
+    if (!inverse_transform)
+        return geometry->surface_info(ray, *this);
+
+    // Distances along the ray are preserved by the transformation, since the direction is not normalized
+    auto local_ray = ray;
+    local_ray.org = inverse_transform->apply_point(ray.org);
+    local_ray.dir = inverse_transform->apply_vector(ray.dir);
+    auto surf_info = geometry->surface_info(local_ray, *this);
+    surf_info.point       = ray.point_at(t);
+    surf_info.face_normal = proto::normalize(AffineTransform::apply_normal(*inverse_transform, surf_info.face_normal));
+    surf_info.local       = proto::ortho_basis(proto::normalize(AffineTransform::apply_normal(*inverse_transform, surf_info.normal())));
+    return surf_info;
+}
+
+} // namespace sol
@@ -0,0 +1,145 @@
+#include <bvh/bvh.h>
+#include <bvh/sweep_sah_builder.h>
+#if defined(SOL_ENABLE_TBB)
+#include <bvh/tbb/parallel_top_down_scheduler.h>
+#include <par/tbb/executors.h>
+#elif defined(SOL_ENABLE_OMP)
+#include <bvh/omp/parallel_top_down_scheduler.h>
+#include <par/omp/executors.h>
+#else
+#include <bvh/sequential_top_down_scheduler.h>
+#include <par/sequential_executor.h>
+#endif
+#include <bvh/single_ray_traverser.h>
+
+#include "sol/instances.h"
+
+namespace sol {
+
+using Bvh = bvh::Bvh<float>;
+
+#if defined(SOL_ENABLE_TBB)
+template <typename Builder>
+using TopDownScheduler = bvh::tbb::ParallelTopDownScheduler<Builder>;
+using Executor         = par::tbb::Executor;
+#elif defined(SOL_ENABLE_OMP)
+template <typename Builder>
+using TopDownScheduler = bvh::omp::ParallelTopDownScheduler<Builder>;
+using Executor         = par::omp::StaticExecutor;
+#else
+template <typename Builder>
+using TopDownScheduler = bvh::SequentialTopDownScheduler<Builder>;
+using Executor         = par::SequentialExecutor;
+#endif
+
+struct InstanceGroup::BvhData {
+    Bvh bvh;
+    proto::BBoxf bbox;
+};
+
+InstanceGroup::InstanceGroup(std::vector<Instance>&& instances) {
+    // Nested groups are kept as leaves of the top-level BVH, so that they are shared instead of copied
+    instances_.reserve(instances.size());
+    for (auto& instance : instances) {
+        // Empty objects (e.g. empty groups) can never be hit, and have no meaningful bounding box
+        auto bbox = instance.geometry->bbox();
+        if (bbox.min[0] > bbox.max[0] || bbox.min[1] > bbox.max[1] || bbox.min[2] > bbox.max[2])
+            continue;
+        auto nested_group = dynamic_cast<const InstanceGroup*>(instance.geometry);
+        auto inverse = instance.transform.inverse();
+        instances_.push_back(TransformedInstance {
+            instance.geometry, nested_group, instance.transform, inverse, std::move(instance.lights), inverses_.size() });
+        if (nested_group) {
+            for (auto& nested_inverse : nested_group->inverses_)
+                inverses_.push_back(nested_inverse * inverse);
+        } else
+            inverses_.push_back(inverse);
+    }
+    if (instances_.empty())
+        return;
+
+    using Builder = bvh::SweepSahBuilder<Bvh>;
+    Executor executor;
+    TopDownScheduler<Builder> top_down_scheduler;
+
+    auto bboxes  = std::make_unique<proto::BBoxf[]>(instances_.size());
+    auto centers = std::make_unique<proto::Vec3f[]>(instances_.size());
+    auto global_bbox = proto::BBoxf::empty();
+    for (size_t i = 0; i < instances_.size(); ++i) {
+        bboxes[i]  = instances_[i].transform.apply(instances_[i].geometry->bbox());
+        centers[i] = (bboxes[i].min + bboxes[i].max) * 0.5f;
+        global_bbox.extend(bboxes[i]);
+    }
+
+    bvh_data_ = std::make_unique<BvhData>(BvhData {
+        Builder::build(top_down_scheduler, executor, global_bbox, bboxes.get(), centers.get(), instances_.size()),
+        global_bbox
+    });
+}
+
+InstanceGroup::~InstanceGroup() = default;
+
+proto::Rayf InstanceGroup::to_local(const TransformedInstance& instance, const proto::Rayf& ray) const {
+    // The direction is not normalized, so that distances along the ray are preserved
+    return proto::Rayf(
+        instance.inverse.apply_point(ray.org),
+        instance.inverse.apply_vector(ray.dir),
+        ray.tmin, ray.tmax);
+}
+
+std::optional<HitRecord> InstanceGroup::intersect_closest_record(proto::Rayf& ray) const {
+    if (instances_.empty())
+        return std::nullopt;
+    return bvh::SingleRayTraverser<Bvh>::traverse<false>(ray, bvh_data_->bvh,
+        [&] (proto::Rayf& ray, const Bvh::Node& leaf) {
+            std::optional<HitRecord> hit;
+            for (size_t i = leaf.first_index, n = leaf.first_index + leaf.prim_count; i < n; ++i) {
+                auto& instance = instances_[bvh_data_->bvh.prim_indices[i]];
+                auto local_ray = to_local(instance, ray);
+                auto local_hit = instance.geometry->intersect_closest_record(local_ray);
+                if (!local_hit)
+                    continue;
+
+                // Records from nested groups point to one of their transformations,
+                // which has been composed with the transformation of this instance in `inverses_`
+                ray.tmax = local_ray.tmax;
+                auto inverse_index = instance.first_inverse;
+                if (instance.nested_group)
+                    inverse_index += local_hit->inverse_transform - instance.nested_group->inverses_.data();
+                local_hit->inverse_transform = &inverses_[inverse_index];
+                if (local_hit->light) {
+                    auto it = instance.lights.find(local_hit->light);
+                    local_hit->light = it != instance.lights.end() ? it->second : nullptr;
+                }
+                hit = local_hit;
+            }
+            return hit;
+        });
+}
+
+SurfaceInfo InstanceGroup::surface_info(const proto::Rayf& ray, const HitRecord& record) const {
+    // Records produced by this object refer to the instanced objects directly, along with the transformation
+    // from the coordinate system of this group to theirs, so the record has all it needs to compute this itself.
+    return record.surface_info(ray);
+}
+
+bool InstanceGroup::intersect_any(const proto::Rayf& init_ray) const {
+    if (instances_.empty())
+        return false;
+    auto ray = init_ray;
+    return bvh::SingleRayTraverser<Bvh>::traverse<true>(ray, bvh_data_->bvh,
+        [&] (proto::Rayf& ray, const Bvh::Node& leaf) {
+            for (size_t i = leaf.first_index, n = leaf.first_index + leaf.prim_count; i < n; ++i) {
+                auto& instance = instances_[bvh_data_->bvh.prim_indices[i]];
+                if (instance.geometry->intersect_any(to_local(instance, ray)))
+                    return true;
+            }
+            return false;
+        });
+}
+
+proto::BBoxf InstanceGroup::bbox() const {
+    return bvh_data_ ? bvh_data_->bbox : proto::BBoxf::empty();
+}
+
+} // namespace sol
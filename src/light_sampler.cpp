@@ -0,0 +1,343 @@
+#include <algorithm>
+#include <numbers>
+#include <limits>
+#include <utility>
+#include <cmath>
+
+#include "sol/light_sampler.h"
+#include "sol/samplers.h"
+
+namespace sol {
+
+static constexpr float one_minus_epsilon = 0x1.fffffep-1f;
+
+// Uniform Light Sampler -----------------------------------------------------------
+
+UniformLightSampler::UniformLightSampler(const std::vector<const Light*>& lights)
+    : lights_(lights)
+{}
+
+std::optional<LightPick> UniformLightSampler::sample(Sampler& sampler, const proto::Vec3f&, const proto::Vec3f&) const {
+    if (lights_.empty())
+        return std::nullopt;
+    auto light_index = std::min(static_cast<size_t>(sampler() * lights_.size()), lights_.size() - 1);
+    return std::make_optional(LightPick { lights_[light_index], 1.0f / static_cast<float>(lights_.size()) });
+}
+
+float UniformLightSampler::pdf(const Light&, const proto::Vec3f&, const proto::Vec3f&) const {
+    return lights_.empty() ? 0.0f : 1.0f / static_cast<float>(lights_.size());
+}
+
+// Power Light Sampler -------------------------------------------------------------
+
+PowerLightSampler::PowerLightSampler(const std::vector<const Light*>& lights) {
+    // Lights that emit no power cannot contribute, and are never picked
+    std::vector<double> powers;
+    auto total_power = 0.0;
+    for (auto light : lights) {
+        auto power = light->bounds().power;
+        if (power <= 0)
+            continue;
+        indices_.emplace(light, static_cast<uint32_t>(lights_.size()));
+        lights_.push_back(light);
+        powers.push_back(power);
+        total_power += power;
+    }
+    if (lights_.empty())
+        return;
+
+    auto count = lights_.size();
+    probs_.resize(count);
+    entries_.resize(count);
+    std::vector<uint32_t> small, large;
+    std::vector<double> scaled(count);
+    for (size_t i = 0; i < count; ++i) {
+        probs_[i] = static_cast<float>(powers[i] / total_power);
+        scaled[i] = powers[i] * static_cast<double>(count) / total_power;
+        (scaled[i] < 1.0 ? small : large).push_back(static_cast<uint32_t>(i));
+    }
+
+    while (!small.empty() && !large.empty()) {
+        auto i = small.back(); small.pop_back();
+        auto j = large.back(); large.pop_back();
+        entries_[i] = AliasEntry { static_cast<float>(scaled[i]), j };
+        scaled[j] -= 1.0 - scaled[i];
+        (scaled[j] < 1.0 ? small : large).push_back(j);
+    }
+
+    // Remaining entries have a probability of (almost exactly) one, up to rounding errors
+    for (auto i : small) entries_[i] = AliasEntry { 1.0f, i };
+    for (auto i : large) entries_[i] = AliasEntry { 1.0f, i };
+}
+
+std::optional<LightPick> PowerLightSampler::sample(Sampler& sampler, const proto::Vec3f&, const proto::Vec3f&) const {
+    if (lights_.empty())
+        return std::nullopt;
+    auto u = std::min(sampler(), one_minus_epsilon) * static_cast<float>(lights_.size());
+    auto index = std::min(static_cast<size_t>(u), lights_.size() - 1);
+    auto& entry = entries_[index];
+    if (u - static_cast<float>(index) >= entry.threshold)
+        index = entry.alias;
+    return std::make_optional(LightPick { lights_[index], probs_[index] });
+}
+
+float PowerLightSampler::pdf(const Light& light, const proto::Vec3f&, const proto::Vec3f&) const {
+    auto it = indices_.find(&light);
+    return it != indices_.end() ? probs_[it->second] : 0.0f;
+}
+
+// Light Tree ----------------------------------------------------------------------
+
+struct LightTree::BuildItem {
+    const Light* light;
+    LightBounds bounds;
+    proto::Vec3f center;
+};
+
+static inline float safe_sqrt(float x) { return std::sqrt(std::max(x, 0.0f)); }
+static inline float safe_acos(float x) { return std::acos(std::clamp(x, -1.0f, 1.0f)); }
+
+// Returns the cosine and sine of `max(0, a - b)`, given the cosines and sines of `a` and `b`.
+static inline std::pair<float, float> sub_clamped(float cos_a, float sin_a, float cos_b, float sin_b) {
+    if (cos_a > cos_b)
+        return { 1.0f, 0.0f };
+    return { cos_a * cos_b + sin_a * sin_b, sin_a * cos_b - cos_a * sin_b };
+}
+
+static LightBounds merge_bounds(const LightBounds& a, const LightBounds& b) {
+    constexpr auto pi = std::numbers::pi_v<float>;
+    auto bounds = LightBounds {
+        .bbox        = proto::BBoxf(a.bbox).extend(b.bbox),
+        .axis        = a.axis,
+        .cos_theta_o = -1.0f,
+        .cos_theta_e = std::min(a.cos_theta_e, b.cos_theta_e),
+        .power       = a.power + b.power
+    };
+
+    // Compute the smallest cone that contains both cones of normals
+    auto theta_a = safe_acos(a.cos_theta_o);
+    auto theta_b = safe_acos(b.cos_theta_o);
+    auto theta_d = safe_acos(proto::dot(a.axis, b.axis));
+    if (std::min(theta_d + theta_b, pi) <= theta_a) {
+        bounds.cos_theta_o = a.cos_theta_o;
+        return bounds;
+    }
+    if (std::min(theta_d + theta_a, pi) <= theta_b) {
+        bounds.axis = b.axis;
+        bounds.cos_theta_o = b.cos_theta_o;
+        return bounds;
+    }
+    auto theta_o = 0.5f * (theta_a + theta_d + theta_b);
+    auto rotation_axis = proto::cross(a.axis, b.axis);
+    auto rotation_len = proto::length(rotation_axis);
+    if (theta_o >= pi || rotation_len <= std::numeric_limits<float>::epsilon())
+        return bounds;
+
+    // Rotate the axis of the first cone towards the second one
+    auto theta_r = theta_o - theta_a;
+    rotation_axis = rotation_axis * (1.0f / rotation_len);
+    bounds.axis = proto::normalize(
+        a.axis * std::cos(theta_r) + proto::cross(rotation_axis, a.axis) * std::sin(theta_r));
+    bounds.cos_theta_o = std::cos(theta_o);
+    return bounds;
+}
+
+// Surface Area Orientation Heuristic (see "Importance Sampling of Many Lights With Adaptive Tree Splitting").
+static float split_cost(const LightBounds& bounds) {
+    constexpr auto pi = std::numbers::pi_v<float>;
+    auto theta_o = safe_acos(bounds.cos_theta_o);
+    auto theta_e = safe_acos(bounds.cos_theta_e);
+    auto theta_w = std::min(theta_o + theta_e, pi);
+    auto sin_theta_o = safe_sqrt(1.0f - bounds.cos_theta_o * bounds.cos_theta_o);
+    auto orientation_measure =
+        2.0f * pi * (1.0f - bounds.cos_theta_o) +
+        0.5f * pi * (2.0f * theta_w * sin_theta_o - std::cos(theta_o - 2.0f * theta_w) -
+            2.0f * theta_o * sin_theta_o + bounds.cos_theta_o);
+    auto extents = bounds.bbox.max - bounds.bbox.min;
+    auto half_area = extents[0] * extents[1] + extents[1] * extents[2] + extents[0] * extents[2];
+    return bounds.power * orientation_measure * half_area;
+}
+
+LightTree::LightTree(const std::vector<const Light*>& lights) {
+    // Lights that emit no power cannot contribute, and are left out of the tree
+    std::vector<BuildItem> items;
+    for (auto light : lights) {
+        auto bounds = light->bounds();
+        if (bounds.power > 0)
+            items.push_back(BuildItem { light, bounds, (bounds.bbox.min + bounds.bbox.max) * 0.5f });
+    }
+    if (items.empty())
+        return;
+
+    lights_.reserve(items.size());
+    nodes_.reserve(2 * items.size() - 1);
+    nodes_.emplace_back();
+    build(0, items.data(), items.size(), 0);
+}
+
+void LightTree::build(uint32_t node_index, BuildItem* items, size_t count, uint32_t parent) {
+    if (count == 1) {
+        auto light_index = static_cast<uint32_t>(lights_.size());
+        lights_.push_back(items[0].light);
+        leaves_.emplace(items[0].light, node_index);
+        nodes_[node_index] = Node { items[0].bounds, light_index, parent, true };
+        return;
+    }
+
+    auto bounds = items[0].bounds;
+    auto center_bbox = proto::BBoxf::empty();
+    for (size_t i = 0; i < count; ++i) {
+        if (i > 0)
+            bounds = merge_bounds(bounds, items[i].bounds);
+        center_bbox.extend(items[i].center);
+    }
+
+    // Find the best split with a binned sweep over each axis
+    static constexpr size_t bin_count = 12;
+    auto best_cost = std::numeric_limits<float>::max();
+    size_t best_axis = 3, best_bin = 0;
+    auto extents = bounds.bbox.max - bounds.bbox.min;
+    auto max_extent = std::max(extents[0], std::max(extents[1], extents[2]));
+    auto bin_index = [&] (const BuildItem& item, size_t axis) {
+        auto offset = (item.center[axis] - center_bbox.min[axis]) / (center_bbox.max[axis] - center_bbox.min[axis]);
+        return std::min(static_cast<size_t>(offset * bin_count), bin_count - 1);
+    };
+    for (size_t axis = 0; axis < 3; ++axis) {
+        if (center_bbox.max[axis] <= center_bbox.min[axis])
+            continue;
+
+        std::optional<LightBounds> bins[bin_count];
+        for (size_t i = 0; i < count; ++i) {
+            auto& bin = bins[bin_index(items[i], axis)];
+            bin = bin ? merge_bounds(*bin, items[i].bounds) : items[i].bounds;
+        }
+
+        std::optional<float> right_costs[bin_count];
+        std::optional<LightBounds> right;
+        for (size_t i = bin_count - 1; i > 0; --i) {
+            if (bins[i])
+                right = right ? merge_bounds(*right, *bins[i]) : *bins[i];
+            if (right)
+                right_costs[i] = split_cost(*right);
+        }
+
+        // Penalize thin splits along axes where the bounding box is already small
+        auto aspect_factor = extents[axis] > 0 ? max_extent / extents[axis] : 1.0f;
+        std::optional<LightBounds> left;
+        for (size_t i = 0; i < bin_count - 1; ++i) {
+            if (bins[i])
+                left = left ? merge_bounds(*left, *bins[i]) : *bins[i];
+            if (!left || !right_costs[i + 1])
+                continue;
+            auto cost = aspect_factor * (split_cost(*left) + *right_costs[i + 1]);
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_axis = axis;
+                best_bin = i;
+            }
+        }
+    }
+
+    size_t left_count = count / 2;
+    if (best_axis < 3) {
+        left_count = std::partition(items, items + count,
+            [&] (const BuildItem& item) { return bin_index(item, best_axis) <= best_bin; }) - items;
+    }
+    if (left_count == 0 || left_count == count)
+        left_count = count / 2;
+
+    auto first_child = static_cast<uint32_t>(nodes_.size());
+    nodes_[node_index] = Node { bounds, first_child, parent, false };
+    nodes_.emplace_back();
+    nodes_.emplace_back();
+    build(first_child + 0, items, left_count, node_index);
+    build(first_child + 1, items + left_count, count - left_count, node_index);
+}
+
+float LightTree::importance(const LightBounds& bounds, const proto::Vec3f& point, const proto::Vec3f& normal) {
+    auto center = (bounds.bbox.min + bounds.bbox.max) * 0.5f;
+    auto diagonal = bounds.bbox.max - bounds.bbox.min;
+    auto to_point = point - center;
+    auto dist2 = proto::dot(to_point, to_point);
+    auto dir = dist2 > 0 ? to_point * (1.0f / std::sqrt(dist2)) : bounds.axis;
+
+    // Cone of directions subtended by the bounding sphere of the box, as seen from the point
+    auto radius2 = 0.25f * proto::dot(diagonal, diagonal);
+    auto cos_theta_b = -1.0f, sin_theta_b = 0.0f;
+    if (dist2 > radius2) {
+        auto sin2_theta_b = radius2 / dist2;
+        cos_theta_b = safe_sqrt(1.0f - sin2_theta_b);
+        sin_theta_b = std::sqrt(sin2_theta_b);
+    }
+
+    // Smallest angle between the direction to the point and an emission direction
+    auto cos_theta_w = proto::dot(bounds.axis, dir);
+    auto sin_theta_w = safe_sqrt(1.0f - cos_theta_w * cos_theta_w);
+    auto sin_theta_o = safe_sqrt(1.0f - bounds.cos_theta_o * bounds.cos_theta_o);
+    auto [cos_theta_x, sin_theta_x] = sub_clamped(cos_theta_w, sin_theta_w, bounds.cos_theta_o, sin_theta_o);
+    auto cos_theta_p = sub_clamped(cos_theta_x, sin_theta_x, cos_theta_b, sin_theta_b).first;
+    if (cos_theta_p <= bounds.cos_theta_e)
+        return 0.0f;
+
+    // Smallest angle between the surface normal and a direction towards the light.
+    // The absolute value accounts for surfaces that transmit light.
+    auto cos_theta_i = std::abs(proto::dot(dir, normal));
+    auto sin_theta_i = safe_sqrt(1.0f - cos_theta_i * cos_theta_i);
+    auto cos_theta_pi = sub_clamped(cos_theta_i, sin_theta_i, cos_theta_b, sin_theta_b).first;
+
+    // Clamp the distance to avoid extremely large values when the point is close to or inside the box
+    dist2 = std::max(dist2, 0.5f * proto::length(diagonal));
+    return std::max(bounds.power * cos_theta_p * cos_theta_pi / std::max(dist2, std::numeric_limits<float>::min()), 0.0f);
+}
+
+std::optional<LightPick> LightTree::sample(Sampler& sampler, const proto::Vec3f& point, const proto::Vec3f& normal) const {
+    if (nodes_.empty() || importance(nodes_[0].bounds, point, normal) <= 0)
+        return std::nullopt;
+
+    // The same random number is reused at every level, after being remapped to [0, 1)
+    auto u = std::min(sampler(), one_minus_epsilon);
+    auto prob = 1.0f;
+    uint32_t node_index = 0;
+    while (!nodes_[node_index].is_leaf) {
+        auto first_child = nodes_[node_index].first_child_or_light;
+        auto left  = importance(nodes_[first_child + 0].bounds, point, normal);
+        auto right = importance(nodes_[first_child + 1].bounds, point, normal);
+        if (left <= 0 && right <= 0)
+            return std::nullopt;
+
+        auto left_prob = left / (left + right);
+        if (u < left_prob) {
+            node_index = first_child;
+            prob *= left_prob;
+            u = std::min(u / left_prob, one_minus_epsilon);
+        } else {
+            node_index = first_child + 1;
+            prob *= 1.0f - left_prob;
+            u = std::min((u - left_prob) / (1.0f - left_prob), one_minus_epsilon);
+        }
+    }
+    return std::make_optional(LightPick { lights_[nodes_[node_index].first_child_or_light], prob });
+}
+
+float LightTree::pdf(const Light& light, const proto::Vec3f& point, const proto::Vec3f& normal) const {
+    auto it = leaves_.find(&light);
+    if (it == leaves_.end() || importance(nodes_[0].bounds, point, normal) <= 0)
+        return 0.0f;
+
+    // Walk up from the leaf, multiplying the probabilities to choose each node over its sibling
+    auto prob = 1.0f;
+    for (auto node_index = it->second; node_index != 0;) {
+        auto parent = nodes_[node_index].parent;
+        auto first_child = nodes_[parent].first_child_or_light;
+        auto left  = importance(nodes_[first_child + 0].bounds, point, normal);
+        auto right = importance(nodes_[first_child + 1].bounds, point, normal);
+        auto node_importance = node_index == first_child ? left : right;
+        if (node_importance <= 0)
+            return 0.0f;
+        prob *= node_importance / (left + right);
+        node_index = parent;
+    }
+    return prob;
+}
+
+} // namespace sol
@@ -1,3 +1,5 @@
+#include <numbers>
+
 #include <proto/random.h>
 
 #include "sol/lights.h"
@@ -12,7 +14,12 @@ PointLight::PointLight(const proto::Vec3f& pos, const Color& intensity)
     : Light(Tag::PointLight), pos_(pos), intensity_(intensity)
 {}
 
-std::optional<LightAreaSample> PointLight::sample_area(Sampler&, const proto::Vec3f&) const {
+std::optional<LightAreaSample> PointLight::sample_area(Sampler& sampler, const proto::Vec3f& from) const {
+    return sample_area<Sampler>(sampler, from);
+}
+
+template <BuiltinSampler SamplerType>
+std::optional<LightAreaSample> PointLight::sample_area(SamplerType&, const proto::Vec3f&) const {
     return std::make_optional(LightAreaSample {
         .pos       = pos_,
         .intensity = intensity_,
@@ -24,6 +31,11 @@ std::optional<LightAreaSample> PointLight::sample_area(Sampler&, const proto::Ve
 }
 
 std::optional<LightEmissionSample> PointLight::sample_emission(Sampler& sampler) const {
+    return sample_emission<Sampler>(sampler);
+}
+
+template <BuiltinSampler SamplerType>
+std::optional<LightEmissionSample> PointLight::sample_emission(SamplerType& sampler) const {
     auto [dir, pdf_dir] = proto::sample_uniform_sphere(sampler(), sampler());
     return std::make_optional(LightEmissionSample {
         .pos       = pos_,
@@ -43,6 +55,16 @@ float PointLight::pdf_from(const proto::Vec3f&, const proto::Vec2f&) const {
     return 1.0f;
 }
 
+LightBounds PointLight::bounds() const {
+    return LightBounds {
+        .bbox        = proto::BBoxf::empty().extend(pos_),
+        .axis        = proto::Vec3f(0, 0, 1),
+        .cos_theta_o = -1.0f,
+        .cos_theta_e = 0.0f,
+        .power       = 4.0f * std::numbers::pi_v<float> * intensity_.luminance()
+    };
+}
+
 proto::fnv::Hasher& PointLight::hash(proto::fnv::Hasher& hasher) const {
     return pos_.hash(intensity_.hash(hasher.combine(tag)));
 }
@@ -63,12 +85,18 @@ AreaLight<Shape>::AreaLight(const Shape& shape, const ColorTexture& intensity)
 
 template <typename Shape>
 std::optional<LightAreaSample> AreaLight<Shape>::sample_area(Sampler& sampler, const proto::Vec3f& from) const {
+    return sample_area<Sampler>(sampler, from);
+}
+
+template <typename Shape>
+template <BuiltinSampler SamplerType>
+std::optional<LightAreaSample> AreaLight<Shape>::sample_area(SamplerType& sampler, const proto::Vec3f& from) const {
     auto sample = shape_.sample(sampler, from);
     auto dir = proto::normalize(from - sample.pos);
     auto cos = proto::positive_dot(dir, sample.normal);
     return cos > 0 ? std::make_optional(LightAreaSample {
         .pos       = sample.pos,
-        .intensity = intensity_.sample_color(sample.surf_coords),
+        .intensity = dispatch::sample_color(intensity_, sample.surf_coords),
         .pdf_from  = sample.pdf_from,
         .pdf_area  = sample.pdf,
         .pdf_dir   = proto::cosine_hemisphere_pdf(cos),
@@ -78,13 +106,19 @@ std::optional<LightAreaSample> AreaLight<Shape>::sample_area(Sampler& sampler, c
 
 template <typename Shape>
 std::optional<LightEmissionSample> AreaLight<Shape>::sample_emission(Sampler& sampler) const {
+    return sample_emission<Sampler>(sampler);
+}
+
+template <typename Shape>
+template <BuiltinSampler SamplerType>
+std::optional<LightEmissionSample> AreaLight<Shape>::sample_emission(SamplerType& sampler) const {
     auto sample = shape_.sample(sampler);
     auto [dir, pdf_dir] = proto::sample_cosine_hemisphere(sampler(), sampler());
     auto cos = dir[2];
     return cos > 0 ? std::make_optional(LightEmissionSample {
         .pos       = sample.pos,
         .dir       = proto::ortho_basis(sample.normal) * dir,
-        .intensity = intensity_.sample_color(sample.surf_coords),
+        .intensity = dispatch::sample_color(intensity_, sample.surf_coords),
         .pdf_area  = sample.pdf,
         .pdf_dir   = pdf_dir,
         .cos       = cos
@@ -98,7 +132,7 @@ EmissionValue AreaLight<Shape>::emission(const proto::Vec3f& from, const proto::
     if (cos <= 0)
         return EmissionValue { Color::black(), 1.0f, 1.0f, 1.0f };
     return EmissionValue {
-        .intensity = intensity_.sample_color(uv),
+        .intensity = dispatch::sample_color(intensity_, uv),
         .pdf_from  = sample.pdf_from,
         .pdf_area  = sample.pdf,
         .pdf_dir   = proto::cosine_hemisphere_pdf(cos)
@@ -110,6 +144,36 @@ float AreaLight<Shape>::pdf_from(const proto::Vec3f& from, const proto::Vec2f& u
     return shape_.sample_at(uv, from).pdf_from;
 }
 
+static LightBounds shape_bounds(const UniformTriangle& triangle) {
+    return LightBounds {
+        .bbox        = triangle.shape.bbox(),
+        .axis        = triangle.normal,
+        .cos_theta_o = 1.0f,
+        .cos_theta_e = 0.0f,
+        .power       = 1.0f / triangle.inv_area
+    };
+}
+
+static LightBounds shape_bounds(const UniformSphere& sphere) {
+    return LightBounds {
+        .bbox        = proto::BBoxf(
+            sphere.shape.center - proto::Vec3f(sphere.shape.radius),
+            sphere.shape.center + proto::Vec3f(sphere.shape.radius)),
+        .axis        = proto::Vec3f(0, 0, 1),
+        .cos_theta_o = -1.0f,
+        .cos_theta_e = 0.0f,
+        .power       = 1.0f / sphere.inv_area
+    };
+}
+
+template <typename Shape>
+LightBounds AreaLight<Shape>::bounds() const {
+    // The power of a diffuse emitter is pi times its area times its (average) radiance
+    auto bounds = shape_bounds(shape_);
+    bounds.power *= std::numbers::pi_v<float> * intensity_.average_color().luminance();
+    return bounds;
+}
+
 template <typename Shape>
 proto::fnv::Hasher& AreaLight<Shape>::hash(proto::fnv::Hasher& hasher) const {
     return shape_.hash(hasher).combine(&intensity_);
@@ -126,4 +190,20 @@ bool AreaLight<Shape>::equals(const Light& other) const {
 template class AreaLight<UniformTriangle>;
 template class AreaLight<UniformSphere>;
 
+// The sampling functions are compiled for each of the built-in samplers (see `BuiltinSampler`).
+#define SOL_INSTANTIATE_LIGHT_SAMPLE(Class, SamplerType) \
+    template std::optional<LightAreaSample> Class::sample_area<SamplerType>(SamplerType&, const proto::Vec3f&) const; \
+    template std::optional<LightEmissionSample> Class::sample_emission<SamplerType>(SamplerType&) const;
+#define SOL_INSTANTIATE_LIGHTS_SAMPLE(SamplerType) \
+    SOL_INSTANTIATE_LIGHT_SAMPLE(PointLight, SamplerType) \
+    SOL_INSTANTIATE_LIGHT_SAMPLE(UniformTriangleLight, SamplerType) \
+    SOL_INSTANTIATE_LIGHT_SAMPLE(UniformSphereLight, SamplerType)
+
+SOL_INSTANTIATE_LIGHTS_SAMPLE(PcgSampler)
+SOL_INSTANTIATE_LIGHTS_SAMPLE(SobolSampler)
+SOL_INSTANTIATE_LIGHTS_SAMPLE(Pmj02Sampler)
+
+#undef SOL_INSTANTIATE_LIGHTS_SAMPLE
+#undef SOL_INSTANTIATE_LIGHT_SAMPLE
+
 } // namespace sol
@@ -0,0 +1,51 @@
+#include <fstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define SOL_ENABLE_MMAP
+#endif
+
+#include "mapped_file.h"
+
+namespace sol {
+
+#if defined(SOL_ENABLE_MMAP)
+MappedFile::MappedFile(const std::string& file_name) {
+    int fd = open(file_name.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        auto ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (ptr != MAP_FAILED) {
+            data_ = static_cast<const std::byte*>(ptr);
+            size_ = st.st_size;
+        }
+    }
+    // The mapping stays valid after the file descriptor is closed
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (data_)
+        munmap(const_cast<std::byte*>(data_), size_);
+}
+#else
+MappedFile::MappedFile(const std::string& file_name) {
+    std::ifstream is(file_name, std::ios::binary | std::ios::ate);
+    if (!is)
+        return;
+    size_ = is.tellg();
+    buffer_ = std::make_unique<std::byte[]>(size_);
+    is.seekg(0);
+    if (is.read(reinterpret_cast<char*>(buffer_.get()), size_))
+        data_ = buffer_.get();
+}
+
+MappedFile::~MappedFile() = default;
+#endif
+
+} // namespace sol
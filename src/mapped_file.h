@@ -0,0 +1,30 @@
+#ifndef SOL_MAPPED_FILE_H
+#define SOL_MAPPED_FILE_H
+
+#include <cstddef>
+#include <span>
+#include <string>
+#include <memory>
+
+namespace sol {
+
+/// Read-only view of the contents of a file. The file is memory-mapped when the platform supports it,
+/// and read into memory otherwise.
+class MappedFile {
+public:
+    MappedFile(const std::string& file_name);
+    MappedFile(const MappedFile&) = delete;
+    ~MappedFile();
+
+    bool is_open() const { return data_ != nullptr; }
+    std::span<const std::byte> data() const { return std::span(data_, size_); }
+
+private:
+    const std::byte* data_ = nullptr;
+    size_t size_ = 0;
+    std::unique_ptr<std::byte[]> buffer_;
+};
+
+} // namespace sol
+
+#endif
@@ -0,0 +1,246 @@
+#ifndef SOL_PARALLEL_REINSERTION_OPTIMIZER_H
+#define SOL_PARALLEL_REINSERTION_OPTIMIZER_H
+
+#include <array>
+#include <vector>
+#include <queue>
+#include <utility>
+#include <functional>
+#include <limits>
+#include <algorithm>
+#include <cstddef>
+#include <cmath>
+
+#include <proto/bbox.h>
+#include <par/for_each.h>
+
+namespace sol {
+
+/// Optimizes a binary BVH by removing nodes and re-inserting them where they reduce the SAH cost,
+/// following "Parallel Reinsertion for Bounding Volume Hierarchy Optimization", by D. Meister and J. Bittner.
+/// Each iteration searches the best insertion point for a batch of nodes in parallel, and then applies
+/// the non-conflicting reinsertions sequentially, which is cheap in comparison. Batches are taken from the
+/// nodes ranked by area, starting with the largest ones, and successive iterations sweep through the ranking.
+template <typename Bvh>
+class ParallelReinsertionOptimizer {
+public:
+    struct Config {
+        float batch_ratio = 0.05f;      ///< Fraction of the nodes to consider in each iteration
+        size_t max_sweeps = 2;          ///< Maximum number of passes over all the nodes
+    };
+
+    template <typename Executor>
+    static void optimize(Executor& executor, Bvh& bvh, const Config& config = {}) {
+        ParallelReinsertionOptimizer optimizer(bvh);
+        // Stop when a whole sweep did not change anything
+        auto sweep_length = static_cast<size_t>(std::ceil(1.0f / config.batch_ratio));
+        for (size_t i = 0, unchanged_count = 0; i < config.max_sweeps * sweep_length && unchanged_count < sweep_length; ++i)
+            unchanged_count = optimizer.optimize_once(executor, config.batch_ratio) ? 0 : unchanged_count + 1;
+    }
+
+private:
+    static constexpr size_t invalid_index = std::numeric_limits<size_t>::max();
+
+    struct Reinsertion {
+        size_t from;
+        size_t to;
+        float benefit;
+    };
+
+    ParallelReinsertionOptimizer(Bvh& bvh)
+        : bvh_(bvh), parents_(bvh.node_count, invalid_index)
+    {
+        for (size_t i = 0; i < bvh.node_count; ++i) {
+            if (!bvh.nodes[i].is_leaf()) {
+                parents_[bvh.nodes[i].first_index + 0] = i;
+                parents_[bvh.nodes[i].first_index + 1] = i;
+            }
+        }
+    }
+
+    template <typename Executor>
+    bool optimize_once(Executor& executor, float batch_ratio) {
+        // Select the candidates among the nodes ranked by decreasing area. The window of ranks moves
+        // after each iteration, so that all nodes are eventually considered. The root and its children cannot be moved.
+        std::vector<size_t> candidates;
+        for (size_t i = 0; i < bvh_.node_count; ++i) {
+            if (parents_[i] != invalid_index && parents_[i] != 0)
+                candidates.push_back(i);
+        }
+        if (candidates.empty())
+            return false;
+        auto batch_size = std::min(candidates.size(), std::max(size_t{1}, static_cast<size_t>(batch_ratio * bvh_.node_count)));
+        auto first_rank = first_rank_ < candidates.size() ? first_rank_ : 0;
+        batch_size = std::min(batch_size, candidates.size() - first_rank);
+        first_rank_ = first_rank + batch_size;
+
+        auto by_area = [&] (size_t i, size_t j) { return area(i) > area(j); };
+        std::nth_element(candidates.begin(), candidates.begin() + first_rank, candidates.end(), by_area);
+        std::nth_element(candidates.begin() + first_rank, candidates.begin() + first_rank + batch_size, candidates.end(), by_area);
+        candidates.erase(candidates.begin() + first_rank + batch_size, candidates.end());
+        candidates.erase(candidates.begin(), candidates.begin() + first_rank);
+
+        std::vector<Reinsertion> reinsertions(candidates.size());
+        par::for_each(executor, par::range_1d(size_t{0}, candidates.size()), [&] (size_t i) {
+            reinsertions[i] = find_reinsertion(candidates[i]);
+        });
+
+        std::sort(reinsertions.begin(), reinsertions.end(),
+            [] (const Reinsertion& a, const Reinsertion& b) { return a.benefit > b.benefit; });
+
+        // Apply reinsertions that do not touch the nodes modified by a previous one
+        std::vector<bool> locks(bvh_.node_count, false);
+        bool changed = false;
+        for (auto& reinsertion : reinsertions) {
+            if (reinsertion.benefit <= 0)
+                break;
+            auto nodes = touched_nodes(reinsertion);
+            if (std::any_of(nodes.begin(), nodes.end(), [&] (size_t j) { return j != invalid_index && locks[j]; }) ||
+                !is_still_valid(reinsertion))
+                continue;
+            for (auto j : nodes) {
+                if (j != invalid_index)
+                    locks[j] = true;
+            }
+            reinsert(reinsertion);
+            changed = true;
+        }
+        return changed;
+    }
+
+    Reinsertion find_reinsertion(size_t node_index) const {
+        auto parent_index = parents_[node_index];
+        auto sibling_index = sibling(node_index);
+        auto bbox = bvh_.nodes[node_index].bbox();
+        auto node_area = half_area(bbox);
+
+        // Area saved by removing the node: the parent disappears, and all ancestors are refit
+        auto removal_benefit = area(parent_index);
+        auto refit_bbox = proto::BBoxf(bvh_.nodes[sibling_index].bbox());
+        for (auto child = parent_index, i = parents_[parent_index]; i != invalid_index; child = i, i = parents_[i]) {
+            refit_bbox.extend(bvh_.nodes[sibling(child)].bbox());
+            removal_benefit += area(i) - half_area(refit_bbox);
+        }
+
+        // Branch-and-bound search for the best insertion point
+        Reinsertion best { node_index, invalid_index, 0.0f };
+        using Candidate = std::pair<float, size_t>; // Induced cost, node index
+        std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> queue;
+        queue.emplace(0.0f, 0);
+        while (!queue.empty()) {
+            auto [induced_cost, target_index] = queue.top();
+            queue.pop();
+            if (induced_cost + node_area >= removal_benefit - best.benefit)
+                break;
+
+            auto& target = bvh_.nodes[target_index];
+            auto merged_area = half_area(proto::BBoxf(target.bbox()).extend(bbox));
+            auto cost = induced_cost + merged_area;
+            if (target_index != parent_index && target_index != sibling_index && removal_benefit - cost > best.benefit) {
+                best.to = target_index;
+                best.benefit = removal_benefit - cost;
+            }
+
+            if (!target.is_leaf()) {
+                auto child_cost = cost - area(target_index);
+                for (size_t i = 0; i < 2; ++i) {
+                    auto child_index = target.first_index + i;
+                    if (child_index != node_index)
+                        queue.emplace(child_cost, child_index);
+                }
+            }
+        }
+        return best;
+    }
+
+    std::array<size_t, 6> touched_nodes(const Reinsertion& reinsertion) const {
+        auto parent_index = parents_[reinsertion.from];
+        return std::array<size_t, 6> {
+            reinsertion.from,
+            sibling(reinsertion.from),
+            parent_index,
+            parents_[parent_index],
+            reinsertion.to,
+            parents_[reinsertion.to]
+        };
+    }
+
+    // Previous reinsertions in the same batch may have moved the target below the node, or next to it
+    bool is_still_valid(const Reinsertion& reinsertion) const {
+        auto parent_index = parents_[reinsertion.from];
+        if (parent_index == invalid_index ||
+            reinsertion.to == parent_index ||
+            reinsertion.to == sibling(reinsertion.from))
+            return false;
+        for (auto i = reinsertion.to; i != invalid_index; i = parents_[i]) {
+            if (i == reinsertion.from)
+                return false;
+        }
+        return true;
+    }
+
+    void reinsert(const Reinsertion& reinsertion) {
+        auto node_index = reinsertion.from;
+        auto parent_index = parents_[node_index];
+        auto sibling_index = sibling(node_index);
+        auto target_index = reinsertion.to;
+        auto free_index = bvh_.nodes[parent_index].first_index;
+
+        // Remove the node: its sibling takes the place of its parent, which frees the pair of slots that
+        // contained the node and its sibling.
+        auto node = bvh_.nodes[node_index];
+        move_node(sibling_index, parent_index);
+        refit_from(parents_[parent_index]);
+
+        // Insert the node next to the target, using the free pair of slots for the node and the target
+        move_node(target_index, free_index + 0);
+        bvh_.nodes[free_index + 1] = node;
+        set_children_parent(free_index + 1);
+        auto& target = bvh_.nodes[target_index];
+        target.first_index = free_index;
+        target.prim_count = 0;
+        parents_[free_index + 0] = target_index;
+        parents_[free_index + 1] = target_index;
+        refit_from(target_index);
+    }
+
+    void move_node(size_t from, size_t to) {
+        bvh_.nodes[to] = bvh_.nodes[from];
+        set_children_parent(to);
+    }
+
+    void set_children_parent(size_t node_index) {
+        auto& node = bvh_.nodes[node_index];
+        if (!node.is_leaf()) {
+            parents_[node.first_index + 0] = node_index;
+            parents_[node.first_index + 1] = node_index;
+        }
+    }
+
+    void refit_from(size_t node_index) {
+        for (auto i = node_index; i != invalid_index; i = parents_[i]) {
+            auto& node = bvh_.nodes[i];
+            node.set_bbox(proto::BBoxf(bvh_.nodes[node.first_index].bbox()).extend(bvh_.nodes[node.first_index + 1].bbox()));
+        }
+    }
+
+    size_t sibling(size_t node_index) const {
+        auto first_index = bvh_.nodes[parents_[node_index]].first_index;
+        return node_index == first_index ? first_index + 1 : first_index;
+    }
+
+    float area(size_t node_index) const { return half_area(bvh_.nodes[node_index].bbox()); }
+
+    static float half_area(const proto::BBoxf& bbox) {
+        auto e = bbox.max - bbox.min;
+        return e[0] * (e[1] + e[2]) + e[1] * e[2];
+    }
+
+    Bvh& bvh_;
+    std::vector<size_t> parents_;
+    size_t first_rank_ = 0;
+};
+
+} // namespace sol
+
+#endif
@@ -0,0 +1,211 @@
+#include <algorithm>
+#include <atomic>
+#include <numbers>
+#include <limits>
+#include <cmath>
+
+#include "sol/path_guiding.h"
+
+namespace sol {
+
+static constexpr float one_minus_epsilon = 0x1.fffffep-1f;
+
+// Cylindrical equal-area mapping between directions and the unit square
+static proto::Vec2f dir_to_square(const proto::Vec3f& dir) {
+    auto cos_theta = std::clamp(dir[2], -1.0f, 1.0f);
+    auto phi = std::atan2(dir[1], dir[0]);
+    if (phi < 0)
+        phi += 2.0f * std::numbers::pi_v<float>;
+    return proto::Vec2f(
+        std::min((cos_theta + 1.0f) * 0.5f, one_minus_epsilon),
+        std::min(phi * (0.5f * std::numbers::inv_pi_v<float>), one_minus_epsilon));
+}
+
+static proto::Vec3f square_to_dir(const proto::Vec2f& p) {
+    auto cos_theta = 2.0f * p[0] - 1.0f;
+    auto sin_theta = std::sqrt(std::max(0.0f, 1.0f - cos_theta * cos_theta));
+    auto phi = 2.0f * std::numbers::pi_v<float> * p[1];
+    return proto::Vec3f(sin_theta * std::cos(phi), sin_theta * std::sin(phi), cos_theta);
+}
+
+// The mapping preserves areas, and the area of the sphere is 4 pi
+static constexpr float square_to_sphere_pdf = 0.25f * std::numbers::inv_pi_v<float>;
+
+// Directional tree ----------------------------------------------------------------
+
+std::pair<proto::Vec2f, float> PathGuiding::DirectionalTree::sample(float u, float v) const {
+    auto origin = proto::Vec2f(0);
+    auto size = 1.0f;
+    auto pdf = 1.0f;
+    for (uint32_t index = 0;;) {
+        auto& node = nodes_[index];
+        auto total = node.total();
+        if (total <= 0)
+            break;
+
+        // Pick the column first, then the quadrant within that column, reusing the random numbers
+        auto left = (node.energy[0] + node.energy[2]) / total;
+        uint32_t x = u < left ? 0 : 1;
+        u = std::min(x == 0 ? u / left : (u - left) / (1.0f - left), one_minus_epsilon);
+        auto column = node.energy[x] + node.energy[x + 2];
+        auto bottom = column > 0 ? node.energy[x] / column : 0.5f;
+        uint32_t y = v < bottom ? 0 : 1;
+        v = std::min(y == 0 ? v / bottom : (v - bottom) / (1.0f - bottom), one_minus_epsilon);
+
+        auto quadrant = x + 2 * y;
+        pdf *= 4.0f * node.energy[quadrant] / total;
+        size *= 0.5f;
+        origin += proto::Vec2f(x * size, y * size);
+        if (!node.children[quadrant])
+            break;
+        index = node.children[quadrant];
+    }
+    return std::pair { origin + proto::Vec2f(u * size, v * size), pdf };
+}
+
+float PathGuiding::DirectionalTree::pdf(proto::Vec2f p) const {
+    auto pdf = 1.0f;
+    for (uint32_t index = 0;;) {
+        auto& node = nodes_[index];
+        auto total = node.total();
+        if (total <= 0)
+            return pdf;
+        uint32_t x = p[0] < 0.5f ? 0 : 1;
+        uint32_t y = p[1] < 0.5f ? 0 : 1;
+        auto quadrant = x + 2 * y;
+        pdf *= 4.0f * node.energy[quadrant] / total;
+        if (!node.children[quadrant])
+            return pdf;
+        p = proto::Vec2f(p[0] * 2.0f - x, p[1] * 2.0f - y);
+        index = node.children[quadrant];
+    }
+}
+
+void PathGuiding::DirectionalTree::record(proto::Vec2f p, float value) {
+    // The energy is added to every level, so that inner nodes always contain the sum of the energy of their children
+    for (uint32_t index = 0;;) {
+        uint32_t x = p[0] < 0.5f ? 0 : 1;
+        uint32_t y = p[1] < 0.5f ? 0 : 1;
+        auto quadrant = x + 2 * y;
+        auto& node = nodes_[index];
+        std::atomic_ref<float>(node.energy[quadrant]).fetch_add(value, std::memory_order_relaxed);
+        if (!node.children[quadrant])
+            return;
+        p = proto::Vec2f(p[0] * 2.0f - x, p[1] * 2.0f - y);
+        index = node.children[quadrant];
+    }
+}
+
+PathGuiding::DirectionalTree PathGuiding::DirectionalTree::refine(float threshold, size_t max_depth) const {
+    struct StackElem {
+        uint32_t old_index;     ///< Corresponding node in this tree, if any (0 otherwise)
+        uint32_t new_index;
+        float energy;           ///< Energy of the node, when it has no corresponding node in this tree
+        size_t depth;
+    };
+
+    DirectionalTree tree;
+    auto total = nodes_[0].total();
+    if (total <= 0)
+        return tree;
+
+    // Quadrants that do not exist in this tree are assumed to have uniformly distributed energy
+    std::vector<StackElem> stack { StackElem { 0, 0, total, 1 } };
+    while (!stack.empty()) {
+        auto elem = stack.back();
+        stack.pop_back();
+        if (elem.depth >= max_depth)
+            continue;
+
+        auto is_new = elem.new_index != 0 && elem.old_index == 0;
+        for (uint32_t quadrant = 0; quadrant < 4; ++quadrant) {
+            auto energy = is_new ? elem.energy * 0.25f : nodes_[elem.old_index].energy[quadrant];
+            if (energy <= threshold * total)
+                continue;
+            auto child_index = static_cast<uint32_t>(tree.nodes_.size());
+            tree.nodes_.emplace_back();
+            tree.nodes_[elem.new_index].children[quadrant] = child_index;
+            stack.push_back(StackElem {
+                is_new ? 0 : nodes_[elem.old_index].children[quadrant],
+                child_index, energy, elem.depth + 1
+            });
+        }
+    }
+    return tree;
+}
+
+// Spatial tree --------------------------------------------------------------------
+
+void PathGuiding::reset(const proto::BBoxf& bbox) {
+    bbox_min_ = bbox.min;
+    for (size_t i = 0; i < 3; ++i)
+        inv_extent_[i] = 1.0f / std::max(bbox.max[i] - bbox.min[i], std::numeric_limits<float>::min());
+    nodes_.assign(1, SpatialNode { 0, 0, true });
+    leaves_.assign(1, Leaf {});
+    can_sample_ = false;
+}
+
+void PathGuiding::split_leaves() {
+    // Children are added at the end of the array, and are split again if they still contain too many samples
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+        if (!nodes_[i].is_leaf)
+            continue;
+        auto leaf_index = nodes_[i].first_child_or_leaf;
+        if (leaves_[leaf_index].sample_count <= config_.spatial_threshold)
+            continue;
+
+        // Both halves keep the distribution of the parent, and are assumed to have received half of its samples
+        leaves_[leaf_index].sample_count /= 2;
+        auto new_leaf_index = static_cast<uint32_t>(leaves_.size());
+        leaves_.push_back(Leaf(leaves_[leaf_index]));
+
+        auto first_child = static_cast<uint32_t>(nodes_.size());
+        auto axis = nodes_[i].axis;
+        auto child_axis = (axis + 1) % 3;
+        nodes_.push_back(SpatialNode { leaf_index, child_axis, true });
+        nodes_.push_back(SpatialNode { new_leaf_index, child_axis, true });
+        nodes_[i] = SpatialNode { first_child, axis, false };
+    }
+}
+
+void PathGuiding::refine_leaf(size_t i) {
+    auto& leaf = leaves_[i];
+    leaf.sampling = std::move(leaf.recording);
+    leaf.recording = leaf.sampling.refine(config_.directional_threshold, config_.max_directional_depth);
+    leaf.sample_count = 0;
+}
+
+size_t PathGuiding::find_leaf(const proto::Vec3f& point) const {
+    float p[3];
+    for (size_t i = 0; i < 3; ++i)
+        p[i] = std::clamp((point[i] - bbox_min_[i]) * inv_extent_[i], 0.0f, 1.0f);
+    uint32_t index = 0;
+    while (!nodes_[index].is_leaf) {
+        auto& node = nodes_[index];
+        auto& x = p[node.axis];
+        x *= 2.0f;
+        index = node.first_child_or_leaf;
+        if (x >= 1.0f) {
+            x -= 1.0f;
+            index++;
+        }
+    }
+    return nodes_[index].first_child_or_leaf;
+}
+
+std::pair<proto::Vec3f, float> PathGuiding::sample(const proto::Vec3f& point, float u, float v) const {
+    auto [p, pdf] = leaves_[find_leaf(point)].sampling.sample(u, v);
+    return std::pair { square_to_dir(p), pdf * square_to_sphere_pdf };
+}
+
+float PathGuiding::pdf(const proto::Vec3f& point, const proto::Vec3f& dir) const {
+    return leaves_[find_leaf(point)].sampling.pdf(dir_to_square(dir)) * square_to_sphere_pdf;
+}
+
+void PathGuiding::record(const proto::Vec3f& point, const proto::Vec3f& dir, float radiance) {
+    auto& leaf = leaves_[find_leaf(point)];
+    leaf.recording.record(dir_to_square(dir), radiance);
+    std::atomic_ref<uint32_t>(leaf.sample_count).fetch_add(1, std::memory_order_relaxed);
+}
+
+} // namespace sol
@@ -0,0 +1,206 @@
+#ifndef SOL_QUANTIZED_BVH_H
+#define SOL_QUANTIZED_BVH_H
+
+#include <array>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+#include <type_traits>
+#include <stdexcept>
+
+#include <proto/vec.h>
+#include <proto/ray.h>
+
+#include "wide_bvh.h"
+
+namespace sol {
+
+/// Compressed version of a `WideBvh`. The bounding boxes of the children of a node are quantized to 8 bits
+/// per component, relative to the bounding box of the node itself. Quantized boxes always enclose
+/// the original ones, which means that traversal finds the same intersections as with the uncompressed BVH.
+template <size_t Arity>
+struct QuantizedBvh {
+    static constexpr size_t arity = Arity;
+
+    struct Node {
+        std::array<float, 3> origin;            ///< Minimum corner of the node
+        std::array<int8_t, 3> exponent;         ///< Scale of the quantization grid, in powers of two
+        std::array<uint8_t, Arity> qmin[3];
+        std::array<uint8_t, Arity> qmax[3];
+        std::array<uint32_t, Arity> first_index; ///< Index of the child node, or of the first primitive for leaves
+        std::array<uint16_t, Arity> prim_count;  ///< Number of primitives for leaves, 0 for inner nodes
+
+        // Empty child slots have an inverted bounding box (see `quantize()`)
+        bool is_empty(size_t i) const { return qmin[0][i] > qmax[0][i]; }
+        bool is_leaf(size_t i) const { return prim_count[i] != 0; }
+    };
+
+    std::vector<Node> nodes;
+    size_t depth = 0;   ///< Number of levels of inner nodes, which bounds the size of the traversal stack
+
+    /// Returns true if the primitive counts of the leaves of the given wide BVH fit in a compressed node.
+    static bool can_compress(const WideBvh<Arity>& wide_bvh) {
+        for (auto& node : wide_bvh.nodes) {
+            for (size_t i = 0; i < Arity; ++i) {
+                if (node.prim_count[i] > std::numeric_limits<uint16_t>::max())
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    /// Compresses a wide BVH. The BVH must be compressible (see `can_compress()`).
+    static QuantizedBvh compress(const WideBvh<Arity>& wide_bvh) {
+        if (!can_compress(wide_bvh))
+            throw std::runtime_error("BVH leaves are too large to be compressed");
+        QuantizedBvh quantized_bvh;
+        quantized_bvh.nodes.resize(wide_bvh.nodes.size());
+        for (size_t i = 0; i < wide_bvh.nodes.size(); ++i)
+            quantized_bvh.nodes[i] = quantize(wide_bvh.nodes[i]);
+        quantized_bvh.depth = wide_bvh.depth;
+        return quantized_bvh;
+    }
+
+    /// Recomputes the depth of the BVH from its nodes. See `WideBvh::update_depth()`.
+    void update_depth() {
+        std::vector<size_t> depths(nodes.size(), 1);
+        for (size_t i = nodes.size(); i-- > 0;) {
+            for (size_t j = 0; j < Arity; ++j) {
+                if (nodes[i].is_empty(j) || nodes[i].is_leaf(j))
+                    continue;
+                auto child_index = nodes[i].first_index[j];
+                if (child_index <= i || child_index >= nodes.size())
+                    throw std::runtime_error("Invalid child index in BVH node");
+                depths[i] = std::max(depths[i], depths[child_index] + 1);
+            }
+        }
+        depth = nodes.empty() ? 0 : depths[0];
+    }
+
+    /// Intersects the BVH with a ray. See `WideBvh::traverse()`.
+    template <bool IsAnyHit, typename LeafFn>
+    auto traverse(proto::Rayf& ray, LeafFn&& leaf_fn) const {
+        using Result = std::invoke_result_t<LeafFn, proto::Rayf&, size_t, size_t>;
+        Result result {};
+
+        std::array<float, 3> org, inv_dir;
+        for (int i = 0; i < 3; ++i) {
+            org[i] = ray.org[i];
+            inv_dir[i] = 1.0f / ray.dir[i];
+        }
+
+        struct StackElem { uint32_t first_index, prim_count; float entry; };
+        TraversalStack<StackElem> stack((Arity - 1) * depth + 1);
+        stack.push(StackElem { 0, 0, ray.tmin });
+
+        while (!stack.is_empty()) {
+            auto elem = stack.pop();
+            if (elem.entry > ray.tmax)
+                continue;
+
+            if (elem.prim_count != 0) {
+                auto leaf_result = leaf_fn(ray, elem.first_index, elem.first_index + elem.prim_count);
+                if constexpr (IsAnyHit) {
+                    if (leaf_result)
+                        return leaf_result;
+                } else if (leaf_result)
+                    result = leaf_result;
+                continue;
+            }
+
+            auto& node = nodes[elem.first_index];
+            std::array<float, 3> scale;
+            for (int i = 0; i < 3; ++i)
+                scale[i] = std::ldexp(1.0f, node.exponent[i]);
+
+            std::array<float, Arity> entry;
+            std::array<bool, Arity> hit;
+            // This loop is written so that the compiler can vectorize it
+            for (size_t i = 0; i < Arity; ++i) {
+                auto tx0 = (dequantize(node.origin[0], scale[0], node.qmin[0][i]) - org[0]) * inv_dir[0];
+                auto tx1 = (dequantize(node.origin[0], scale[0], node.qmax[0][i]) - org[0]) * inv_dir[0];
+                auto ty0 = (dequantize(node.origin[1], scale[1], node.qmin[1][i]) - org[1]) * inv_dir[1];
+                auto ty1 = (dequantize(node.origin[1], scale[1], node.qmax[1][i]) - org[1]) * inv_dir[1];
+                auto tz0 = (dequantize(node.origin[2], scale[2], node.qmin[2][i]) - org[2]) * inv_dir[2];
+                auto tz1 = (dequantize(node.origin[2], scale[2], node.qmax[2][i]) - org[2]) * inv_dir[2];
+                auto t0 = std::max(std::max(std::min(tx0, tx1), std::min(ty0, ty1)), std::max(std::min(tz0, tz1), ray.tmin));
+                auto t1 = std::min(std::min(std::max(tx0, tx1), std::max(ty0, ty1)), std::min(std::max(tz0, tz1), ray.tmax));
+                entry[i] = t0;
+                hit[i] = t0 <= t1 && node.qmin[0][i] <= node.qmax[0][i];
+            }
+
+            auto first_pushed = stack.size();
+            for (size_t i = 0; i < Arity; ++i) {
+                if (hit[i])
+                    stack.push(StackElem { node.first_index[i], node.prim_count[i], entry[i] });
+            }
+
+            std::sort(stack.begin() + first_pushed, stack.end(),
+                [] (const StackElem& a, const StackElem& b) { return a.entry > b.entry; });
+        }
+        return result;
+    }
+
+private:
+    static float dequantize(float origin, float scale, uint8_t q) {
+        return origin + static_cast<float>(q) * scale;
+    }
+
+    static Node quantize(const typename WideBvh<Arity>::Node& wide_node) {
+        static constexpr int max_q = std::numeric_limits<uint8_t>::max();
+
+        Node node;
+        for (int j = 0; j < 3; ++j) {
+            auto min = +std::numeric_limits<float>::max();
+            auto max = -std::numeric_limits<float>::max();
+            for (size_t i = 0; i < Arity; ++i) {
+                if (wide_node.is_empty(i))
+                    continue;
+                min = std::min(min, wide_node.min[j][i]);
+                max = std::max(max, wide_node.max[j][i]);
+            }
+
+            // Choose the smallest power of two such that the grid covers the whole node
+            auto extent = max - min;
+            int exponent = extent > 0
+                ? static_cast<int>(std::ceil(std::log2(extent / static_cast<float>(max_q))))
+                : std::numeric_limits<int8_t>::min();
+            exponent = std::clamp<int>(exponent, std::numeric_limits<int8_t>::min(), std::numeric_limits<int8_t>::max());
+            while (exponent < std::numeric_limits<int8_t>::max() && dequantize(min, std::ldexp(1.0f, exponent), max_q) < max)
+                exponent++;
+
+            node.origin[j] = min;
+            node.exponent[j] = exponent;
+            auto scale = std::ldexp(1.0f, exponent);
+            for (size_t i = 0; i < Arity; ++i) {
+                if (wide_node.is_empty(i)) {
+                    node.qmin[j][i] = max_q;
+                    node.qmax[j][i] = 0;
+                    continue;
+                }
+
+                // Round outwards, and fix the result in case floating-point rounding made the box too small
+                int qmin = std::clamp<int>(std::floor((wide_node.min[j][i] - min) / scale), 0, max_q);
+                int qmax = std::clamp<int>(std::ceil ((wide_node.max[j][i] - min) / scale), 0, max_q);
+                while (qmin > 0 && dequantize(min, scale, qmin) > wide_node.min[j][i])
+                    qmin--;
+                while (qmax < max_q && dequantize(min, scale, qmax) < wide_node.max[j][i])
+                    qmax++;
+                node.qmin[j][i] = qmin;
+                node.qmax[j][i] = qmax;
+            }
+        }
+
+        for (size_t i = 0; i < Arity; ++i) {
+            node.first_index[i] = wide_node.first_index[i];
+            node.prim_count[i] = wide_node.prim_count[i];
+        }
+        return node;
+    }
+};
+
+} // namespace sol
+
+#endif
@@ -1,4 +1,6 @@
 #include <chrono>
+#include <algorithm>
+#include <cmath>
 
 #include "sol/render_job.h"
 #include "sol/scene.h"
@@ -13,23 +15,50 @@ RenderJob::RenderJob(const Renderer& renderer, Image& output)
 
 RenderJob::RenderJob(RenderJob&& other)
     : sample_count(other.sample_count)
-    , samples_per_frame(other.samples_per_frame)
+    , samples_per_frame(other.samples_per_frame.load())
+    , frame_pacing(other.frame_pacing)
+    , target_frame_ms(other.target_frame_ms)
     , renderer(other.renderer)
     , output(other.output)
 {}
 
-RenderJob::~RenderJob() = default;
+RenderJob::~RenderJob() {
+    cancel();
+    wait();
+}
 
 void RenderJob::start(std::function<bool (const RenderJob&)>&& frame_end) {
+    output.clear();
     is_done_ = false;
-    render_thread_ = std::thread([&] {
-        for (size_t i = 0; sample_count == 0 || i < sample_count; i += samples_per_frame) {
-            size_t j = i + samples_per_frame;
-            if (i + j > sample_count && sample_count != 0)
-                j = sample_count - i;
-
-            renderer.render(output, i, j);
-            if ((frame_end && !frame_end(*this)) || is_done_)
+    rendered_sample_count_ = 0;
+    is_converged_ = false;
+    frame_sample_count_ = 0;
+    control_.reset();
+    ms_per_sample_ = 0;
+    best_throughput_ = 0;
+    best_samples_per_frame_ = 0;
+    is_throughput_tuned_ = false;
+    render_thread_ = std::thread([this, frame_end = std::move(frame_end)] {
+        for (size_t i = 0; sample_count == 0 || i < sample_count;) {
+            size_t j = std::max(samples_per_frame.load(), size_t{1});
+            if (sample_count != 0)
+                j = std::min(j, sample_count - i);
+
+            frame_sample_count_ = j;
+            auto frame_start = std::chrono::steady_clock::now();
+            renderer.render(output, i, j, &control_);
+            auto frame_stop = std::chrono::steady_clock::now();
+            if (control_.is_cancelled())
+                break;
+
+            // The progress of the frame is cleared first, so that `progress()` never counts the frame twice
+            control_.set_total_work(0);
+            i += j;
+            rendered_sample_count_ = i;
+            frame_ms_ = std::chrono::duration<double, std::milli>(frame_stop - frame_start).count();
+            is_converged_ = renderer.is_converged();
+            adjust_samples_per_frame();
+            if ((frame_end && !frame_end(*this)) || is_done_ || is_converged_)
                 break;
         }
 
@@ -39,8 +68,43 @@ void RenderJob::start(std::function<bool (const RenderJob&)>&& frame_end) {
     });
 }
 
+void RenderJob::adjust_samples_per_frame() {
+    size_t count = frame_sample_count_;
+    double ms = std::max(double{frame_ms_}, 1.0e-3);
+    switch (frame_pacing) {
+        case FramePacing::Latency: {
+            // The time per sample is smoothed to avoid oscillations caused by noisy measurements.
+            // Frames may shrink immediately, but only grow by a factor of two at a time.
+            auto ms_per_sample = ms / static_cast<double>(count);
+            ms_per_sample_ = ms_per_sample_ > 0 ? (ms_per_sample_ + ms_per_sample) * 0.5 : ms_per_sample;
+            auto target = std::round(static_cast<double>(target_frame_ms) / ms_per_sample_);
+            samples_per_frame = std::clamp(static_cast<size_t>(target), size_t{1}, 2 * count);
+            break;
+        }
+        case FramePacing::Throughput: {
+            // Double the number of samples until the throughput does not increase significantly anymore,
+            // and then keep the best value found so far.
+            if (is_throughput_tuned_)
+                break;
+            auto throughput = static_cast<double>(count) / ms;
+            if (throughput > best_throughput_ * 1.05) {
+                best_throughput_ = throughput;
+                best_samples_per_frame_ = count;
+                samples_per_frame = 2 * count;
+            } else {
+                samples_per_frame = std::max(best_samples_per_frame_, size_t{1});
+                is_throughput_tuned_ = true;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
 bool RenderJob::wait(size_t timeout_ms) {
-    if (is_done_ || !render_thread_.joinable())
+    // Even when the job is done (e.g. cancelled), the thread may still be finishing its last tiles
+    if (!render_thread_.joinable())
         return true;
     std::unique_lock<std::mutex> lock(mutex_);
     if (timeout_ms != 0) {
@@ -50,12 +114,22 @@ bool RenderJob::wait(size_t timeout_ms) {
             return false;
     } else
         done_cond_.wait(lock, [&] { return is_done_; });
+    // The render thread needs the lock to finish
+    lock.unlock();
     render_thread_.join();
     return true;
 }
 
 void RenderJob::cancel() {
     is_done_ = true;
+    control_.cancel();
+}
+
+float RenderJob::progress() const {
+    if (sample_count == 0)
+        return control_.progress();
+    auto samples = static_cast<float>(rendered_sample_count_) + control_.progress() * static_cast<float>(frame_sample_count_);
+    return std::min(samples / static_cast<float>(sample_count), 1.0f);
 }
 
 } // namespace sol
@@ -4,6 +4,7 @@
 #include "sol/cameras.h"
 #include "sol/textures.h"
 #include "sol/geometry.h"
+#include "sol/light_sampler.h"
 
 namespace sol {
 
@@ -11,4 +12,16 @@ Scene::Scene() = default;
 Scene::~Scene() = default;
 Scene::Scene(Scene&&) = default;
 
+void Scene::finalize(LightSamplerType light_sampler_type) {
+    std::vector<const Light*> light_ptrs;
+    light_ptrs.reserve(lights.size());
+    for (auto& light : lights)
+        light_ptrs.push_back(light.get());
+    switch (light_sampler_type) {
+        case LightSamplerType::Uniform: light_sampler = std::make_unique<UniformLightSampler>(light_ptrs); break;
+        case LightSamplerType::Power:   light_sampler = std::make_unique<PowerLightSampler>(light_ptrs);   break;
+        default:                        light_sampler = std::make_unique<LightTree>(light_ptrs);           break;
+    }
+}
+
 } // namespace sol
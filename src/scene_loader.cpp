@@ -1,4 +1,5 @@
 #include <filesystem>
+#include <unordered_set>
 #include <system_error>
 
 #include "scene_loader.h"
@@ -62,6 +63,13 @@ void SceneLoader::load_and_throw_on_error(const std::string& file_name) {
     if (!geoms_.contains(root_name))
         throw std::runtime_error("Root geometry named '" + root_name + "' cannot be found");
     scene_.root = std::move(geoms_[root_name]);
+    geoms_.erase(root_name);
+    remove_unreachable_lights();
+
+    // Other geometric objects may be instanced by the root, and must live as long as the scene
+    for (auto& [_, geom] : geoms_)
+        scene_.geometries.push_back(std::move(geom));
+    geoms_.clear();
 }
 
 const Image* SceneLoader::load_image(const std::string& file_name) {
@@ -77,9 +85,49 @@ const Image* SceneLoader::load_image(const std::string& file_name) {
     return nullptr;
 }
 
-void SceneLoader::insert_geom(const std::string& name, std::unique_ptr<Geometry>&& geom) {
+void SceneLoader::insert_geom(const std::string& name, std::unique_ptr<Geometry>&& geom, std::vector<const Light*>&& lights) {
+    auto geom_ptr = geom.get();
     if (!geoms_.emplace(name, std::move(geom)).second)
         throw std::runtime_error("Duplicate geometry found with name '" + name + "'");
+    geom_lights_.emplace(geom_ptr, std::move(lights));
+}
+
+void SceneLoader::remove_unreachable_lights() {
+    // The lights of objects that are only instanced are in the local coordinate system of these objects.
+    // They, and the lights of objects that are not used by the root, must not be sampled.
+    auto& root_lights = geom_lights_[scene_.root.get()];
+    std::unordered_set<const Light*> reachable(root_lights.begin(), root_lights.end());
+    std::unordered_set<const Light*> unreachable;
+    for (auto& [_, lights] : geom_lights_) {
+        for (auto light : lights) {
+            if (!reachable.contains(light))
+                unreachable.insert(light);
+        }
+    }
+    for (auto light : unreachable)
+        lights_.erase(light);
+    std::erase_if(scene_.lights, [&] (auto& light) { return unreachable.contains(light.get()); });
+    geom_lights_.clear();
+}
+
+const Light* SceneLoader::transform_light(const Light& light, const AffineTransform& transform) {
+    switch (light.tag) {
+        case Light::Tag::PointLight: {
+            auto& point_light = static_cast<const PointLight&>(light);
+            return get_or_insert_light<PointLight>(transform.apply_point(point_light.pos()), point_light.intensity());
+        }
+        case Light::Tag::UniformTriangleLight: {
+            auto& triangle_light = static_cast<const UniformTriangleLight&>(light);
+            auto& triangle = triangle_light.shape().shape;
+            return get_or_insert_light<UniformTriangleLight>(proto::Trianglef(
+                transform.apply_point(triangle.v0),
+                transform.apply_point(triangle.v1),
+                transform.apply_point(triangle.v2)), triangle_light.intensity());
+        }
+        default:
+            // Other lights may not keep their shape under an affine transformation
+            return nullptr;
+    }
 }
 
 std::unique_ptr<Camera> SceneLoader::create_camera(const toml::table& table) {
@@ -100,17 +148,107 @@ void SceneLoader::create_geom(const toml::table& table, const std::string& base_
     auto type = table["type"].value_or<std::string>("");
     if (type == "import") {
         auto file = table["file"].value_or<std::string>("");
-        if (file.ends_with(".obj"))
-            return insert_geom(name, obj::load(*this, base_dir + "/" + file));
+        if (file.ends_with(".obj")) {
+            auto mesh = obj::load(*this, base_dir + "/" + file, parse_mesh_config(table), table["cache"].value_or(false));
+            auto lights = mesh->lights();
+            return insert_geom(name, std::move(mesh), std::move(lights));
+        }
         throw SourceError::from_toml(table.source(), "Unknown file format for '" + file + "'");
     }
+    if (type == "instances") {
+        std::vector<InstanceGroup::Instance> instances;
+        std::vector<const Light*> lights;
+        if (auto array = table["instances"].as_array()) {
+            for (auto& elem : *array) {
+                if (auto instance = elem.as_table()) {
+                    instances.push_back(parse_instance(*instance));
+                    for (auto [_, light] : instances.back().lights)
+                        lights.push_back(light);
+                }
+            }
+        }
+        return insert_geom(name, std::make_unique<InstanceGroup>(std::move(instances)), std::move(lights));
+    }
     throw SourceError::from_toml(table.source(), "Unknown node type '" + type + "'");
 }
 
+InstanceGroup::Instance SceneLoader::parse_instance(const toml::table& table) {
+    auto object = table["object"].value_or<std::string>("");
+    auto it = geoms_.find(object);
+    if (it == geoms_.end())
+        throw SourceError::from_toml(table.source(), "Unknown object '" + object + "' (objects must be defined before being instanced)");
+
+    auto transform = AffineTransform::identity();
+    if (auto matrix = table["matrix"].as_array()) {
+        // Row-major 3x4 matrix, where the last column is the translation
+        if (matrix->size() != 12)
+            throw SourceError::from_toml(table.source(), "Invalid instance matrix (expected 12 elements)");
+        std::array<float, 12> m;
+        for (size_t i = 0; i < 12; ++i)
+            m[i] = (*matrix)[i].value_or(0.0f);
+        transform = AffineTransform({
+            proto::Vec3f(m[0], m[1], m[2]),
+            proto::Vec3f(m[4], m[5], m[6]),
+            proto::Vec3f(m[8], m[9], m[10])
+        }, proto::Vec3f(m[3], m[7], m[11]));
+    } else {
+        // Scale first, then rotate, then translate
+        auto uniform_scale = table["scale"].value_or(1.0f);
+        auto scale = parse_vec3(table["scale"], proto::Vec3f(uniform_scale, uniform_scale, uniform_scale));
+        auto rotate    = parse_vec3(table["rotate"], proto::Vec3f(0, 0, 0));
+        auto translate = parse_vec3(table["translate"], proto::Vec3f(0, 0, 0));
+        transform =
+            AffineTransform::translate(translate) *
+            AffineTransform::rotate(rotate) *
+            AffineTransform::scale(scale);
+    }
+    if (!transform.is_invertible())
+        throw SourceError::from_toml(table.source(), "Instance transformation of '" + object + "' is not invertible");
+
+    // Each instance places its own copy of the lights of the instanced object.
+    // Mirroring would flip the side from which transformed triangle lights emit.
+    InstanceGroup::LightMap lights;
+    auto& object_lights = geom_lights_[it->second.get()];
+    if (!object_lights.empty() && transform.determinant() < 0)
+        throw SourceError::from_toml(table.source(), "Object '" + object + "' contains lights and cannot be mirrored");
+    for (auto light : object_lights) {
+        auto transformed_light = transform_light(*light, transform);
+        if (!transformed_light)
+            throw SourceError::from_toml(table.source(), "Object '" + object + "' contains lights that cannot be instanced");
+        lights.emplace(light, transformed_light);
+    }
+    return InstanceGroup::Instance { it->second.get(), transform, std::move(lights) };
+}
+
+TriangleMesh::Config SceneLoader::parse_mesh_config(const toml::table& table) {
+    TriangleMesh::Config config;
+    if (auto quality = table["bvh_quality"].value<std::string>()) {
+        if (*quality == "low")
+            config.bvh_quality = BvhQuality::Low;
+        else if (*quality == "medium")
+            config.bvh_quality = BvhQuality::Medium;
+        else if (*quality == "high")
+            config.bvh_quality = BvhQuality::High;
+        else
+            throw SourceError::from_toml(table.source(), "Invalid BVH quality '" + *quality + "'");
+    }
+    config.bvh_arity = table["bvh_arity"].value_or(config.bvh_arity);
+    if (config.bvh_arity != 2 && config.bvh_arity != 4 && config.bvh_arity != 8)
+        throw SourceError::from_toml(table.source(), "Invalid BVH arity '" + std::to_string(config.bvh_arity) + "'");
+    config.compress_bvh = table["compress_bvh"].value_or(config.compress_bvh);
+    if (config.compress_bvh && config.bvh_arity == 2)
+        throw SourceError::from_toml(table.source(), "Compressed BVHs require an arity of 4 or 8");
+    config.compact      = table["compact"].value_or(config.compact);
+    return config;
+}
+
 std::optional<Scene> Scene::load(const std::string& file_name, const Defaults& defaults, std::ostream* err_out) {
     Scene scene;
     SceneLoader loader(scene, defaults, err_out);
-    return loader.load(file_name) ? std::make_optional(std::move(scene)) : std::nullopt;
+    if (!loader.load(file_name))
+        return std::nullopt;
+    scene.finalize(defaults.light_sampler);
+    return std::make_optional(std::move(scene));
 }
 
 } // namespace sol
@@ -12,6 +12,8 @@
 #include <proto/hash.h>
 
 #include "sol/scene.h"
+#include "sol/triangle_mesh.h"
+#include "sol/instances.h"
 
 namespace sol {
 
@@ -76,11 +78,16 @@ public:
         return get_or_insert<T, Light>(lights_, scene_.lights, std::forward<Args>(args)...); 
     }
 
-    void insert_geom(const std::string&, std::unique_ptr<Geometry>&&);
+    // Registers a geometric object, along with the lights that it places (in its local coordinate system).
+    void insert_geom(const std::string&, std::unique_ptr<Geometry>&&, std::vector<const Light*>&& = {});
 
 private:
     std::unique_ptr<Camera> create_camera(const toml::table&);
     void create_geom(const toml::table&, const std::string&);
+    TriangleMesh::Config parse_mesh_config(const toml::table&);
+    InstanceGroup::Instance parse_instance(const toml::table&);
+    const Light* transform_light(const Light&, const AffineTransform&);
+    void remove_unreachable_lights();
 
     template <typename T, typename U, typename Set, typename Container, typename... Args>
     static const U* get_or_insert(Set& set, Container& container, Args&&... args) {
@@ -117,6 +124,7 @@ private:
 
     std::unordered_map<std::string, const Image*> images_;
     std::unordered_map<std::string, std::unique_ptr<Geometry>> geoms_;
+    std::unordered_map<const Geometry*, std::vector<const Light*>> geom_lights_;
 
     std::ostream* err_out_;
 };
@@ -1,20 +1,7 @@
 #include "sol/shapes.h"
-#include "sol/samplers.h"
 
 namespace sol {
 
-template <typename Shape, typename Derived>
-ShapeSample SamplableShape<Shape, Derived>::sample(Sampler& sampler) const {
-    auto uv = proto::Vec2f(sampler(), sampler());
-    return static_cast<const Derived*>(this)->sample_at(uv);
-}
-
-template <typename Shape, typename Derived>
-DirectionalShapeSample SamplableShape<Shape, Derived>::sample(Sampler& sampler, const proto::Vec3f& from) const {
-    auto uv = proto::Vec2f(sampler(), sampler());
-    return static_cast<const Derived*>(this)->sample_at(uv, from);
-}
-
 // Uniform Triangle ----------------------------------------------------------------
 
 ShapeSample UniformTriangle::sample_at(proto::Vec2f uv) const {
@@ -40,7 +27,4 @@ DirectionalShapeSample UniformSphere::sample_at(const proto::Vec2f& uv, const pr
     return DirectionalShapeSample(sample_at(uv));
 }
 
-template struct SamplableShape<proto::Trianglef, UniformTriangle>;
-template struct SamplableShape<proto::Spheref,   UniformSphere>;
-
 } // namespace sol
@@ -51,6 +51,18 @@ Color ImageTexture<ImageFilter, BorderMode>::sample_color(const proto::Vec2f& uv
         [&] (size_t i, size_t j) { return image_.rgb_at(i, j); });
 }
 
+template <typename ImageFilter, typename BorderMode>
+Color ImageTexture<ImageFilter, BorderMode>::compute_average_color(const Image& image) {
+    if (image.width() == 0 || image.height() == 0)
+        return Color::black();
+    auto sum = Color::black();
+    for (size_t y = 0; y < image.height(); ++y) {
+        for (size_t x = 0; x < image.width(); ++x)
+            sum += image.rgb_at(x, y);
+    }
+    return sum * (1.0f / static_cast<float>(image.width() * image.height()));
+}
+
 template class ImageTexture<ImageFilter::Nearest, BorderMode::Clamp>;
 template class ImageTexture<ImageFilter::Nearest, BorderMode::Repeat>;
 template class ImageTexture<ImageFilter::Nearest, BorderMode::Mirror>;
@@ -0,0 +1,107 @@
+#include <cmath>
+#include <numbers>
+
+#include "sol/transform.h"
+
+namespace sol {
+
+AffineTransform AffineTransform::identity() {
+    return scale(proto::Vec3f(1, 1, 1));
+}
+
+AffineTransform AffineTransform::translate(const proto::Vec3f& t) {
+    auto transform = identity();
+    transform.translation = t;
+    return transform;
+}
+
+AffineTransform AffineTransform::scale(const proto::Vec3f& s) {
+    return AffineTransform({
+        proto::Vec3f(s[0], 0, 0),
+        proto::Vec3f(0, s[1], 0),
+        proto::Vec3f(0, 0, s[2])
+    }, proto::Vec3f(0, 0, 0));
+}
+
+AffineTransform AffineTransform::rotate(const proto::Vec3f& angles) {
+    auto radians = angles * (std::numbers::pi_v<float> / 180.0f);
+    auto cx = std::cos(radians[0]), sx = std::sin(radians[0]);
+    auto cy = std::cos(radians[1]), sy = std::sin(radians[1]);
+    auto cz = std::cos(radians[2]), sz = std::sin(radians[2]);
+    auto rx = AffineTransform({
+        proto::Vec3f(1, 0, 0),
+        proto::Vec3f(0, cx, -sx),
+        proto::Vec3f(0, sx, cx)
+    }, proto::Vec3f(0, 0, 0));
+    auto ry = AffineTransform({
+        proto::Vec3f(cy, 0, sy),
+        proto::Vec3f(0, 1, 0),
+        proto::Vec3f(-sy, 0, cy)
+    }, proto::Vec3f(0, 0, 0));
+    auto rz = AffineTransform({
+        proto::Vec3f(cz, -sz, 0),
+        proto::Vec3f(sz, cz, 0),
+        proto::Vec3f(0, 0, 1)
+    }, proto::Vec3f(0, 0, 0));
+    return rz * ry * rx;
+}
+
+proto::Vec3f AffineTransform::apply_vector(const proto::Vec3f& v) const {
+    return proto::Vec3f(
+        proto::dot(rows[0], v),
+        proto::dot(rows[1], v),
+        proto::dot(rows[2], v));
+}
+
+proto::Vec3f AffineTransform::apply_normal(const AffineTransform& inverse, const proto::Vec3f& n) {
+    // Normals are transformed by the transpose of the inverse
+    return inverse.rows[0] * n[0] + inverse.rows[1] * n[1] + inverse.rows[2] * n[2];
+}
+
+proto::BBoxf AffineTransform::apply(const proto::BBoxf& bbox) const {
+    auto result = proto::BBoxf::empty();
+    for (int i = 0; i < 8; ++i) {
+        result.extend(apply_point(proto::Vec3f(
+            i & 1 ? bbox.max[0] : bbox.min[0],
+            i & 2 ? bbox.max[1] : bbox.min[1],
+            i & 4 ? bbox.max[2] : bbox.min[2])));
+    }
+    return result;
+}
+
+float AffineTransform::determinant() const {
+    return proto::dot(rows[0], proto::cross(rows[1], rows[2]));
+}
+
+bool AffineTransform::is_invertible() const {
+    auto det = determinant();
+    return std::isfinite(det) && det != 0 && std::isfinite(1.0f / det);
+}
+
+AffineTransform AffineTransform::inverse() const {
+    // The columns of the inverse are the cross products of the rows, divided by the determinant
+    auto c0 = proto::cross(rows[1], rows[2]);
+    auto c1 = proto::cross(rows[2], rows[0]);
+    auto c2 = proto::cross(rows[0], rows[1]);
+    auto inv_det = 1.0f / determinant();
+    auto inverse = AffineTransform({
+        proto::Vec3f(c0[0], c1[0], c2[0]) * inv_det,
+        proto::Vec3f(c0[1], c1[1], c2[1]) * inv_det,
+        proto::Vec3f(c0[2], c1[2], c2[2]) * inv_det
+    }, proto::Vec3f(0, 0, 0));
+    inverse.translation = -inverse.apply_vector(translation);
+    return inverse;
+}
+
+AffineTransform AffineTransform::operator * (const AffineTransform& other) const {
+    std::array<proto::Vec3f, 3> result_rows;
+    for (int i = 0; i < 3; ++i) {
+        result_rows[i] =
+            other.rows[0] * rows[i][0] +
+            other.rows[1] * rows[i][1] +
+            other.rows[2] * rows[i][2];
+    }
+    return AffineTransform(result_rows, apply_point(other.translation));
+}
+
+} // namespace sol
@@ -0,0 +1,43 @@
+#ifndef SOL_TRAVERSAL_STACK_H
+#define SOL_TRAVERSAL_STACK_H
+
+#include <array>
+#include <vector>
+#include <cstddef>
+
+namespace sol {
+
+/// Stack used to traverse a BVH. Its capacity is derived from the depth of the BVH, so that it can never overflow.
+/// The elements live in a fixed-size array, unless the BVH is deep enough to require more space.
+template <typename T, size_t InlineCapacity = 128>
+class TraversalStack {
+public:
+    explicit TraversalStack(size_t capacity) {
+        if (capacity > InlineCapacity) {
+            heap_.resize(capacity);
+            data_ = heap_.data();
+        }
+    }
+
+    TraversalStack(const TraversalStack&) = delete;
+    TraversalStack& operator = (const TraversalStack&) = delete;
+
+    void push(const T& elem) { data_[size_++] = elem; }
+    T pop() { return data_[--size_]; }
+
+    bool is_empty() const { return size_ == 0; }
+    size_t size() const { return size_; }
+
+    T* begin() { return data_; }
+    T* end() { return data_ + size_; }
+
+private:
+    std::array<T, InlineCapacity> inline_;
+    std::vector<T> heap_;
+    T* data_ = inline_.data();
+    size_t size_ = 0;
+};
+
+} // namespace sol
+
+#endif
@@ -1,9 +1,19 @@
 #include <ranges>
 #include <numeric>
+#include <array>
+#include <limits>
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+#include <variant>
+#include <type_traits>
+#include <unordered_set>
+#include <bit>
 
 #include <proto/triangle.h>
 
 #include <bvh/bvh.h>
+#include <bvh/binned_sah_builder.h>
 #include <bvh/sweep_sah_builder.h>
 #if defined(SOL_ENABLE_TBB)
 #include <bvh/tbb/parallel_top_down_scheduler.h>
@@ -15,17 +25,186 @@
 #include <bvh/sequential_top_down_scheduler.h>
 #include <par/sequential_executor.h>
 #endif
-#include <bvh/topology_modifier.h>
-#include <bvh/sequential_reinsertion_optimizer.h>
 #include <bvh/single_ray_traverser.h>
 
 #include "sol/triangle_mesh.h"
 #include "sol/lights.h"
 
+#include "binary_stream.h"
+#include "traversal_stack.h"
+#include "wide_bvh.h"
+#include "quantized_bvh.h"
+#include "parallel_reinsertion_optimizer.h"
+
 namespace sol {
 
 using Bvh = bvh::Bvh<float>;
-struct TriangleMesh::BvhData { Bvh bvh; };
+using TraversalBvh = std::variant<
+    std::monostate,
+    WideBvh<4>, WideBvh<8>,
+    QuantizedBvh<4>, QuantizedBvh<8>>;
+
+struct TriangleMesh::BvhData {
+    Bvh bvh;
+    // Collapsed and/or compressed version of the BVH, used for single-ray traversal when the configuration requires it.
+    // When this is a compressed BVH, the nodes of the binary BVH are discarded to save memory.
+    TraversalBvh traversal_bvh;
+    // Bounding box of the whole mesh, kept separately since the binary BVH may have been discarded
+    proto::BBoxf bbox = proto::BBoxf::empty();
+    // Depth of the binary BVH, which bounds the size of the stack used for packet traversal
+    size_t depth = 0;
+
+    bool has_binary_nodes() const { return !is_compressed(); }
+    bool is_compressed() const {
+        return
+            std::holds_alternative<QuantizedBvh<4>>(traversal_bvh) ||
+            std::holds_alternative<QuantizedBvh<8>>(traversal_bvh);
+    }
+    // Triangle index for each lane of each triangle block (padding lanes contain `invalid_index`).
+    // Compact meshes store them on 32 bits in `compact_prim_indices` instead, and leave `prim_indices` empty.
+    std::vector<size_t> prim_indices;
+    std::vector<uint32_t> compact_prim_indices;
+
+    static constexpr size_t invalid_index = std::numeric_limits<size_t>::max();
+    static constexpr uint32_t invalid_compact_index = std::numeric_limits<uint32_t>::max();
+
+    size_t prim_index_count() const { return prim_indices.size() + compact_prim_indices.size(); }
+    size_t prim_index(size_t i) const {
+        if (compact_prim_indices.empty())
+            return prim_indices[i];
+        auto j = compact_prim_indices[i];
+        return j == invalid_compact_index ? invalid_index : j;
+    }
+};
+
+/// Block of triangles stored in SoA form, so that a ray can be intersected against all of them at once.
+/// The leaves of the BVH refer to ranges of blocks, not to individual triangles.
+/// Unused lanes have degenerate edges, and thus are never intersected.
+struct TriangleMesh::TriangleBlock {
+#if defined(__AVX__)
+    static constexpr size_t size = 8;
+#else
+    static constexpr size_t size = 4;
+#endif
+
+    std::array<float, size> v0[3];
+    std::array<float, size> e1[3];
+    std::array<float, size> e2[3];
+
+    TriangleBlock() {
+        for (int i = 0; i < 3; ++i) {
+            v0[i].fill(0.0f);
+            e1[i].fill(0.0f);
+            e2[i].fill(0.0f);
+        }
+    }
+
+    void set(size_t lane, const proto::Vec3f& p0, const proto::Vec3f& p1, const proto::Vec3f& p2) {
+        for (int i = 0; i < 3; ++i) {
+            v0[i][lane] = p0[i];
+            e1[i][lane] = p1[i] - p0[i];
+            e2[i][lane] = p2[i] - p0[i];
+        }
+    }
+
+    proto::Vec3f normal(size_t lane) const {
+        // `proto::PrecomputedTrianglef`, which was used before triangle blocks, computes its normal as
+        // `cross(p0 - p1, p2 - p0)`, which is `cross(e2, e1)` here. The same orientation is used so that
+        // which side of a triangle is the front side does not change.
+        return proto::normalize(proto::Vec3f(
+            e2[1][lane] * e1[2][lane] - e2[2][lane] * e1[1][lane],
+            e2[2][lane] * e1[0][lane] - e2[0][lane] * e1[2][lane],
+            e2[0][lane] * e1[1][lane] - e2[1][lane] * e1[0][lane]));
+    }
+
+    /// Intersects the ray with the triangles of the block (Moller-Trumbore test).
+    /// If any triangle is hit, the ray `tmax` is updated and the closest lane is returned along with its barycentric coordinates.
+    std::optional<std::tuple<size_t, float, float>> intersect(proto::Rayf& ray) const {
+        std::array<float, size> t, u, v;
+        std::array<bool, size> hit;
+        // This loop is written so that the compiler can vectorize it
+        for (size_t i = 0; i < size; ++i) {
+            auto px = ray.dir[1] * e2[2][i] - ray.dir[2] * e2[1][i];
+            auto py = ray.dir[2] * e2[0][i] - ray.dir[0] * e2[2][i];
+            auto pz = ray.dir[0] * e2[1][i] - ray.dir[1] * e2[0][i];
+            auto det = e1[0][i] * px + e1[1][i] * py + e1[2][i] * pz;
+            auto inv_det = 1.0f / det;
+            auto sx = ray.org[0] - v0[0][i];
+            auto sy = ray.org[1] - v0[1][i];
+            auto sz = ray.org[2] - v0[2][i];
+            auto qx = sy * e1[2][i] - sz * e1[1][i];
+            auto qy = sz * e1[0][i] - sx * e1[2][i];
+            auto qz = sx * e1[1][i] - sy * e1[0][i];
+            u[i] = (sx * px + sy * py + sz * pz) * inv_det;
+            v[i] = (ray.dir[0] * qx + ray.dir[1] * qy + ray.dir[2] * qz) * inv_det;
+            t[i] = (e2[0][i] * qx + e2[1][i] * qy + e2[2][i] * qz) * inv_det;
+            hit[i] =
+                det != 0.0f &&
+                u[i] >= 0.0f && v[i] >= 0.0f && u[i] + v[i] <= 1.0f &&
+                t[i] >= ray.tmin && t[i] <= ray.tmax;
+        }
+
+        std::optional<std::tuple<size_t, float, float>> hit_info;
+        for (size_t i = 0; i < size; ++i) {
+            if (hit[i] && t[i] <= ray.tmax) {
+                ray.tmax = t[i];
+                hit_info = std::make_optional(std::tuple { i, u[i], v[i] });
+            }
+        }
+        return hit_info;
+    }
+};
+
+/// Group of rays that are traversed together. Ray data is stored in SoA form,
+/// so that a bounding box can be tested against all the rays of the packet at once.
+struct TriangleMesh::RayPacket {
+    static constexpr size_t size = 8;
+
+    std::array<proto::Rayf, size> rays;
+    std::array<bool, size> active;
+    std::array<float, size> org[3];
+    std::array<float, size> inv_dir[3];
+    std::array<float, size> tmin;
+    std::array<float, size> tmax;
+
+    using Mask = std::array<bool, size>;
+
+    void load(size_t lane, const proto::Rayf& ray, bool is_active) {
+        rays[lane] = ray;
+        active[lane] = is_active;
+        for (int i = 0; i < 3; ++i) {
+            org[i][lane] = ray.org[i];
+            inv_dir[i][lane] = 1.0f / ray.dir[i];
+        }
+        tmin[lane] = ray.tmin;
+        tmax[lane] = ray.tmax;
+    }
+
+    /// Intersects the packet with the given box. Returns the smallest entry distance among
+    /// the rays that intersect the box, and the mask of those rays.
+    std::pair<float, Mask> intersect(const proto::BBoxf& bbox) const {
+        Mask mask;
+        float entry = std::numeric_limits<float>::max();
+        // This loop is written so that the compiler can vectorize it
+        for (size_t i = 0; i < size; ++i) {
+            auto tx0 = (bbox.min[0] - org[0][i]) * inv_dir[0][i];
+            auto tx1 = (bbox.max[0] - org[0][i]) * inv_dir[0][i];
+            auto ty0 = (bbox.min[1] - org[1][i]) * inv_dir[1][i];
+            auto ty1 = (bbox.max[1] - org[1][i]) * inv_dir[1][i];
+            auto tz0 = (bbox.min[2] - org[2][i]) * inv_dir[2][i];
+            auto tz1 = (bbox.max[2] - org[2][i]) * inv_dir[2][i];
+            auto t0 = std::max(std::max(std::min(tx0, tx1), std::min(ty0, ty1)), std::max(std::min(tz0, tz1), tmin[i]));
+            auto t1 = std::min(std::min(std::max(tx0, tx1), std::max(ty0, ty1)), std::min(std::max(tz0, tz1), tmax[i]));
+            mask[i] = active[i] && t0 <= t1;
+            entry = mask[i] ? std::min(entry, t0) : entry;
+        }
+        return std::pair { entry, mask };
+    }
+
+    bool any(const Mask& mask) const {
+        return std::any_of(mask.begin(), mask.end(), [] (bool b) { return b; });
+    }
+};
 
 #if defined(SOL_ENABLE_TBB)
 template <typename Builder>
@@ -41,33 +220,266 @@ using TopDownScheduler = bvh::SequentialTopDownScheduler<Builder>;
 using Executor         = par::SequentialExecutor;
 #endif
 
+// Computes the depth of the part of a binary BVH that is reachable from its root.
+// Throws an exception if the nodes do not form a tree.
+static size_t compute_depth(const Bvh& bvh) {
+    if (bvh.node_count == 0)
+        return 0;
+    size_t depth = 0, visited_count = 0;
+    std::vector<std::pair<size_t, size_t>> stack { { 0, 1 } };
+    while (!stack.empty()) {
+        auto [node_index, level] = stack.back();
+        stack.pop_back();
+        if (++visited_count > bvh.node_count)
+            throw std::runtime_error("Invalid BVH nodes");
+        depth = std::max(depth, level);
+        auto& node = bvh.nodes[node_index];
+        if (node.is_leaf())
+            continue;
+        if (node.first_index + 1 >= bvh.node_count)
+            throw std::runtime_error("Invalid child index in BVH node");
+        stack.emplace_back(node.first_index + 0, level + 1);
+        stack.emplace_back(node.first_index + 1, level + 1);
+    }
+    return depth;
+}
+
+template <size_t I = 0>
+static void read_traversal_bvh(BinaryReader& reader, size_t index, TraversalBvh& traversal_bvh) {
+    if constexpr (I < std::variant_size_v<TraversalBvh>) {
+        if (index != I)
+            return read_traversal_bvh<I + 1>(reader, index, traversal_bvh);
+        using T = std::variant_alternative_t<I, TraversalBvh>;
+        if constexpr (!std::is_same_v<T, std::monostate>) {
+            T t;
+            t.nodes = reader.read_vector<typename T::Node>();
+            t.update_depth();
+            traversal_bvh = std::move(t);
+        }
+    } else
+        throw std::runtime_error("Invalid BVH type in mesh data");
+}
+
 TriangleMesh::TriangleMesh(
     std::vector<size_t>&& indices,
     std::vector<proto::Vec3f>&& vertices,
     std::vector<proto::Vec3f>&& normals,
     std::vector<proto::Vec2f>&& tex_coords,
     std::vector<const Bsdf*>&& bsdfs,
-    std::unordered_map<size_t, const Light*>&& lights)
-    : indices_(std::move(indices))
+    std::unordered_map<size_t, const Light*>&& lights,
+    const Config& config)
+    : config_(config)
+    , indices_(std::move(indices))
     , normals_(std::move(normals))
     , tex_coords_(std::move(tex_coords))
     , bsdfs_(std::move(bsdfs))
-    , lights_(std::move(lights))
 {
+    // Quantized binary nodes are about as large as regular ones, so compression is only useful for wide BVHs
+    if (config_.compress_bvh && config_.bvh_arity != 4 && config_.bvh_arity != 8)
+        throw std::runtime_error("Compressed BVHs require an arity of 4 or 8");
+
+    // The indices must be in their final place before building the BVH, since the build goes through `triangle_indices()`
+    if (config_.compact) {
+        if (vertices.size() > std::numeric_limits<uint32_t>::max() ||
+            indices_.size() / 3 >= BvhData::invalid_compact_index)
+            throw std::runtime_error("Too many vertices or triangles for a compact mesh");
+        compact_indices_.assign(indices_.begin(), indices_.end());
+        indices_ = {};
+    }
+
     Executor executor;
     bvh_data_ = build_bvh(executor, vertices);
-    triangles_ = build_triangles(executor, vertices);
+    build_light_table(lights);
+    if (config_.compact)
+        vertices_ = std::move(vertices);
+    else
+        triangles_ = build_triangles(executor, vertices);
+}
+
+TriangleMesh::TriangleMesh(
+    BinaryReader& reader,
+    std::vector<const Bsdf*>&& bsdfs,
+    std::unordered_map<size_t, const Light*>&& lights,
+    const Config& config)
+    : config_(config)
+    , bsdfs_(std::move(bsdfs))
+{
+    if (reader.read<size_t>() != TriangleBlock::size ||
+        reader.read<BvhQuality>() != config_.bvh_quality ||
+        reader.read<size_t>() != config_.bvh_arity ||
+        reader.read<bool>()   != config_.compress_bvh ||
+        reader.read<bool>()   != config_.compact)
+        throw std::runtime_error("Mesh data was written with a different configuration");
+
+    indices_         = reader.read_vector<size_t>();
+    compact_indices_ = reader.read_vector<uint32_t>();
+    vertices_        = reader.read_vector<proto::Vec3f>();
+    normals_         = reader.read_vector<proto::Vec3f>();
+    tex_coords_      = reader.read_vector<proto::Vec2f>();
+    triangles_       = reader.read_vector<TriangleBlock>();
+
+    bvh_data_ = std::make_unique<BvhData>();
+    bvh_data_->prim_indices = reader.read_vector<size_t>();
+    bvh_data_->compact_prim_indices = reader.read_vector<uint32_t>();
+    bvh_data_->bbox = reader.read<proto::BBoxf>();
+    if (auto node_count = reader.read_count(sizeof(Bvh::Node)); node_count > 0) {
+        bvh_data_->bvh.nodes = std::make_unique<Bvh::Node[]>(node_count);
+        bvh_data_->bvh.node_count = node_count;
+        reader.read(bvh_data_->bvh.nodes.get(), node_count);
+    }
+    bvh_data_->depth = compute_depth(bvh_data_->bvh);
+    read_traversal_bvh(reader, reader.read<size_t>(), bvh_data_->traversal_bvh);
+
+    if (bsdfs_.size() != triangle_count())
+        throw std::runtime_error("Invalid number of BSDFs for the mesh data");
+    validate();
+    build_light_table(lights);
 }
 
 TriangleMesh::~TriangleMesh() = default;
 
-std::optional<Hit> TriangleMesh::intersect_closest(proto::Rayf& ray) const {
-    auto hit_info = bvh::SingleRayTraverser<Bvh>::traverse<false>(ray, bvh_data_->bvh,
-        [&] (proto::Rayf& ray, const Bvh::Node& leaf) {
+void TriangleMesh::write(BinaryWriter& writer) const {
+    writer.write(TriangleBlock::size);
+    writer.write(config_.bvh_quality);
+    writer.write(config_.bvh_arity);
+    writer.write(config_.compress_bvh);
+    writer.write(config_.compact);
+
+    writer.write(indices_);
+    writer.write(compact_indices_);
+    writer.write(vertices_);
+    writer.write(normals_);
+    writer.write(tex_coords_);
+    writer.write(triangles_);
+
+    writer.write(bvh_data_->prim_indices);
+    writer.write(bvh_data_->compact_prim_indices);
+    writer.write(bvh_data_->bbox);
+    writer.write(bvh_data_->bvh.node_count);
+    writer.write(bvh_data_->bvh.nodes.get(), bvh_data_->bvh.node_count);
+    writer.write(bvh_data_->traversal_bvh.index());
+    std::visit([&] <typename T> (const T& traversal_bvh) {
+        if constexpr (!std::is_same_v<T, std::monostate>)
+            writer.write(traversal_bvh.nodes);
+    }, bvh_data_->traversal_bvh);
+}
+
+void TriangleMesh::validate() const {
+    if ((config_.compact ? !indices_.empty() : !compact_indices_.empty()) ||
+        (config_.compact ? compact_indices_.size() : indices_.size()) % 3 != 0)
+        throw std::runtime_error("Invalid vertex indices in mesh data");
+
+    // Normals and texture coordinates are stored per vertex, like vertices in compact mode
+    auto vertex_count = std::min(normals_.size(), tex_coords_.size());
+    if (config_.compact)
+        vertex_count = std::min(vertex_count, vertices_.size());
+    for (size_t i = 0; i < triangle_count(); ++i) {
+        auto [i0, i1, i2] = triangle_indices(i);
+        if (std::max({ i0, i1, i2 }) >= vertex_count)
+            throw std::runtime_error("Invalid vertex indices in mesh data");
+    }
+
+    auto prim_index_count = bvh_data_->prim_index_count();
+    if ((config_.compact ? !bvh_data_->prim_indices.empty() : !bvh_data_->compact_prim_indices.empty()) ||
+        prim_index_count % TriangleBlock::size != 0 ||
+        (!config_.compact && triangles_.size() * TriangleBlock::size != prim_index_count))
+        throw std::runtime_error("Invalid number of triangle blocks in mesh data");
+    for (size_t i = 0; i < prim_index_count; ++i) {
+        auto prim_index = bvh_data_->prim_index(i);
+        if (prim_index != BvhData::invalid_index && prim_index >= triangle_count())
+            throw std::runtime_error("Invalid primitive indices in mesh data");
+    }
+
+    // The BVH must have the layout required by the configuration, and must not be empty,
+    // since traversal starts at the root of either the binary BVH or the traversal BVH.
+    auto& bvh = bvh_data_->bvh;
+    auto [traversal_arity, traversal_node_count] = std::visit([&] <typename T> (const T& traversal_bvh) {
+        if constexpr (std::is_same_v<T, std::monostate>)
+            return std::pair<size_t, size_t> { 2, bvh.node_count };
+        else
+            return std::pair<size_t, size_t> { T::arity, traversal_bvh.nodes.size() };
+    }, bvh_data_->traversal_bvh);
+    if (traversal_arity != config_.bvh_arity ||
+        traversal_node_count == 0 ||
+        (bvh_data_->is_compressed() && !config_.compress_bvh) ||
+        (bvh_data_->has_binary_nodes() != (bvh.node_count > 0)))
+        throw std::runtime_error("Invalid BVH layout in mesh data");
+
+    // Leaves refer to ranges of triangle blocks
+    auto block_count = prim_index_count / TriangleBlock::size;
+    auto check_leaf = [&] (size_t first_block, size_t leaf_block_count) {
+        if (first_block > block_count || leaf_block_count > block_count - first_block)
+            throw std::runtime_error("Invalid BVH leaves in mesh data");
+    };
+
+    // Only the nodes reachable from the root are checked, since `build_leaf_blocks()` leaves some nodes unused
+    std::vector<size_t> stack;
+    if (bvh.node_count > 0)
+        stack.push_back(0);
+    while (!stack.empty()) {
+        auto& node = bvh.nodes[stack.back()];
+        stack.pop_back();
+        if (node.is_leaf()) {
+            check_leaf(node.first_index, node.prim_count);
+            continue;
+        }
+        stack.push_back(node.first_index + 0);
+        stack.push_back(node.first_index + 1);
+    }
+
+    std::visit([&] <typename T> (const T& traversal_bvh) {
+        if constexpr (!std::is_same_v<T, std::monostate>) {
+            for (auto& node : traversal_bvh.nodes) {
+                for (size_t i = 0; i < node.first_index.size(); ++i) {
+                    if (!node.is_empty(i) && node.is_leaf(i))
+                        check_leaf(node.first_index[i], node.prim_count[i]);
+                }
+            }
+        }
+    }, bvh_data_->traversal_bvh);
+}
+
+template <bool IsAnyHit, typename LeafFn>
+auto TriangleMesh::traverse(proto::Rayf& ray, LeafFn&& leaf_fn) const {
+    using Result = std::invoke_result_t<LeafFn, proto::Rayf&, size_t, size_t>;
+    return std::visit([&] <typename T> (const T& traversal_bvh) -> Result {
+        if constexpr (std::is_same_v<T, std::monostate>) {
+            return bvh::SingleRayTraverser<Bvh>::traverse<IsAnyHit>(ray, bvh_data_->bvh,
+                [&] (proto::Rayf& ray, const Bvh::Node& leaf) {
+                    return leaf_fn(ray, leaf.first_index, leaf.first_index + leaf.prim_count);
+                });
+        } else
+            return traversal_bvh.template traverse<IsAnyHit>(ray, leaf_fn);
+    }, bvh_data_->traversal_bvh);
+}
+
+const TriangleMesh::TriangleBlock& TriangleMesh::triangle_block(size_t block_index, TriangleBlock& scratch) const {
+    if (!config_.compact)
+        return triangles_[block_index];
+
+    // In compact mode, blocks are gathered from the shared vertices every time they are needed
+    for (size_t lane = 0; lane < TriangleBlock::size; ++lane) {
+        auto j = bvh_data_->prim_index(block_index * TriangleBlock::size + lane);
+        if (j == BvhData::invalid_index) {
+            scratch.set(lane, proto::Vec3f(0, 0, 0), proto::Vec3f(0, 0, 0), proto::Vec3f(0, 0, 0));
+            continue;
+        }
+        auto [i0, i1, i2] = triangle_indices(j);
+        scratch.set(lane, vertices_[i0], vertices_[i1], vertices_[i2]);
+    }
+    return scratch;
+}
+
+std::optional<HitRecord> TriangleMesh::intersect_closest_record(proto::Rayf& ray) const {
+    TriangleBlock scratch;
+    auto hit_info = traverse<false>(ray,
+        [&] (proto::Rayf& ray, size_t begin, size_t end) {
             std::optional<std::tuple<size_t, float, float>> hit_info;
-            for (size_t i = leaf.first_index, n = i + leaf.prim_count; i < n; ++i) {
-                if (auto uv = triangles_[i].intersect(ray))
-                    hit_info = std::make_optional(std::tuple { i, uv->first, uv->second });
+            for (size_t i = begin; i < end; ++i) {
+                if (auto block_hit = triangle_block(i, scratch).intersect(ray)) {
+                    auto [lane, u, v] = *block_hit;
+                    hit_info = std::make_optional(std::tuple { i * TriangleBlock::size + lane, u, v });
+                }
             }
             return hit_info;
         });
@@ -76,10 +488,188 @@ std::optional<Hit> TriangleMesh::intersect_closest(proto::Rayf& ray) const {
         return std::nullopt;
 
     auto [permuted_index, u, v] = *hit_info;
-    auto face_normal    = triangles_[permuted_index].normal();
-    auto triangle_index = bvh_data_->bvh.prim_indices[permuted_index];
+    return std::make_optional(make_record(ray, permuted_index, u, v));
+}
+
+proto::BBoxf TriangleMesh::bbox() const {
+    return bvh_data_->bbox;
+}
+
+bool TriangleMesh::intersect_any(const proto::Rayf& init_ray) const {
+    auto ray = init_ray;
+    TriangleBlock scratch;
+    return traverse<true>(ray,
+        [&] (proto::Rayf& ray, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                if (triangle_block(i, scratch).intersect(ray))
+                    return true;
+            }
+            return false;
+        });
+}
+
+void TriangleMesh::intersect_closest_batch(
+    std::span<proto::Rayf> rays,
+    std::span<const bool> active,
+    std::span<std::optional<HitRecord>> hits) const
+{
+    // Packets are traversed with the binary BVH, which is not available when the BVH is compressed
+    if (!bvh_data_->has_binary_nodes())
+        return Geometry::intersect_closest_batch(rays, active, hits);
+
+    static constexpr size_t invalid_index = std::numeric_limits<size_t>::max();
+    RayPacket packet;
+    TriangleBlock scratch;
+    for (size_t first = 0; first < rays.size(); first += RayPacket::size) {
+        std::array<std::tuple<size_t, float, float>, RayPacket::size> hit_infos;
+        for (size_t i = 0; i < RayPacket::size; ++i) {
+            bool is_active = first + i < rays.size() && active[first + i];
+            packet.load(i, is_active ? rays[first + i] : proto::Rayf(), is_active);
+            hit_infos[i] = std::tuple { invalid_index, 0.0f, 0.0f };
+        }
+
+        traverse_packet<false>(packet, [&] (const Bvh::Node& leaf, const RayPacket::Mask& mask) {
+            for (size_t i = leaf.first_index, n = i + leaf.prim_count; i < n; ++i) {
+                auto& block = triangle_block(i, scratch);
+                for (size_t j = 0; j < RayPacket::size; ++j) {
+                    if (!mask[j])
+                        continue;
+                    if (auto block_hit = block.intersect(packet.rays[j])) {
+                        auto [lane, u, v] = *block_hit;
+                        hit_infos[j] = std::tuple { i * TriangleBlock::size + lane, u, v };
+                    }
+                }
+            }
+            for (size_t j = 0; j < RayPacket::size; ++j) {
+                if (mask[j])
+                    packet.tmax[j] = packet.rays[j].tmax;
+            }
+        });
+
+        for (size_t i = 0; i < RayPacket::size && first + i < rays.size(); ++i) {
+            if (!packet.active[i])
+                continue;
+            auto [permuted_index, u, v] = hit_infos[i];
+            if (permuted_index == invalid_index) {
+                hits[first + i] = std::nullopt;
+                continue;
+            }
+            rays[first + i].tmax = packet.rays[i].tmax;
+            hits[first + i] = std::make_optional(make_record(packet.rays[i], permuted_index, u, v));
+        }
+    }
+}
+
+void TriangleMesh::intersect_any_batch(
+    std::span<const proto::Rayf> rays,
+    std::span<const bool> active,
+    std::span<bool> hits) const
+{
+    if (!bvh_data_->has_binary_nodes())
+        return Geometry::intersect_any_batch(rays, active, hits);
+
+    RayPacket packet;
+    TriangleBlock scratch;
+    for (size_t first = 0; first < rays.size(); first += RayPacket::size) {
+        for (size_t i = 0; i < RayPacket::size; ++i) {
+            bool is_active = first + i < rays.size() && active[first + i];
+            packet.load(i, is_active ? rays[first + i] : proto::Rayf(), is_active);
+        }
+
+        traverse_packet<true>(packet, [&] (const Bvh::Node& leaf, const RayPacket::Mask& mask) {
+            for (size_t i = leaf.first_index, n = i + leaf.prim_count; i < n; ++i) {
+                auto& block = triangle_block(i, scratch);
+                for (size_t j = 0; j < RayPacket::size; ++j) {
+                    if (!mask[j] || !packet.active[j])
+                        continue;
+                    if (block.intersect(packet.rays[j])) {
+                        // Rays that hit something are removed from the packet
+                        packet.active[j] = false;
+                        hits[first + j] = true;
+                    }
+                }
+            }
+        });
+
+        for (size_t i = 0; i < RayPacket::size && first + i < rays.size(); ++i) {
+            if (packet.active[i])
+                hits[first + i] = false;
+        }
+    }
+}
+
+template <bool IsAnyHit, typename LeafFn>
+void TriangleMesh::traverse_packet(RayPacket& packet, LeafFn&& leaf_fn) const {
+    auto& bvh = bvh_data_->bvh;
+    if (!packet.any(packet.active) || !packet.any(packet.intersect(bvh.nodes[0].bbox()).second))
+        return;
+
+    // Nodes on the stack have been tested against the packet when their parent was visited.
+    // At most one node is pushed per level of the BVH.
+    TraversalStack<size_t> stack(bvh_data_->depth);
+    size_t node_index = 0;
+    while (true) {
+        auto& node = bvh.nodes[node_index];
+        if (node.is_leaf()) {
+            leaf_fn(node, packet.intersect(node.bbox()).second);
+            if constexpr (IsAnyHit) {
+                if (!packet.any(packet.active))
+                    return;
+            }
+        } else {
+            auto [entry_left,  mask_left]  = packet.intersect(bvh.nodes[node.first_index + 0].bbox());
+            auto [entry_right, mask_right] = packet.intersect(bvh.nodes[node.first_index + 1].bbox());
+            bool hit_left  = packet.any(mask_left);
+            bool hit_right = packet.any(mask_right);
+            if (hit_left && hit_right) {
+                // Visit the child that is closest to the packet first
+                auto near = node.first_index, far = node.first_index + 1;
+                if (entry_right < entry_left)
+                    std::swap(near, far);
+                stack.push(far);
+                node_index = near;
+                continue;
+            } else if (hit_left || hit_right) {
+                node_index = node.first_index + (hit_left ? 0 : 1);
+                continue;
+            }
+        }
+        if (stack.is_empty())
+            break;
+        node_index = stack.pop();
+    }
+}
+
+HitRecord TriangleMesh::make_record(const proto::Rayf& ray, size_t permuted_index, float u, float v) const {
+    return HitRecord {
+        .geometry          = this,
+        .inverse_transform = nullptr,
+        .prim_index        = permuted_index,
+        .t                 = ray.tmax,
+        .u                 = u,
+        .v                 = v,
+        .light             = light_at(permuted_index),
+        .bsdf              = bsdfs_[bvh_data_->prim_index(permuted_index)]
+    };
+}
+
+SurfaceInfo TriangleMesh::surface_info(const proto::Rayf& ray, const HitRecord& record) const {
+    // The primitive index of a record is the index of the triangle in the permuted block array
+    auto permuted_index = record.prim_index;
+    auto u = record.u, v = record.v;
+    auto triangle_index = bvh_data_->prim_index(permuted_index);
     auto [i0, i1, i2]   = triangle_indices(triangle_index);
 
+    // The face normal is read from the lane of the hit triangle. Compact meshes have no blocks,
+    // so only the hit triangle is gathered from the shared vertices.
+    proto::Vec3f face_normal;
+    if (config_.compact) {
+        TriangleBlock scratch;
+        scratch.set(0, vertices_[i0], vertices_[i1], vertices_[i2]);
+        face_normal = scratch.normal(0);
+    } else
+        face_normal = triangles_[permuted_index / TriangleBlock::size].normal(permuted_index % TriangleBlock::size);
+
     auto normal     = proto::lerp(normals_[i0], normals_[i1], normals_[i2], u, v);
     auto tex_coords = proto::lerp(tex_coords_[i0], tex_coords_[i1], tex_coords_[i2], u, v);
 
@@ -92,36 +682,16 @@ std::optional<Hit> TriangleMesh::intersect_closest(proto::Rayf& ray) const {
 
     SurfaceInfo surf_info;
     surf_info.is_front_side = is_front_side;
-    surf_info.point         = ray.point_at(ray.tmax);
+    surf_info.point         = ray.point_at(record.t);
     surf_info.tex_coords    = tex_coords;
     surf_info.surf_coords   = proto::Vec2f(u, v);
     surf_info.face_normal   = face_normal;
     surf_info.local         = proto::ortho_basis(proto::normalize(normal));
-
-    const Light* light = nullptr;
-    if (auto it = lights_.find(triangle_index); it != lights_.end())
-        light = it->second;
-    return std::make_optional(Hit { surf_info, light, bsdfs_[triangle_index] });
-}
-
-bool TriangleMesh::intersect_any(const proto::Rayf& init_ray) const {
-    auto ray = init_ray;
-    return bvh::SingleRayTraverser<Bvh>::traverse<true>(ray, bvh_data_->bvh,
-        [&] (proto::Rayf& ray, const Bvh::Node& leaf) {
-            for (size_t i = leaf.first_index, n = i + leaf.prim_count; i < n; ++i) {
-                if (triangles_[i].intersect(ray))
-                    return true;
-            }
-            return false;
-        });
+    return surf_info;
 }
 
 template <typename Executor>
 std::unique_ptr<TriangleMesh::BvhData> TriangleMesh::build_bvh(Executor& executor, const std::vector<proto::Vec3f>& vertices) const {
-    using Builder = bvh::SweepSahBuilder<Bvh>;
-
-    TopDownScheduler<Builder> top_down_scheduler;
-
     auto bboxes  = std::make_unique<proto::BBoxf[]>(triangle_count());
     auto centers = std::make_unique<proto::Vec3f[]>(triangle_count());
 
@@ -130,31 +700,165 @@ std::unique_ptr<TriangleMesh::BvhData> TriangleMesh::build_bvh(Executor& executo
         executor, par::range_1d(size_t{0}, triangle_count()), proto::BBoxf::empty(),
         [] (proto::BBoxf left, const proto::BBoxf& right) { return left.extend(right); },
         [&] (size_t i) -> proto::BBoxf {
-            auto triangle = proto::Trianglef(
-                vertices[indices_[i * 3 + 0]],
-                vertices[indices_[i * 3 + 1]],
-                vertices[indices_[i * 3 + 2]]);
+            auto [i0, i1, i2] = triangle_indices(i);
+            auto triangle = proto::Trianglef(vertices[i0], vertices[i1], vertices[i2]);
             auto bbox  = triangle.bbox();
             centers[i] = triangle.center();
             return bboxes[i] = bbox;
         });
 
-    auto bvh = Builder::build(top_down_scheduler, executor, global_bbox, bboxes.get(), centers.get(), triangle_count());
-    bvh::TopologyModifier topo_modifier(bvh, bvh.parents(executor));
-    bvh::SequentialReinsertionOptimizer<Bvh>::optimize(topo_modifier);
-    return std::make_unique<BvhData>(BvhData { std::move(bvh) });
+    auto build = [&] <typename Builder> () {
+        TopDownScheduler<Builder> top_down_scheduler;
+        return Builder::build(top_down_scheduler, executor, global_bbox, bboxes.get(), centers.get(), triangle_count());
+    };
+
+    Bvh bvh;
+    if (config_.bvh_quality == BvhQuality::Low)
+        bvh = build.template operator()<bvh::BinnedSahBuilder<Bvh, 16>>();
+    else
+        bvh = build.template operator()<bvh::SweepSahBuilder<Bvh>>();
+    if (config_.bvh_quality == BvhQuality::High)
+        ParallelReinsertionOptimizer<Bvh>::optimize(executor, bvh);
+
+    auto bvh_data = std::make_unique<BvhData>(BvhData { std::move(bvh) });
+    bvh_data->bbox = global_bbox;
+    build_leaf_blocks(*bvh_data);
+    bvh_data->depth = compute_depth(bvh_data->bvh);
+    if (config_.compact) {
+        auto& prim_indices = bvh_data->prim_indices;
+        bvh_data->compact_prim_indices.resize(prim_indices.size());
+        std::transform(prim_indices.begin(), prim_indices.end(), bvh_data->compact_prim_indices.begin(), [] (size_t i) {
+            return i == BvhData::invalid_index ? BvhData::invalid_compact_index : static_cast<uint32_t>(i);
+        });
+        prim_indices = {};
+    }
+    auto collapse = [&] <size_t Arity> () {
+        auto wide_bvh = WideBvh<Arity>::collapse(bvh_data->bvh);
+        // Leaves that are too large for compressed nodes are kept in the uncompressed layout, along with the binary BVH
+        if (config_.compress_bvh && QuantizedBvh<Arity>::can_compress(wide_bvh)) {
+            bvh_data->traversal_bvh = QuantizedBvh<Arity>::compress(wide_bvh);
+            bvh_data->bvh = Bvh();
+        } else
+            bvh_data->traversal_bvh = std::move(wide_bvh);
+    };
+    if (config_.bvh_arity == 4)
+        collapse.template operator()<4>();
+    else if (config_.bvh_arity == 8)
+        collapse.template operator()<8>();
+    else
+        assert(config_.bvh_arity == 2 && !config_.compress_bvh);
+    return bvh_data;
+}
+
+void TriangleMesh::build_leaf_blocks(BvhData& bvh_data) const {
+    // Leaves are made to contain at most one block of triangles when possible: Subtrees that contain
+    // fewer triangles than the block size are turned into leaves. Leaves that are still larger
+    // than a block are split over several blocks, the last one being padded.
+    auto& bvh = bvh_data.bvh;
+    std::vector<size_t> subtree_prim_counts(bvh.node_count, 0);
+    std::vector<size_t> stack;
+    auto count_prims = [&] (auto&& count_prims, size_t node_index) -> size_t {
+        auto& node = bvh.nodes[node_index];
+        return subtree_prim_counts[node_index] = node.is_leaf()
+            ? node.prim_count
+            : count_prims(count_prims, node.first_index) + count_prims(count_prims, node.first_index + 1);
+    };
+    count_prims(count_prims, 0);
+
+    auto& prim_indices = bvh_data.prim_indices;
+    auto gather_prims = [&] (auto&& gather_prims, size_t node_index) -> void {
+        auto& node = bvh.nodes[node_index];
+        if (node.is_leaf()) {
+            for (size_t i = node.first_index, n = i + node.prim_count; i < n; ++i)
+                prim_indices.push_back(bvh.prim_indices[i]);
+        } else {
+            gather_prims(gather_prims, node.first_index + 0);
+            gather_prims(gather_prims, node.first_index + 1);
+        }
+    };
+
+    stack.push_back(0);
+    while (!stack.empty()) {
+        auto node_index = stack.back();
+        stack.pop_back();
+        auto& node = bvh.nodes[node_index];
+        if (!node.is_leaf() && subtree_prim_counts[node_index] > TriangleBlock::size) {
+            stack.push_back(node.first_index + 0);
+            stack.push_back(node.first_index + 1);
+            continue;
+        }
+
+        auto first_block = prim_indices.size() / TriangleBlock::size;
+        gather_prims(gather_prims, node_index);
+        auto block_count = (subtree_prim_counts[node_index] + TriangleBlock::size - 1) / TriangleBlock::size;
+        prim_indices.resize((first_block + block_count) * TriangleBlock::size, BvhData::invalid_index);
+
+        // The node is turned into a leaf referencing a range of blocks.
+        // Its children, if any, become unreachable.
+        node.first_index = first_block;
+        node.prim_count  = block_count;
+    }
+}
+
+const Light* TriangleMesh::light_at(size_t permuted_index) const {
+    if (emissive_blocks_.empty())
+        return nullptr;
+    auto& emissive_block = emissive_blocks_[permuted_index / TriangleBlock::size];
+    auto lane = permuted_index % TriangleBlock::size;
+    if ((emissive_block.lane_mask & (uint32_t{1} << lane)) == 0)
+        return nullptr;
+    // The lights of the emissive lanes that precede this one come first
+    auto rank = std::popcount(emissive_block.lane_mask & ((uint32_t{1} << lane) - 1));
+    return lights_[emissive_block.first_light + rank];
+}
+
+void TriangleMesh::build_light_table(const std::unordered_map<size_t, const Light*>& lights) {
+    // Lights are stored in the same order as the triangle blocks, so that finding the light
+    // associated with a hit does not require any hashing. Meshes without lights do not store anything.
+    static_assert(TriangleBlock::size <= 32);
+    emissive_blocks_.clear();
+    lights_.clear();
+    if (lights.empty())
+        return;
+    emissive_blocks_.resize(bvh_data_->prim_index_count() / TriangleBlock::size);
+    for (size_t i = 0; i < emissive_blocks_.size(); ++i) {
+        auto& emissive_block = emissive_blocks_[i];
+        emissive_block.first_light = static_cast<uint32_t>(lights_.size());
+        for (size_t lane = 0; lane < TriangleBlock::size; ++lane) {
+            auto prim_index = bvh_data_->prim_index(i * TriangleBlock::size + lane);
+            if (prim_index == BvhData::invalid_index)
+                continue;
+            if (auto it = lights.find(prim_index); it != lights.end()) {
+                emissive_block.lane_mask |= uint32_t{1} << lane;
+                lights_.push_back(it->second);
+            }
+        }
+    }
+}
+
+std::vector<const Light*> TriangleMesh::lights() const {
+    std::vector<const Light*> lights;
+    std::unordered_set<const Light*> seen;
+    for (auto light : lights_) {
+        if (seen.insert(light).second)
+            lights.push_back(light);
+    }
+    return lights;
 }
 
 template <typename Executor>
-std::vector<proto::PrecomputedTrianglef> TriangleMesh::build_triangles(Executor& executor, const std::vector<proto::Vec3f>& vertices) const {
+std::vector<TriangleMesh::TriangleBlock> TriangleMesh::build_triangles(Executor& executor, const std::vector<proto::Vec3f>& vertices) const {
     // Build a permuted array of triangles, so as to avoid indirections when intersecting the mesh with a ray.
-    std::vector<proto::PrecomputedTrianglef> triangles(triangle_count());
-    par::for_each(executor, par::range_1d(size_t{0}, triangle_count()), [&] (size_t i) {
-        auto j = bvh_data_->bvh.prim_indices[i];
-        triangles[i] = proto::PrecomputedTrianglef(
-            vertices[indices_[j * 3 + 0]],
-            vertices[indices_[j * 3 + 1]],
-            vertices[indices_[j * 3 + 2]]);
+    auto& prim_indices = bvh_data_->prim_indices;
+    std::vector<TriangleBlock> triangles(prim_indices.size() / TriangleBlock::size);
+    par::for_each(executor, par::range_1d(size_t{0}, triangles.size()), [&] (size_t i) {
+        for (size_t lane = 0; lane < TriangleBlock::size; ++lane) {
+            auto j = prim_indices[i * TriangleBlock::size + lane];
+            if (j == BvhData::invalid_index)
+                continue;
+            auto [i0, i1, i2] = triangle_indices(j);
+            triangles[i].set(lane, vertices[i0], vertices[i1], vertices[i2]);
+        }
     });
     return triangles;
 }
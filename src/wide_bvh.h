@@ -0,0 +1,213 @@
+#ifndef SOL_WIDE_BVH_H
+#define SOL_WIDE_BVH_H
+
+#include <array>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+#include <stdexcept>
+
+#include <proto/vec.h>
+#include <proto/ray.h>
+#include <proto/bbox.h>
+
+#include "traversal_stack.h"
+
+namespace sol {
+
+/// BVH with `Arity` children per node, obtained by collapsing a binary BVH.
+/// The bounding boxes of the children are stored in SoA form, so that
+/// all of them can be intersected with a ray in one vectorizable loop.
+template <size_t Arity>
+struct WideBvh {
+    static_assert(Arity >= 2);
+    static constexpr size_t arity = Arity;
+
+    struct Node {
+        std::array<float, Arity> min[3];
+        std::array<float, Arity> max[3];
+        std::array<uint32_t, Arity> first_index; ///< Index of the child node, or of the first primitive for leaves
+        std::array<uint32_t, Arity> prim_count;  ///< Number of primitives for leaves, 0 for inner nodes
+
+        // Empty child slots have an inverted bounding box, which is never hit by any ray
+        bool is_empty(size_t i) const { return min[0][i] > max[0][i]; }
+        bool is_leaf(size_t i) const { return prim_count[i] != 0; }
+
+        void set_child(size_t i, const proto::BBoxf& bbox, uint32_t first, uint32_t count) {
+            for (int j = 0; j < 3; ++j) {
+                min[j][i] = bbox.min[j];
+                max[j][i] = bbox.max[j];
+            }
+            first_index[i] = first;
+            prim_count[i] = count;
+        }
+
+        void clear_child(size_t i) {
+            for (int j = 0; j < 3; ++j) {
+                min[j][i] = +std::numeric_limits<float>::max();
+                max[j][i] = -std::numeric_limits<float>::max();
+            }
+            first_index[i] = 0;
+            prim_count[i] = 0;
+        }
+    };
+
+    std::vector<Node> nodes;
+    size_t depth = 0;   ///< Number of levels of inner nodes, which bounds the size of the traversal stack
+
+    /// Collapses a binary BVH into a wide one. The leaves of the binary BVH are preserved,
+    /// which means that the primitive indices of the original BVH are still valid.
+    template <typename Bvh>
+    static WideBvh collapse(const Bvh& bvh) {
+        WideBvh wide_bvh;
+        wide_bvh.nodes.emplace_back();
+        auto& root = bvh.nodes[0];
+        if (root.is_leaf()) {
+            for (size_t i = 1; i < Arity; ++i)
+                wide_bvh.nodes[0].clear_child(i);
+            wide_bvh.nodes[0].set_child(0, root.bbox(), root.first_index, root.prim_count);
+        } else
+            wide_bvh.collapse(bvh, 0, 0);
+        wide_bvh.update_depth();
+        return wide_bvh;
+    }
+
+    /// Recomputes the depth of the BVH from its nodes. Children are always stored after their parent,
+    /// which allows to process nodes in reverse order. Throws an exception if the nodes violate that property.
+    void update_depth() {
+        std::vector<size_t> depths(nodes.size(), 1);
+        for (size_t i = nodes.size(); i-- > 0;) {
+            for (size_t j = 0; j < Arity; ++j) {
+                if (nodes[i].is_empty(j) || nodes[i].is_leaf(j))
+                    continue;
+                auto child_index = nodes[i].first_index[j];
+                if (child_index <= i || child_index >= nodes.size())
+                    throw std::runtime_error("Invalid child index in BVH node");
+                depths[i] = std::max(depths[i], depths[child_index] + 1);
+            }
+        }
+        depth = nodes.empty() ? 0 : depths[0];
+    }
+
+    /// Intersects the BVH with a ray, calling the given function for each leaf that is hit.
+    /// The children of each node, leaves included, are visited in front-to-back order.
+    /// The leaf function takes the ray and a range of primitives, and returns either an optional value
+    /// (when `IsAnyHit` is false), in which case the last value it returned is the result of the traversal,
+    /// or a boolean (when `IsAnyHit` is true), in which case the traversal stops as soon as it returns true.
+    template <bool IsAnyHit, typename LeafFn>
+    auto traverse(proto::Rayf& ray, LeafFn&& leaf_fn) const {
+        using Result = std::invoke_result_t<LeafFn, proto::Rayf&, size_t, size_t>;
+        Result result {};
+
+        std::array<float, 3> org, inv_dir;
+        for (int i = 0; i < 3; ++i) {
+            org[i] = ray.org[i];
+            inv_dir[i] = 1.0f / ray.dir[i];
+        }
+
+        // Leaves are pushed on the stack like inner nodes, so that they are sorted along with them.
+        // Each visited node replaces itself with at most `Arity` children, hence the capacity.
+        struct StackElem { uint32_t first_index, prim_count; float entry; };
+        TraversalStack<StackElem> stack((Arity - 1) * depth + 1);
+        stack.push(StackElem { 0, 0, ray.tmin });
+
+        while (!stack.is_empty()) {
+            auto elem = stack.pop();
+            if (elem.entry > ray.tmax)
+                continue;
+
+            if (elem.prim_count != 0) {
+                auto leaf_result = leaf_fn(ray, elem.first_index, elem.first_index + elem.prim_count);
+                if constexpr (IsAnyHit) {
+                    if (leaf_result)
+                        return leaf_result;
+                } else if (leaf_result)
+                    result = leaf_result;
+                continue;
+            }
+
+            auto& node = nodes[elem.first_index];
+            std::array<float, Arity> entry;
+            std::array<bool, Arity> hit;
+            // This loop is written so that the compiler can vectorize it
+            for (size_t i = 0; i < Arity; ++i) {
+                auto tx0 = (node.min[0][i] - org[0]) * inv_dir[0];
+                auto tx1 = (node.max[0][i] - org[0]) * inv_dir[0];
+                auto ty0 = (node.min[1][i] - org[1]) * inv_dir[1];
+                auto ty1 = (node.max[1][i] - org[1]) * inv_dir[1];
+                auto tz0 = (node.min[2][i] - org[2]) * inv_dir[2];
+                auto tz1 = (node.max[2][i] - org[2]) * inv_dir[2];
+                auto t0 = std::max(std::max(std::min(tx0, tx1), std::min(ty0, ty1)), std::max(std::min(tz0, tz1), ray.tmin));
+                auto t1 = std::min(std::min(std::max(tx0, tx1), std::max(ty0, ty1)), std::min(std::max(tz0, tz1), ray.tmax));
+                entry[i] = t0;
+                hit[i] = t0 <= t1 && node.min[0][i] <= node.max[0][i];
+            }
+
+            auto first_pushed = stack.size();
+            for (size_t i = 0; i < Arity; ++i) {
+                if (hit[i])
+                    stack.push(StackElem { node.first_index[i], node.prim_count[i], entry[i] });
+            }
+
+            // Sort the children that were just pushed so that the closest is popped first
+            std::sort(stack.begin() + first_pushed, stack.end(),
+                [] (const StackElem& a, const StackElem& b) { return a.entry > b.entry; });
+        }
+        return result;
+    }
+
+private:
+    template <typename Bvh>
+    void collapse(const Bvh& bvh, size_t bvh_node_index, size_t wide_node_index) {
+        // Greedily open the child with the largest area until the node is full
+        std::array<size_t, Arity> children;
+        size_t child_count = 2;
+        children[0] = bvh.nodes[bvh_node_index].first_index + 0;
+        children[1] = bvh.nodes[bvh_node_index].first_index + 1;
+        while (child_count < Arity) {
+            size_t best = child_count;
+            float best_area = -1.0f;
+            for (size_t i = 0; i < child_count; ++i) {
+                auto& child = bvh.nodes[children[i]];
+                if (child.is_leaf())
+                    continue;
+                auto area = half_area(child.bbox());
+                if (area > best_area) {
+                    best_area = area;
+                    best = i;
+                }
+            }
+            if (best == child_count)
+                break;
+            auto first_index = bvh.nodes[children[best]].first_index;
+            children[best] = first_index + 0;
+            children[child_count++] = first_index + 1;
+        }
+
+        for (size_t i = child_count; i < Arity; ++i)
+            nodes[wide_node_index].clear_child(i);
+        for (size_t i = 0; i < child_count; ++i) {
+            auto& child = bvh.nodes[children[i]];
+            if (child.is_leaf()) {
+                nodes[wide_node_index].set_child(i, child.bbox(), child.first_index, child.prim_count);
+            } else {
+                // Note: `nodes` may be reallocated here, so the current node cannot be kept as a reference
+                auto child_index = nodes.size();
+                nodes.emplace_back();
+                nodes[wide_node_index].set_child(i, child.bbox(), child_index, 0);
+                collapse(bvh, children[i], child_index);
+            }
+        }
+    }
+
+    static float half_area(const proto::BBoxf& bbox) {
+        auto e = bbox.max - bbox.min;
+        return e[0] * (e[1] + e[2]) + e[1] * e[2];
+    }
+};
+
+} // namespace sol
+
+#endif
@@ -1,4 +1,5 @@
 #include <optional>
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 #include <chrono>
@@ -8,10 +9,15 @@
 
 #include <sol/scene.h>
 #include <sol/image.h>
+#include <sol/aovs.h>
+#include <sol/denoiser.h>
 #include <sol/render_job.h>
 #include <sol/algorithms/path_tracer.h>
+#include <sol/algorithms/wavefront_path_tracer.h>
+#include <sol/algorithms/bdpt.h>
+#include <sol/algorithms/sppm.h>
 
-static const std::unordered_set<std::string> valid_algorithms = { "path_tracer" };
+static const std::unordered_set<std::string> valid_algorithms = { "path_tracer", "wavefront_path_tracer", "bdpt", "sppm" };
 
 struct Options {
     std::string scene_file;
@@ -19,16 +25,28 @@ struct Options {
     sol::Image::Format out_format = sol::Image::Format::Auto;
 
     std::string algorithm = "path_tracer";
+    sol::LightSamplerType light_sampler = sol::LightSamplerType::Tree;
+    sol::SamplerType sampler = sol::SamplerType::Random;
 
     size_t output_width = 1080;
     size_t output_height = 720;
     size_t samples_per_pixel = 16;
+    size_t tile_size = 16;
+    size_t frame_ms = 0;
+    bool max_throughput = false;
+    float target_error = 0.0f;
+    bool path_guiding = false;
+    sol::AovLayout aovs;
+    bool denoise = false;
 
     size_t max_path_len = 64;
     size_t min_rr_path_len = 3;
     float min_survival_prob = 0.05f;
     float max_survival_prob = 0.75f;
     float ray_offset  = 1e-5f;
+
+    size_t photon_count = 1 << 18;
+    float initial_radius = 0.02f;
 };
 
 static void usage() {
@@ -44,10 +62,26 @@ static void usage() {
         << default_options.algorithm << "')\n"
         "  -s <n>     --samples <n>               Sets the number of samples per pixel (default: "
         << default_options.samples_per_pixel << ")\n"
+        "             --light-sampler <type>      Sets the strategy used to pick lights: uniform, power, or tree (default: tree)\n"
+        "             --sampler <type>            Sets the sampler used to generate paths: random, sobol, or pmj02 (default: random,\n"
+        "                                         path tracer only for other samplers)\n"
         "  -w <n>     --width <n>                 Sets the output width, in pixels (default: "
         << default_options.output_width << ")\n"
         "  -h <n>     --height <n>                Sets the output height, in pixels (default: "
         << default_options.output_height << ")\n"
+        "             --tile-size <n>             Sets the size of the tiles that are distributed over threads (default: "
+        << default_options.tile_size << ")\n"
+        "             --target-error <e>          Enables adaptive sampling, stopping pixels at the given relative error (default: "
+        << default_options.target_error << ", path tracer only)\n"
+        "             --frame-ms <ms>             Adjusts the number of samples per frame so that frames take the given time\n"
+        "                                         (default: fixed number of samples per frame)\n"
+        "             --max-throughput            Increases the number of samples per frame as long as it improves the number\n"
+        "                                         of samples rendered per second\n"
+        "             --path-guiding              Enables path guiding, learned over several frames (path tracer only)\n"
+        "             --aovs <list>               Adds the given comma-separated AOVs to the output image: albedo, normal, depth,\n"
+        "                                         or samples (path tracer only, saved as layers of an EXR image)\n"
+        "             --denoise                   Denoises the output image, using the albedo and normal AOVs as guides\n"
+        "                                         (path tracer only)\n"
         "             --max-path-len <len>        Sets the maximum path length (default: "
         << default_options.max_path_len << ")\n"
         "             --min-survival-prob <prob>  Sets the minimum Russian Roulette survival probability (default: "
@@ -58,6 +92,10 @@ static void usage() {
         << default_options.min_rr_path_len << ")\n"
         "             --ray-offset <off>          Sets the ray offset used to avoid self intersections (default: "
         << default_options.ray_offset << ")\n"
+        "             --photon-count <n>          Sets the number of photons traced per sample, for photon mapping (default: "
+        << default_options.photon_count << ")\n"
+        "             --initial-radius <r>        Sets the initial photon gathering radius, for photon mapping (default: "
+        << default_options.initial_radius << ")\n"
         "\nValid image formats:\n"
         "  auto, png, jpeg, exr, tiff\n"
         "\nValid algorithms:\n  ";
@@ -111,6 +149,26 @@ static std::optional<Options> parse_options(int argc, char** argv) {
                     std::cerr << "Unknown rendering algorithm '" << argv[i] << "'" << std::endl;
                     return std::nullopt;
                 }
+            } else if (argv[i] == "--light-sampler"sv) {
+                if (!must_have_arg(i++, argc, argv))
+                    return std::nullopt;
+                if      (argv[i] == "uniform"sv) options.light_sampler = sol::LightSamplerType::Uniform;
+                else if (argv[i] == "power"sv)   options.light_sampler = sol::LightSamplerType::Power;
+                else if (argv[i] == "tree"sv)    options.light_sampler = sol::LightSamplerType::Tree;
+                else {
+                    std::cerr << "Unknown light sampler '" << argv[i] << "'" << std::endl;
+                    return std::nullopt;
+                }
+            } else if (argv[i] == "--sampler"sv) {
+                if (!must_have_arg(i++, argc, argv))
+                    return std::nullopt;
+                if      (argv[i] == "random"sv) options.sampler = sol::SamplerType::Random;
+                else if (argv[i] == "sobol"sv)  options.sampler = sol::SamplerType::Sobol;
+                else if (argv[i] == "pmj02"sv)  options.sampler = sol::SamplerType::Pmj02;
+                else {
+                    std::cerr << "Unknown sampler '" << argv[i] << "'" << std::endl;
+                    return std::nullopt;
+                }
             } else if (argv[i] == "-w"sv || argv[i] == "--width"sv) {
                 if (!must_have_arg(i++, argc, argv))
                     return std::nullopt;
@@ -123,6 +181,38 @@ static std::optional<Options> parse_options(int argc, char** argv) {
                 if (!must_have_arg(i++, argc, argv))
                     return std::nullopt;
                 options.samples_per_pixel = std::strtoul(argv[i], NULL, 10);
+            } else if (argv[i] == "--tile-size"sv) {
+                if (!must_have_arg(i++, argc, argv))
+                    return std::nullopt;
+                options.tile_size = std::max(std::strtoul(argv[i], NULL, 10), 1ul);
+            } else if (argv[i] == "--target-error"sv) {
+                if (!must_have_arg(i++, argc, argv))
+                    return std::nullopt;
+                options.target_error = std::strtof(argv[i], NULL);
+            } else if (argv[i] == "--frame-ms"sv) {
+                if (!must_have_arg(i++, argc, argv))
+                    return std::nullopt;
+                options.frame_ms = std::strtoul(argv[i], NULL, 10);
+            } else if (argv[i] == "--max-throughput"sv) {
+                options.max_throughput = true;
+            } else if (argv[i] == "--path-guiding"sv) {
+                options.path_guiding = true;
+            } else if (argv[i] == "--aovs"sv) {
+                if (!must_have_arg(i++, argc, argv))
+                    return std::nullopt;
+                std::istringstream list(argv[i]);
+                for (std::string aov; std::getline(list, aov, ',');) {
+                    if      (aov == "albedo")  options.aovs.albedo = true;
+                    else if (aov == "normal")  options.aovs.normal = true;
+                    else if (aov == "depth")   options.aovs.depth = true;
+                    else if (aov == "samples") options.aovs.sample_count = true;
+                    else {
+                        std::cerr << "Unknown AOV '" << aov << "'" << std::endl;
+                        return std::nullopt;
+                    }
+                }
+            } else if (argv[i] == "--denoise"sv) {
+                options.denoise = true;
             } else if (argv[i] == "--max-path-len"sv) {
                 if (!must_have_arg(i++, argc, argv))
                     return std::nullopt;
@@ -143,6 +233,14 @@ static std::optional<Options> parse_options(int argc, char** argv) {
                 if (!must_have_arg(i++, argc, argv))
                     return std::nullopt;
                 options.ray_offset = std::strtof(argv[i], NULL);
+            } else if (argv[i] == "--photon-count"sv) {
+                if (!must_have_arg(i++, argc, argv))
+                    return std::nullopt;
+                options.photon_count = std::strtoul(argv[i], NULL, 10);
+            } else if (argv[i] == "--initial-radius"sv) {
+                if (!must_have_arg(i++, argc, argv))
+                    return std::nullopt;
+                options.initial_radius = std::strtof(argv[i], NULL);
             } else {
                 std::cerr << "Unknown option '" << argv[i] << "'" << std::endl;
                 return std::nullopt;
@@ -160,6 +258,30 @@ static std::optional<Options> parse_options(int argc, char** argv) {
             "Type 'driver -h' to show usage" << std::endl;
         return std::nullopt;
     }
+    if (options.frame_ms != 0 && options.max_throughput) {
+        std::cerr << "Options '--frame-ms' and '--max-throughput' cannot be used together" << std::endl;
+        return std::nullopt;
+    }
+    if (options.sampler != sol::SamplerType::Random && options.algorithm != "path_tracer") {
+        std::cerr << "Samplers other than 'random' are only supported by the 'path_tracer' algorithm" << std::endl;
+        return std::nullopt;
+    }
+    if (options.target_error > 0 && options.algorithm != "path_tracer") {
+        std::cerr << "Adaptive sampling is only supported by the 'path_tracer' algorithm" << std::endl;
+        return std::nullopt;
+    }
+    if (options.path_guiding && options.algorithm != "path_tracer") {
+        std::cerr << "Path guiding is only supported by the 'path_tracer' algorithm" << std::endl;
+        return std::nullopt;
+    }
+    if (options.aovs.has_any() && options.algorithm != "path_tracer") {
+        std::cerr << "AOVs are only supported by the 'path_tracer' algorithm" << std::endl;
+        return std::nullopt;
+    }
+    if (options.denoise && options.algorithm != "path_tracer") {
+        std::cerr << "Denoising is only supported by the 'path_tracer' algorithm" << std::endl;
+        return std::nullopt;
+    }
     return std::make_optional(options);
 }
 
@@ -176,8 +298,13 @@ static bool save_image(const sol::Image& image, const Options& options) {
         if (options.out_file.ends_with(".exr"))
             format = sol::Image::Format::Exr;
     }
+    if (image.channel_count() > 3 && format != sol::Image::Format::Exr) {
+        std::cout << "AOVs can only be saved in the EXR format, use an '.exr' file name or '-f exr'" << std::endl;
+        return false;
+    }
     if (!image.save(options.out_file, format)) {
-        if (format != sol::Image::Format::Auto &&
+        // Other formats would silently drop the AOVs
+        if (format != sol::Image::Format::Auto && image.channel_count() <= 3 &&
             image.save(options.out_file, sol::Image::Format::Auto)) {
             std::cout << "Image could not be saved in the given format, so the default format was used instead" << std::endl;
             return true;
@@ -198,6 +325,7 @@ int main(int argc, char** argv) {
     scene_defaults.aspect_ratio =
         static_cast<float>(options->output_width) /
         static_cast<float>(options->output_height);
+    scene_defaults.light_sampler = options->light_sampler;
 
     std::ostringstream err_stream;
     auto scene = sol::Scene::load(options->scene_file, scene_defaults, &err_stream);
@@ -213,32 +341,117 @@ int main(int argc, char** argv) {
         << "    " << scene->textures.size() << " texture(s)\n"
         << "    " << scene->images.size() << " image(s)\n";
 
-    std::unique_ptr<sol::Renderer> renderer;
-    assert(options->algorithm == "path_tracer");
-    renderer = std::make_unique<sol::PathTracer>(*scene, sol::PathTracer::Config {
+    // The denoiser is guided by the albedo and normals, so they are always rendered when denoising
+    auto render_aovs = options->aovs;
+    if (options->denoise)
+        render_aovs.albedo = render_aovs.normal = true;
+
+    sol::PathTracer::Config path_tracer_config {
         .max_path_len      = options->max_path_len,
         .min_rr_path_len   = options->min_rr_path_len,
         .min_survival_prob = options->min_survival_prob,
         .max_survival_prob = options->max_survival_prob,
-        .ray_offset        = options->ray_offset
-    });
+        .ray_offset        = options->ray_offset,
+        .adaptive_sampling = { .target_error = options->target_error },
+        .sampler           = options->sampler,
+        .path_guiding      = { .enable = options->path_guiding },
+        .aovs              = render_aovs
+    };
+
+    std::unique_ptr<sol::Renderer> renderer;
+    if (options->algorithm == "wavefront_path_tracer") {
+        renderer = std::make_unique<sol::WavefrontPathTracer>(*scene, sol::WavefrontPathTracer::Config {
+            .max_path_len      = options->max_path_len,
+            .min_rr_path_len   = options->min_rr_path_len,
+            .min_survival_prob = options->min_survival_prob,
+            .max_survival_prob = options->max_survival_prob,
+            .ray_offset        = options->ray_offset
+        });
+    } else if (options->algorithm == "bdpt") {
+        renderer = std::make_unique<sol::Bdpt>(*scene, sol::Bdpt::Config {
+            .max_path_len      = options->max_path_len,
+            .min_rr_path_len   = options->min_rr_path_len,
+            .min_survival_prob = options->min_survival_prob,
+            .max_survival_prob = options->max_survival_prob,
+            .ray_offset        = options->ray_offset
+        });
+    } else if (options->algorithm == "sppm") {
+        renderer = std::make_unique<sol::Sppm>(*scene, sol::Sppm::Config {
+            .max_path_len      = options->max_path_len,
+            .min_rr_path_len   = options->min_rr_path_len,
+            .min_survival_prob = options->min_survival_prob,
+            .max_survival_prob = options->max_survival_prob,
+            .ray_offset        = options->ray_offset,
+            .photon_count      = options->photon_count,
+            .initial_radius    = options->initial_radius
+        });
+    } else {
+        assert(options->algorithm == "path_tracer");
+        renderer = std::make_unique<sol::PathTracer>(*scene, path_tracer_config);
+    }
+
+    renderer->tile_scheduler().set_tile_size(options->tile_size);
 
-    sol::Image output(options->output_width, options->output_height, 3);
+    auto output = render_aovs.create_image(options->output_width, options->output_height);
     sol::RenderJob render_job(*renderer, output);
 
     render_job.sample_count = options->samples_per_pixel;
     render_job.samples_per_frame = options->samples_per_pixel;
+    // Adaptive sampling needs several frames to be able to stop converged pixels
+    if (path_tracer_config.adaptive_sampling.target_error > 0)
+        render_job.samples_per_frame = std::min(options->samples_per_pixel, path_tracer_config.adaptive_sampling.min_samples);
+    // Path guiding learns the distribution that a frame samples from during the previous frames
+    if (path_tracer_config.path_guiding.enable)
+        render_job.samples_per_frame = std::max(options->samples_per_pixel / 8, size_t{1});
+    // Start from one sample per frame, and let the job find how many samples fit in the requested time
+    if (options->frame_ms != 0) {
+        render_job.frame_pacing = sol::RenderJob::FramePacing::Latency;
+        render_job.target_frame_ms = options->frame_ms;
+        render_job.samples_per_frame = 1;
+    }
+    // Start from one sample per frame, and let the job find the frame size that renders samples the fastest
+    if (options->max_throughput) {
+        render_job.frame_pacing = sol::RenderJob::FramePacing::Throughput;
+        render_job.samples_per_frame = 1;
+    }
 
     auto render_start = std::chrono::system_clock::now();
-    render_job.start();
+    size_t frame_count = 0;
+    render_job.start([&] (const sol::RenderJob&) { frame_count++; return true; });
     std::cout << "Rendering started..." << std::endl;
     render_job.wait();
     auto render_end = std::chrono::system_clock::now();
     auto rendering_ms = std::chrono::duration_cast<std::chrono::milliseconds>(render_end - render_start).count();
-    std::cout << "Rendering finished in " << rendering_ms << "ms" << std::endl;
+    std::cout << "Rendering finished in " << rendering_ms << "ms (" << frame_count << " frame(s), last with "
+        << render_job.frame_sample_count() << " sample(s) in " << render_job.frame_ms() << "ms)" << std::endl;
+    if (render_job.is_converged())
+        std::cout << "Image converged after " << render_job.rendered_sample_count() << " sample(s) per pixel" << std::endl;
 
     if (!options->out_file.empty()) {
-        output.scale(1.0f / static_cast<float>(render_job.sample_count));
+        render_aovs.normalize(output, render_job.rendered_sample_count());
+        if (options->denoise) {
+            auto denoise_start = std::chrono::system_clock::now();
+            sol::Denoiser denoiser;
+            denoiser.tile_scheduler().set_tile_size(options->tile_size);
+            auto denoised = denoiser.denoise(output, render_aovs);
+            // Only keep the AOVs that were requested, and not the ones that were only rendered as guides
+            auto result = options->aovs.create_image(output.width(), output.height());
+            auto pixel_count = output.width() * output.height();
+            for (size_t i = 0; i < 3; ++i)
+                std::copy_n(denoised.channel(i).get(), pixel_count, result.channel(i).get());
+            for (auto aov : { sol::Aov::Albedo, sol::Aov::Normal, sol::Aov::Depth, sol::Aov::SampleCount }) {
+                auto channel = options->aovs.first_channel(aov);
+                if (!channel)
+                    continue;
+                auto render_channel = *render_aovs.first_channel(aov);
+                for (size_t i = 0; i < sol::AovLayout::channel_count(aov); ++i)
+                    std::copy_n(output.channel(render_channel + i).get(), pixel_count, result.channel(*channel + i).get());
+            }
+            output = std::move(result);
+            auto denoise_end = std::chrono::system_clock::now();
+            auto denoising_ms = std::chrono::duration_cast<std::chrono::milliseconds>(denoise_end - denoise_start).count();
+            std::cout << "Denoising finished in " << denoising_ms << "ms" << std::endl;
+        }
         if (!save_image(output, *options))
             return 1;
     }